@@ -0,0 +1,33 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+#define ARENA_ALIGNMENT 64              // Cache line, also enough for AVX loads
+#define ARENA_DEFAULT_BLOCK_SIZE (1 << 20)
+
+typedef struct ArenaBlock ArenaBlock;
+
+// Bump allocator for simulation-lifetime data. Memory comes from the system
+// in large blocks; individual allocations are never freed, the whole arena is
+// released (or rewound for reuse) at once.
+typedef struct Arena {
+    ArenaBlock* first;
+    ArenaBlock* current;
+    size_t block_size;
+    size_t used;                // Bytes handed out since the last reset
+    size_t peak;                // Highest `used` ever reached
+    size_t reserved;            // Bytes obtained from the system
+    int allocations;            // Allocations since the last reset
+    int system_allocations;     // Blocks obtained from the system
+} Arena;
+
+Arena* get_simulation_arena(void);
+
+void arena_init(Arena* arena, size_t block_size);
+void* arena_alloc(Arena* arena, size_t size);
+// Rewinds every block for reuse without returning memory to the system
+void arena_reset(Arena* arena);
+void arena_free(Arena* arena);
+
+#endif
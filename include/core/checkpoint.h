@@ -0,0 +1,74 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "core/particle_store.h"
+
+// Binary checkpoint of the whole particle state, for restarting runs.
+//
+// Layout: a CheckpointHeader, then CHECKPOINT_FIELD_COUNT arrays of
+// particle_count 4-byte values, in CheckpointField order. Array f starts at
+// header_size + f * field_stride; the stride is a multiple of
+// CHECKPOINT_ALIGNMENT, so every array can be read straight out of a
+// mapping. Values are in the writer's native byte order; readers reject
+// files whose magic, version, or byte order mark does not match.
+#define CHECKPOINT_MAGIC "FSIMCKPT"
+#define CHECKPOINT_VERSION 2
+#define CHECKPOINT_BYTE_ORDER_MARK 0x01020304u
+#define CHECKPOINT_ALIGNMENT 64
+
+typedef enum CheckpointField {
+    CHECKPOINT_POSITION_X,
+    CHECKPOINT_POSITION_Y,
+    CHECKPOINT_VELOCITY_X,
+    CHECKPOINT_VELOCITY_Y,
+    CHECKPOINT_ACCELERATION_X,
+    CHECKPOINT_ACCELERATION_Y,
+    CHECKPOINT_RADIUS,
+    CHECKPOINT_MASS,
+    CHECKPOINT_CHARGE,
+    CHECKPOINT_REST_X,
+    CHECKPOINT_REST_Y,
+    CHECKPOINT_CALM_STEPS,      // int32
+    CHECKPOINT_ID,              // int32
+    CHECKPOINT_FIELD_COUNT
+} CheckpointField;
+
+typedef struct CheckpointHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order_mark;
+    uint32_t header_size;
+    uint32_t field_count;
+    uint32_t particle_count;
+    float domain_size;
+    uint64_t step;              // Physics steps run when it was written
+    uint64_t field_stride;      // Bytes from one field array to the next
+    uint8_t reserved[16];
+} CheckpointHeader;
+
+// A checkpoint file mapped read-only
+typedef struct Checkpoint {
+    void* map;
+    size_t size;
+    const CheckpointHeader* header;
+} Checkpoint;
+
+// Maps and validates a checkpoint. Returns 0 and prints why on failure.
+int checkpoint_open(const char* path, Checkpoint* checkpoint);
+void checkpoint_close(Checkpoint* checkpoint);
+// Copies the mapped arrays into the store, replacing its particles
+void checkpoint_load(const Checkpoint* checkpoint, ParticleStore* store);
+
+// Copies the store into a staging buffer and writes it to path on a
+// background thread, through a temporary file renamed into place when
+// complete, so the step loop only pays for the copy. Returns 0 without
+// writing when the previous write is still running.
+int checkpoint_write_async(const char* path, const ParticleStore* store, uint64_t step, float domain);
+// Waits for the background write; returns 0 if the last write failed
+int checkpoint_wait(void);
+// Waits, then releases the staging buffer
+void checkpoint_shutdown(void);
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef FIXED_STEP_H
+#define FIXED_STEP_H
+
+#include <stdint.h>
+
+// Fixed-timestep accumulator against the wall clock. Step n is due at
+// origin + n * step_ns; fixed_step_due() hands out every step that has come
+// due since the last call, so simulated time keeps pace with real time no
+// matter how long each call took. When more than max_steps are due at once
+// (the "spiral of death", where catching up takes longer than the time being
+// caught up) the excess is dropped and the schedule slips instead.
+//
+// A display at wall time t shows the state of the last step handed out,
+// blended with the one before by fixed_step_alpha(), so motion stays smooth
+// when the display rate is not a multiple of the step rate.
+typedef struct FixedStepClock {
+    uint64_t step_ns;
+    uint64_t next_due_ns;   // Wall time of the next step
+    int max_steps;          // Per call, the spiral-of-death cap
+    long steps;             // Handed out since init
+    long dropped_steps;     // Skipped by the cap
+    long capped_calls;      // Calls that hit the cap
+} FixedStepClock;
+
+// The first step is due right away
+void fixed_step_init(FixedStepClock* clock, double step_seconds, int max_steps, uint64_t now_ns);
+// Steps to run now, 0..max_steps; the schedule advances past all of them
+int fixed_step_due(FixedStepClock* clock, uint64_t now_ns);
+// Nanoseconds until the next step is due, 0 when it already is
+uint64_t fixed_step_time_until_due(const FixedStepClock* clock, uint64_t now_ns);
+// Wall time at which the last handed-out step was due
+uint64_t fixed_step_last_due(const FixedStepClock* clock);
+// Blend factor in [0, 1] between the state before a step due at due_ns and
+// the state after it, for a display at now_ns
+float fixed_step_alpha(uint64_t step_ns, uint64_t due_ns, uint64_t now_ns);
+
+#endif
@@ -1,12 +1,16 @@
 #ifndef MATH_UTILS_H
 #define MATH_UTILS_H
 
-#include "core/particle.h"
+#include <stdint.h>
+#include "core/particle_store.h"
 
-float distance_on_motion(Particle* particle1, Particle* particle2, float dt);
-void pointing_vector(Particle* particle1, Particle* particle2, float* result);
+float distance_on_motion(const ParticleStore* store, int a, int b, float dt);
+void pointing_vector(const ParticleStore* store, int a, int b, float* result);
 void normalized_vector(const float* vector, float* result);
 float vector_norm(const float* vector);
-float distance(Particle* particle1, Particle* particle2);
+float distance(const ParticleStore* store, int a, int b);
+// Interleaves the low 16 bits of x and y into a Morton (Z-order) code, x in
+// the even bits
+uint32_t morton_encode(uint32_t x, uint32_t y);
 
 #endif
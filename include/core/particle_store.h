@@ -0,0 +1,64 @@
+#ifndef PARTICLE_STORE_H
+#define PARTICLE_STORE_H
+
+#include "core/particle.h"
+
+// Structure-of-arrays particle storage. Every field lives in its own
+// contiguous array and particles are addressed by index, so the hot loops
+// in the integrator, collision code, grid and renderer stream through memory
+// instead of chasing one heap allocation per particle.
+//
+// All `capacity` slots are carved from the simulation arena up front, so
+// adding and removing particles during a run never touches the system
+// allocator. The slots form a pool: removing a particle moves the last one
+// into its slot and puts its id on a free list that the next add takes from,
+// so every live particle keeps its id and ids stay below capacity.
+typedef struct ParticleStore {
+    float* position_x;
+    float* position_y;
+    float* velocity_x;
+    float* velocity_y;
+    float* acceleration_x;
+    float* acceleration_y;
+    float* radius;
+    float* mass;
+    float* charge;
+    float* rest_x;          // Where the current calm streak started, see physics/sleep.h
+    float* rest_y;
+    int* calm_steps;        // Consecutive low-energy steps
+    int* id;                // Stable name of the particle, kept through reordering and removals
+    int* free_ids;          // Ids of removed particles, taken again last in first out
+    int free_id_count;
+    int id_count;           // Ids handed out so far, live or free
+    int count;
+    int capacity;
+
+    // Slot usage counters
+    long created;
+    long destroyed;
+} ParticleStore;
+
+ParticleStore* get_particle_store(void);
+
+void particle_store_init(ParticleStore* store, int capacity);
+void particle_store_free(ParticleStore* store);
+int particle_store_add(ParticleStore* store, const Particle* particle);
+// Moves the last particle into index, so the last index becomes stale in
+// everything that holds particle indices. During a run the recycling pass
+// (spatial/particle_factory.h) fixes those up.
+void particle_store_remove(ParticleStore* store, int index);
+// Bulk reset: drops every particle and frees all ids
+void particle_store_clear(ParticleStore* store);
+// Rebuilds the free id list from the ids of the live particles, after they
+// were written directly (checkpoint loading)
+void particle_store_collect_free_ids(ParticleStore* store);
+void particle_store_get(const ParticleStore* store, int index, Particle* out);
+// Moves the particle at order[k] into slot k, for every k < count. Gathers
+// into a second set of arrays from the arena and swaps them in, so it also
+// invalidates indices and must run between steps.
+void particle_store_permute(ParticleStore* store, const int* order);
+// Copies the live particles and free ids of src into dst, for saving and
+// restoring a state. Slot usage counters are left alone.
+void particle_store_copy(ParticleStore* dst, const ParticleStore* src);
+
+#endif
@@ -1,13 +1,33 @@
 #ifndef PROFILER_H
 #define PROFILER_H
 
-#include <SDL2/SDL.h>
+#include <stddef.h>
+#include <stdint.h>
 
 // Rolling average over 60 frames (~1 second at 60fps)
 #define ROLLING_AVG_FRAMES 60
 // 10-second average at 100Hz (dt=0.01)
 #define FPS_10S_FRAMES 1000
 
+// Phases of physics_step(), timed individually
+typedef enum ProfilerPhase {
+    PHASE_BROAD_PHASE,
+    PHASE_VELOCITY_COLLISION,
+    PHASE_POSITION,
+    PHASE_OVERLAP,
+    PHASE_CONSTRAINTS,
+    PHASE_REPARTITION,
+    PHASE_RECYCLE,
+    PHASE_REORDER,
+    PHASE_SLEEP,
+    PHASE_SPH_DENSITY,
+    PHASE_SPH_FORCES,
+    PHASE_CHARGE_TREE,
+    PHASE_CHARGE_FORCES,
+    PHASE_EXPORT,
+    PHASE_COUNT
+} ProfilerPhase;
+
 typedef struct Profiler {
     float physics_times[ROLLING_AVG_FRAMES];
     float render_times[ROLLING_AVG_FRAMES];
@@ -15,26 +35,49 @@ typedef struct Profiler {
     float fps_history[FPS_10S_FRAMES];
     int current_index;
     int frame_count;
-    Uint64 last_frame_start;
-    Uint64 physics_start;
-    Uint64 render_start;
+    uint64_t last_frame_start;
+    uint64_t physics_start;
+    uint64_t render_start;
+    uint64_t phase_start[PHASE_COUNT];
     float avg_physics_ms;
     float avg_render_ms;
     float avg_frame_ms;
     float current_fps;
     float avg_fps_10s;
+
+    // Running totals since profiler_init(), for end-of-run reports
+    double total_physics_ms;
+    double total_phase_ms[PHASE_COUNT];
+    int physics_steps;
+
+    // Collision pair buffer usage, reported once per physics step
+    int contact_pairs;              // Pairs found in the last step
+    int contact_pairs_peak;
+    long contact_pairs_dropped;     // Lost to the buffer limit since the simulation started
+    int contact_buffer_growths;
+    size_t contact_buffer_bytes;
+
+    // Substeps each physics step was split into
+    int substeps;                   // In the last step
+    int substeps_peak;
+    long total_substeps;
 } Profiler;
 
+// Monotonic clock in nanoseconds
+uint64_t profiler_now_ns(void);
+
 void profiler_init(Profiler* prof);
 void profiler_start_frame(Profiler* prof);
 void profiler_start_physics(Profiler* prof);
 void profiler_end_physics(Profiler* prof);
+void profiler_start_phase(Profiler* prof, ProfilerPhase phase);
+void profiler_end_phase(Profiler* prof, ProfilerPhase phase);
+void profiler_record_contacts(Profiler* prof, int pairs, long dropped, int growths, size_t buffer_bytes);
+void profiler_record_substeps(Profiler* prof, int substeps);
 void profiler_start_render(Profiler* prof);
 void profiler_end_render(Profiler* prof);
 void profiler_end_frame(Profiler* prof);
 void profiler_get_metrics(Profiler* prof, float* physics_ms, float* render_ms, float* frame_ms, float* fps);
-
-// Simple text rendering for metrics overlay
-void profiler_draw_metrics(SDL_Renderer* renderer, Profiler* prof, int particle_count);
+const char* profiler_phase_name(ProfilerPhase phase);
 
 #endif
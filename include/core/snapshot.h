@@ -0,0 +1,54 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdint.h>
+#include "core/particle_store.h"
+
+// Copy of the data the renderer needs, taken at the end of a physics step,
+// with the positions before that step for interpolation
+typedef struct PositionSnapshot {
+    float* position_x;
+    float* position_y;
+    float* previous_x;
+    float* previous_y;
+    float* speed;
+    float* radius;
+    int count;
+    int capacity;
+    int has_previous;     // 0 when the indices changed during the step
+    uint64_t step;        // Physics step that produced the snapshot (first is 1)
+    uint64_t due_ns;      // Wall time the step was scheduled for, see core/fixed_step.h
+    float physics_ms;     // Rolling average physics time when it was taken
+} PositionSnapshot;
+
+void snapshot_init(PositionSnapshot* snapshot, int capacity);
+void snapshot_free(PositionSnapshot* snapshot);
+
+// Lock-free single-producer/single-consumer triple buffer. The producer
+// always owns one slot and the consumer another; the third is the hand-off
+// slot, swapped atomically. Neither side ever waits for the other.
+typedef struct SnapshotBuffer {
+    PositionSnapshot slots[3];
+    int back;      // Producer's slot
+    int front;     // Consumer's slot
+    int middle;    // Hand-off slot; SNAPSHOT_FRESH is set when it is unread
+} SnapshotBuffer;
+
+void snapshot_buffer_init(SnapshotBuffer* buffer, int capacity);
+void snapshot_buffer_free(SnapshotBuffer* buffer);
+
+// Producer side: fill the slot returned by snapshot_begin_write(), then publish
+PositionSnapshot* snapshot_begin_write(SnapshotBuffer* buffer);
+void snapshot_publish(SnapshotBuffer* buffer);
+// Call right before the last step of the snapshot, then snapshot_capture()
+// after it
+void snapshot_capture_previous(PositionSnapshot* snapshot, const ParticleStore* store);
+void snapshot_capture(PositionSnapshot* snapshot, const ParticleStore* store, uint64_t step, uint64_t due_ns,
+                      float physics_ms);
+
+// Consumer side: newest published snapshot, or NULL before the first publish
+const PositionSnapshot* snapshot_acquire_latest(SnapshotBuffer* buffer);
+// Positions blended from before (alpha 0) to after (alpha 1) the step into out
+void snapshot_interpolate(const PositionSnapshot* snapshot, float alpha, PositionSnapshot* out);
+
+#endif
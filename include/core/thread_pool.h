@@ -0,0 +1,22 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#define THREAD_POOL_MAX_THREADS 64
+
+// Work callback: processes items [begin, end) on the given thread.
+// thread_index is stable for the lifetime of the pool (0 is the caller).
+typedef void (*ThreadPoolTask)(void* context, int thread_index, int begin, int end);
+
+// Starts thread_count - 1 worker threads; the calling thread is worker 0
+void thread_pool_init(int thread_count);
+void thread_pool_shutdown(void);
+int thread_pool_size(void);
+
+// Splits [0, count) into chunks of `grain` items handed out dynamically to
+// all threads, and returns once every chunk has been processed
+void thread_pool_parallel_for(int count, int grain, ThreadPoolTask task, void* context);
+// Same, recording one trace zone named `zone` on every thread that takes
+// chunks, instead of the task recording one per chunk
+void thread_pool_parallel_for_traced(const char* zone, int count, int grain, ThreadPoolTask task, void* context);
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef TRAJECTORY_H
+#define TRAJECTORY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "core/particle_store.h"
+
+// Trajectory export. At the end of every physics step whose number is a
+// multiple of the decimation interval, positions and velocities are copied
+// into the next of a ring of staging frames; a writer thread streams full
+// frames to disk in step order. The physics thread never waits for the
+// disk: when the writer is still busy with every staging frame, the new
+// frame is dropped, counted in TrajectoryStats::frames_dropped, and
+// trajectory_close() warns about it. Each dropped frame leaves a gap in
+// the file's step numbers.
+//
+// File layout: a TrajectoryHeader, then one TrajectoryFrameHeader per frame
+// followed by four arrays of particle_count values: position x, position y,
+// velocity x, velocity y. Values are in particle id order
+// (ParticleStore::id), so index k names the same particle in every frame
+// even when --reorder moves particles around in storage. particle_count
+// covers every id handed out; an id that is free at the time of the frame
+// (its particle removed, the id not reused yet) holds NaN in plain frames
+// and TRAJECTORY_FREE_ID_QUANTIZED velocities in quantized ones. Plain
+// frames hold floats. Quantized frames hold uint16 positions in units of
+// domain_size / 65535 and int16 velocities in units of
+// velocity_scale / 32767, where velocity_scale is the frame's largest
+// velocity component.
+#define TRAJECTORY_MAGIC "FSIMTRAJ"
+#define TRAJECTORY_VERSION 1
+#define TRAJECTORY_BYTE_ORDER_MARK 0x01020304u
+#define TRAJECTORY_QUANTIZED 1u
+// Velocity of a free id in quantized frames, below any real value
+#define TRAJECTORY_FREE_ID_QUANTIZED INT16_MIN
+
+typedef struct TrajectoryHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order_mark;
+    uint32_t header_size;
+    uint32_t flags;             // TRAJECTORY_QUANTIZED
+    uint32_t every;             // Steps between frames
+    float domain_size;
+} TrajectoryHeader;
+
+typedef struct TrajectoryFrameHeader {
+    uint64_t step;
+    uint32_t particle_count;
+    float velocity_scale;       // Quantized frames only
+} TrajectoryFrameHeader;
+
+typedef struct TrajectoryStats {
+    long frames_written;
+    long frames_dropped;        // Every staging frame was still being written
+    uint64_t bytes_written;
+    double writer_ms;           // Time the writer thread spent in fwrite
+} TrajectoryStats;
+
+// Opens path and starts the writer; every <= 0 is treated as 1. first_step is
+// the number of steps already run, for runs resumed from a checkpoint.
+// Returns 0 when the file cannot be created.
+int trajectory_open(const char* path, int capacity, int every, int quantize, float domain, uint64_t first_step);
+// Writes the remaining frames and closes the file
+void trajectory_close(void);
+int trajectory_enabled(void);
+// Called once at the end of every physics step
+void trajectory_capture(const ParticleStore* store);
+// Writer statistics; read them after trajectory_close() for exact totals
+const TrajectoryStats* get_trajectory_stats(void);
+
+#endif
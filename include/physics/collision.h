@@ -1,28 +1,130 @@
 #ifndef COLLISION_H
 #define COLLISION_H
 
-#include "core/particle.h"
+#include "core/particle_store.h"
+#include <stddef.h>
 
 extern float particle_restitution;
 extern float wall_restitution;
 
-void detect_and_resolve_collision(Particle* a, Particle* b, float dt);
-void resolve_particle_collision(Particle* a, Particle* b);
-void handle_wall_collision(Particle* p, float dt);
+struct CollisionPairBuffer;
+
+void detect_and_resolve_collision(ParticleStore* store, int a, int b, float dt, struct CollisionPairBuffer* pairs);
+void resolve_particle_collision(ParticleStore* store, int a, int b);
+void handle_wall_collision(ParticleStore* store, int i, float dt);
 
 // Position-based constraint resolution
 void resolve_position_overlaps(int max_iterations);
 void enforce_position_constraints(void);
-void clamp_particle_position(Particle* p);
+void clamp_particle_position(ParticleStore* store, int i);
+
+// Collision pair caching for performance. Each thread appends to its own
+// buffer, so detection never shares a write target between threads. The pairs
+// found while processing one partition are contiguous in that thread's buffer
+// and their range is recorded, letting the solver revisit them per partition.
+// Buffers grow geometrically up to COLLISION_PAIRS_PER_PARTICLE pairs per
+// particle; pairs past that limit are dropped and counted.
+#define COLLISION_PAIRS_PER_PARTICLE 8
 
-// Collision pair caching for performance
 typedef struct CollisionPair {
-    Particle* a;
-    Particle* b;
+    int a;
+    int b;
 } CollisionPair;
 
+typedef struct CollisionPairBuffer {
+    CollisionPair* pairs;
+    int count;
+    int capacity;
+    long dropped;           // Pairs lost to the limit since init
+    int growths;            // Reallocations since init
+} CollisionPairBuffer;
+
+// Pair buffer usage, refreshed by merge_collision_pairs()
+typedef struct CollisionPairStats {
+    int pairs;              // Pairs found in the last step
+    int peak_pairs;         // Most pairs found in any one step
+    long dropped;
+    int growths;
+    size_t reserved_bytes;  // Capacity of all buffers, merged one included
+} CollisionPairStats;
+
+void init_collision_pairs(int buffer_count, int partition_count);
+void cleanup_collision_pairs(void);
 void clear_collision_pairs(void);
-void add_collision_pair(Particle* a, Particle* b);
+CollisionPairBuffer* get_collision_pair_buffer(int thread_index);
+void add_collision_pair(CollisionPairBuffer* buffer, int a, int b);
+void record_partition_pairs(int partition, int thread_index, int begin, int end);
+// Copies every thread's pairs into one buffer in partition order and points
+// the partition ranges at it. Call after detection, before the solvers.
+void merge_collision_pairs(void);
+const CollisionPairStats* get_collision_pair_stats(void);
+// Rewrites every cached pair after the particles were reordered or removed,
+// where new_index maps an old particle index to its new one, or to -1 for a
+// removed particle, whose pairs are dropped
+void remap_collision_pairs(const int* new_index);
+
+// Warm starting from a persistent contact cache (physics/contact_cache.h).
+// Detection then also keeps resting contacts, not only approaching ones.
+// After every solve, the pairs still overlapping are cached by particle id
+// with the correction the solve applied to them, and the rest are evicted.
+// The first sweep of the next solve moves each cached pair apart by
+// CONTACT_WARM_START_FACTOR of that correction, at most its current overlap,
+// before taking the usual fraction of what is left. Contacts that need the
+// same push every step, like those of a pile held up against gravity, then
+// converge in one or two sweeps.
+#define CONTACT_WARM_START_FACTOR 0.8f
+
+// Convergence of the overlap solver, refreshed by every solve
+typedef struct OverlapSolverStats {
+    int iterations;             // Sweeps in the last solve
+    int peak_iterations;
+    long total_iterations;
+    long solves;
+    float residual;             // Deepest overlap left after the last solve
+    float mean_residual;        // Mean over the pairs still overlapping
+    int above_tolerance;        // Pairs left overlapping by more than the tolerance
+    double total_residual;      // Deepest overlaps summed over all solves
+    int cached;                 // Contacts kept for the next solve when warm starting
+    int pair_colors;            // Color batches of the last graph-colored solve
+    int overflow_pairs;         // Pairs of the last graph-colored solve left to the serial batch
+} OverlapSolverStats;
+
+// Call after init_collision_pairs()
+void enable_contact_warm_start(void);
+int contact_warm_start_enabled(void);
+// Overlap below which the solver stops early
+float get_overlap_tolerance(void);
+const OverlapSolverStats* get_overlap_solver_stats(void);
+
+// Overlap solver modes. AUTO runs the partition-colored solver when the step
+// is threaded or deterministic and the sequential one otherwise.
+typedef enum OverlapSolver {
+    OVERLAP_SOLVER_AUTO,
+    OVERLAP_SOLVER_SEQUENTIAL,
+    OVERLAP_SOLVER_PARTITIONS,
+    OVERLAP_SOLVER_GRAPH,
+    OVERLAP_SOLVER_JACOBI
+} OverlapSolver;
+
+const char* overlap_solver_name(OverlapSolver solver);
+
+// Sequential Gauss-Seidel sweep over the merged buffer in partition order
 void resolve_position_overlaps_cached(int max_iterations);
+// Same solver, run color by color with the partitions of a color in parallel.
+// Results do not depend on the number of threads.
+void resolve_position_overlaps_colored(int max_iterations);
+// Gauss-Seidel over the pairs themselves: a greedy coloring gives every pair
+// the lowest of PAIR_COLOR_LIMIT colors its two particles do not use yet, and
+// the pairs of one color run in parallel. Pairs finding no free color form a
+// last batch solved serially. Results do not depend on the number of threads.
+#define PAIR_COLOR_LIMIT 32
+void resolve_position_overlaps_graph(int max_iterations);
+// Jacobi sweeps: every particle sums the corrections of its pairs, computed
+// from the positions at the start of the sweep, and one pass over the
+// particles then applies the sums. Each pair takes the same fraction of its
+// overlap as in the Gauss-Seidel solvers; more sweeps are needed since no
+// pair sees the corrections of the others within one. Results do not depend
+// on the number of threads.
+void resolve_position_overlaps_jacobi(int max_iterations);
 
 #endif
@@ -0,0 +1,28 @@
+#ifndef CONTACT_CACHE_H
+#define CONTACT_CACHE_H
+
+#include <stdint.h>
+
+// Contacts carried from one overlap solve to the next, each with the
+// correction the solve gave it. A contact is keyed by the ids of its two
+// particles (ParticleStore::id), in either order, so reordering and removals
+// leave the cache valid. Open addressing with linear probing in a power of
+// two table at most half full. Every entry carries the generation that wrote
+// it, so clearing the table only bumps the generation.
+typedef struct ContactCache {
+    uint64_t* keys;
+    float* correction;
+    uint32_t* generation;   // Of the write, current entries match cache->current
+    uint32_t current;
+    int count;
+    int capacity;
+} ContactCache;
+
+void contact_cache_free(ContactCache* cache);
+// Drops every contact and makes room for at least `contacts` new ones
+void contact_cache_clear(ContactCache* cache, int contacts);
+void contact_cache_insert(ContactCache* cache, int id_a, int id_b, float correction);
+// Correction stored for the pair, 0 when it is not cached
+float contact_cache_lookup(const ContactCache* cache, int id_a, int id_b);
+
+#endif
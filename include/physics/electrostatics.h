@@ -0,0 +1,41 @@
+#ifndef ELECTROSTATICS_H
+#define ELECTROSTATICS_H
+
+// Coulomb forces between charged particles with a Barnes-Hut quadtree.
+//
+// Every step the particles are sorted along a Morton curve of their bounding
+// square, and the tree is built over the sorted order: a node covers a
+// contiguous range and splits into up to four children, until it holds at
+// most ELECTROSTATICS_LEAF_SIZE particles. Each node stores its total charge
+// and the |q|-weighted center of its charges (a monopole). A node seen from
+// a particle at distance d is used as a whole when size / d < theta;
+// otherwise its children are opened. Pairs are softened by the largest
+// particle radius, so touching particles see a finite force.
+//
+// The top ELECTROSTATICS_SPLIT_LEVEL levels are built serially; the subtrees
+// below them are counted, placed and built in parallel, and the force pass
+// runs in parallel over the sorted particles.
+#define ELECTROSTATICS_LEAF_SIZE 8
+#define ELECTROSTATICS_SPLIT_LEVEL 3
+#define ELECTROSTATICS_MAX_LEVEL 16     // 16 bits per axis in the Morton code
+#define ELECTROSTATICS_DEFAULT_THETA 0.5f
+
+typedef struct ElectrostaticsStats {
+    int nodes;
+    int leaves;
+    int subtrees;               // Built in parallel below the split level
+    long interactions;          // Particle-node and particle-particle terms in the last step
+} ElectrostaticsStats;
+
+// coulomb_constant <= 0 disables the forces; theta 0 sums every pair directly
+void electrostatics_init(float coulomb_constant, float theta);
+void electrostatics_cleanup(void);
+int electrostatics_enabled(void);
+float electrostatics_theta(void);
+void electrostatics_build_tree(void);
+// Coulomb accelerations from the last built tree, plus gravity, into the
+// store's acceleration arrays
+void electrostatics_apply_forces(void);
+const ElectrostaticsStats* get_electrostatics_stats(void);
+
+#endif
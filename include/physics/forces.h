@@ -1,10 +1,12 @@
 #ifndef FORCES_H
 #define FORCES_H
 
-#include "core/particle.h"
+#include "core/particle_store.h"
 
 extern float gravity_acceleration;
+// Side length of the square simulation box, in meters
+extern float domain_size;
 
-void apply_gravity(Particle* p);
+void apply_gravity(ParticleStore* store, int i);
 
 #endif
@@ -1,7 +1,38 @@
 #ifndef INTEGRATOR_H
 #define INTEGRATOR_H
 
-#include "core/linked_list.h"
+#include "physics/collision.h"
+
+struct Profiler;
+
+// With more than one thread in the pool, or with deterministic mode on,
+// collisions are processed color by color over the grid partitions.
+// Deterministic mode makes a single-threaded run use that same schedule, so
+// results are identical for every thread count.
+void physics_set_deterministic(int enabled);
+
+// Most sweeps of the overlap solver per substep (default 5)
+void physics_set_overlap_iterations(int iterations);
+// Selects the overlap solver; call after physics_set_deterministic() and
+// thread_pool_init(). Returns the choice, with OVERLAP_SOLVER_AUTO resolved.
+OverlapSolver physics_set_overlap_solver(OverlapSolver solver);
+
+// Adaptive substepping for the collision model: each physics_step() is
+// split into as many equal substeps, up to PHYSICS_MAX_SUBSTEPS, as keep the
+// fastest particle of the last position pass, plus one step of the largest
+// acceleration seen, from moving more than `fraction` of the smallest
+// particle radius per substep. Impacts can still speed a particle up within
+// a substep, so after each one the rest of the step is split again from the
+// speed measured in it. Fast impacts get short substeps instead of
+// tunneling, a settling pile runs one substep per step. Call after the
+// particles exist; fraction <= 0 turns it off.
+#define PHYSICS_MAX_SUBSTEPS 32
+void physics_set_adaptive(float fraction);
+// Speed of the fastest particle in the last position pass
+float physics_max_speed(void);
+
+// Phase timings of every physics_step() are added to this profiler (may be NULL)
+void physics_set_profiler(struct Profiler* prof);
 
 void physics_step(float time_step);
 
@@ -0,0 +1,33 @@
+#ifndef NARROW_PHASE_H
+#define NARROW_PHASE_H
+
+#include "core/particle_store.h"
+#include "physics/collision.h"
+
+// Batched narrow-phase: tests one particle against a run of candidates
+// (typically a whole partition of the sorted grid order) several lanes at a
+// time. The predicted contact test compares squared distances, so no sqrt is
+// taken. Lanes that hit and are approaching (with contact warm starting,
+// lanes that hit at all) form a compact bit mask; a batch without hits is
+// done, the others go through the scalar test from their first hit on.
+//
+// All lanes of a batch are tested against the particle's velocity at the
+// start of the batch, which the first resolved hit changes, so the lanes
+// after it are tested again by the scalar code. Every kernel therefore
+// resolves the same pairs in the same order with the same results.
+typedef enum NarrowPhaseKernel {
+    NARROW_PHASE_AUTO,
+    NARROW_PHASE_SCALAR,
+    NARROW_PHASE_SSE,
+    NARROW_PHASE_AVX2
+} NarrowPhaseKernel;
+
+// Selects the kernel used by narrow_phase_collide(). NARROW_PHASE_AUTO, or a
+// kernel the CPU lacks, picks the widest supported one. Returns the choice.
+NarrowPhaseKernel narrow_phase_select(NarrowPhaseKernel requested);
+const char* narrow_phase_kernel_name(NarrowPhaseKernel kernel);
+
+void narrow_phase_collide(ParticleStore* store, int i, const int* candidates, int count,
+                          float dt, CollisionPairBuffer* pairs);
+
+#endif
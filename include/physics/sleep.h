@@ -0,0 +1,62 @@
+#ifndef SLEEP_H
+#define SLEEP_H
+
+#include "core/particle_store.h"
+
+// Sleeping particles for settled piles. A particle whose speed stays below
+// SLEEP_SPEED_FACTOR times the speed gravity adds in one step, for
+// sleep_after_steps consecutive steps, without drifting more than
+// SLEEP_DRIFT_FACTOR of its radius over that streak, falls asleep. The drift
+// check keeps slowly sinking clusters awake. A sleeper's velocity is zeroed
+// and physics_step() stops integrating, wall-checking and colliding it with
+// other sleepers. A grid partition whose particles are all asleep is skipped
+// entirely once its forward neighbors are asleep too.
+//
+// An impact from an awake particle that leaves a sleeper faster than the
+// threshold wakes it; weaker impacts are absorbed as if it were static. A
+// sleeper can also lose its support without being hit, so every update
+// first wakes all sleepers in and around a partition where an awake
+// particle moves at the sleep speed or faster.
+#define SLEEP_SPEED_FACTOR 2.0f
+#define SLEEP_DRIFT_FACTOR 0.25f
+// Marks a particle woken during the step, so the next update can count it
+#define SLEEP_WOKEN -1
+
+typedef struct SleepStats {
+    int sleeping;               // Particles asleep after the last update
+    int sleeping_partitions;    // Non-empty partitions with every particle asleep
+    int fell_asleep;            // During the last update
+    int woken;                  // During the last step, including the shaken ones
+    long total_woken;
+    int shaken;                 // Woken by motion around them in the last update
+    long total_shaken;
+} SleepStats;
+
+// calm_steps before a particle sleeps; sleep_after_steps is INT_MAX when off
+extern int sleep_after_steps;
+
+// steps <= 0 disables sleeping
+void sleep_init(int steps);
+void sleep_cleanup(void);
+int sleep_enabled(void);
+// Call once per step after the grid is current: advances every particle's
+// calm counter, puts calm ones to sleep and refreshes the partition counts
+void update_sleep_states(float dt);
+// Recounts the awake particles of every partition without touching the
+// particles, for a grid rebuilt within a step (substeps), which moves
+// particles between partitions and renumbers hashed ones
+void refresh_sleeping_partitions(void);
+// 1 when the partition and every partition of its forward stencil sleep
+int partition_stencil_asleep(int partition);
+// Called for both particles after a collision response
+void wake_if_disturbed(ParticleStore* store, int i);
+// Wakes the sleepers in and around the partition of particle i, before i is
+// removed and leaves them without its support. Needs the grid i is binned in.
+void wake_around_particle(ParticleStore* store, int i);
+const SleepStats* get_sleep_stats(void);
+
+static inline int particle_is_asleep(const ParticleStore* store, int i) {
+    return store->calm_steps[i] >= sleep_after_steps;
+}
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef SPH_H
+#define SPH_H
+
+// Weakly compressible smoothed-particle hydrodynamics, an alternative to the
+// elastic collision model. Each substep runs a density pass, which gathers
+// every particle's neighbors within the smoothing length h from the grid,
+// and a force pass over the same neighbors: pressure from the equation of
+// state p = c^2 (rho - rho0), clamped at zero so the free surface does not
+// pull particles together, plus viscosity. 2D kernels after Mueller et al.:
+// poly6 for density, spiky gradient for pressure, viscosity Laplacian.
+//
+// h is SPH_SMOOTHING_FACTOR times the largest particle diameter, and rho0 is
+// the density of a square lattice of touching particles. The grid cells must
+// be at least h wide (sph_cell_margin()). The step is split into substeps
+// so that sound travels at most SPH_CFL * h per substep.
+#define SPH_SMOOTHING_FACTOR 2.0f
+#define SPH_SOUND_SPEED 10.0f           // m/s; 10 m/s compresses a 0.5 m column by 5%
+#define SPH_KINEMATIC_VISCOSITY 0.01f   // m^2/s
+#define SPH_CFL 0.4f
+
+typedef struct SphStats {
+    int substeps;               // Per step
+    long neighbor_entries;      // Neighbor pairs found by the last density pass
+    int max_neighbors;
+    float mean_density_ratio;   // Mean rho / rho0 after the last density pass
+} SphStats;
+
+// Call after the particles are created and before init_grid()
+void sph_init(int enabled);
+void sph_cleanup(void);
+int sph_enabled(void);
+float sph_smoothing_length(void);
+float sph_rest_density(void);
+// Extra cell width init_grid() needs beyond the collision diameter
+float sph_cell_margin(void);
+// Substeps needed for one step of time_step seconds
+int sph_substeps(float time_step);
+// Density of every particle from the current grid; keeps the neighbors
+void sph_compute_density(void);
+// Pressure and viscosity accelerations from the neighbors of the last
+// density pass, plus gravity, into the store's acceleration arrays
+void sph_compute_forces(void);
+const SphStats* get_sph_stats(void);
+
+#endif
@@ -0,0 +1,10 @@
+#ifndef PROFILER_OVERLAY_H
+#define PROFILER_OVERLAY_H
+
+#include <SDL2/SDL.h>
+#include "core/profiler.h"
+
+// Simple text rendering for metrics overlay
+void profiler_draw_metrics(SDL_Renderer* renderer, Profiler* prof, int particle_count);
+
+#endif
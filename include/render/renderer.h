@@ -2,7 +2,7 @@
 #define RENDERER_H
 
 #include <SDL2/SDL.h>
-#include "core/particle.h"
+#include "core/snapshot.h"
 
 // Forward declaration to avoid circular include
 struct Profiler;
@@ -11,11 +11,12 @@ extern int window_width;
 extern int window_height;
 extern SDL_Window* window;
 extern SDL_Renderer* renderer;
-extern float domain_size;
 
 int init_renderer(void);
 void shutdown_renderer(void);
-void render_frame(void);
-void render_frame_with_profiler(struct Profiler* prof, int particle_count);
+// Both draw from a snapshot published by the physics step, never from the
+// live particle store, so rendering can run concurrently with physics
+void render_frame(const PositionSnapshot* snapshot);
+void render_frame_with_profiler(const PositionSnapshot* snapshot, struct Profiler* prof);
 
 #endif
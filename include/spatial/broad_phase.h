@@ -0,0 +1,37 @@
+#ifndef BROAD_PHASE_H
+#define BROAD_PHASE_H
+
+// Broad-phase backends: where the collision pass gets the candidate pairs it
+// hands to the narrow phase. The grid (spatial/grid.h) bins the particles
+// with either backend, since the colored passes, the overlap solver and
+// sleeping are all scheduled by its partitions; the backend only decides
+// which pairs of a partition are tested.
+// - BROAD_PHASE_GRID tests every particle of the forward stencil, or the
+//   Verlet lists (spatial/neighbor_list.h) when they are enabled.
+// - BROAD_PHASE_SORT_AND_SWEEP (spatial/sort_and_sweep.h) tests only the
+//   pairs whose swept bounds overlap on both axes, each filed under the
+//   partition where the grid would have met it.
+typedef enum BroadPhase {
+    BROAD_PHASE_GRID,
+    BROAD_PHASE_SORT_AND_SWEEP
+} BroadPhase;
+
+// Call after init_grid()
+void broad_phase_init(BroadPhase backend);
+void broad_phase_cleanup(void);
+BroadPhase get_broad_phase(void);
+const char* broad_phase_name(BroadPhase backend);
+// Refreshes the candidates for a step of length dt, once the grid is
+// current and before velocities are integrated
+void broad_phase_update(float dt);
+// When the candidates come as lists, points offsets and indices at them and
+// returns 1: those of the particle at slot k of get_sorted_particles() are
+// indices[offsets[k], offsets[k + 1]). Returns 0 when the collision pass
+// scans the grid stencil itself.
+int broad_phase_candidates(const int** offsets, const int** indices);
+// Rewrites the backend's particle indices after the particles were
+// reordered or removed, where new_index maps an old particle index to its
+// new one, or to -1 for a removed particle
+void broad_phase_remap(const int* new_index);
+
+#endif
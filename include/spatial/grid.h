@@ -1,14 +1,120 @@
 #ifndef GRID_H
 #define GRID_H
 
-#include "core/linked_list.h"
+#include <stddef.h>
 
-void init_grid(int num_partitions);
+// Uniform grid rebuilt from scratch every step with a counting sort.
+// rebuild_grid() bins each particle once (histogram + prefix sum), so the
+// particles of a partition occupy the contiguous range
+// [get_partition_begin(p), get_partition_end(p)) of get_sorted_particles().
+//
+// Partitions are also split into GRID_COLOR_COUNT colors (x mod 3, y mod 2).
+// Two partitions of the same color never share a cell of their forward
+// neighbor stencil, so all partitions of one color can be processed in
+// parallel without two threads touching the same particle.
+//
+// Two backends share this interface:
+// - GRID_DENSE allocates every cell of the domain, numbers partition
+//   x + y * grid_dim, and clamps particles outside the domain into the
+//   border cells.
+// - GRID_HASHED keeps only the occupied cells in a spatial hash
+//   (spatial/spatial_hash.h). Partition ids are compact, 0..count-1, and
+//   are renumbered by every rebuild. Cells are unbounded, so no particle
+//   is clamped. Memory follows the particle count, not the domain area.
+// Per-partition arrays should be sized with get_partition_capacity(); the
+// current number of partitions is get_partition_count().
+//
+// Particles of mixed sizes are binned on up to GRID_MAX_LEVELS levels, each
+// with cells twice as wide as the one below: a particle goes to the finest
+// level whose cells its collision diameter fits, so small particles no
+// longer share cells sized for the largest. The partitions of every level
+// are numbered after those of the finer ones, and get_sorted_particles()
+// lists each particle once, under its own level. Every partition of a
+// coarser level also lists the finer-level particles inside it
+// (get_partition_finer()), so its pass meets all pairs across levels with
+// the same forward stencil; such a pair belongs to the coarser particle's
+// level. Colors are per level, get_grid_color_count() in all. With equal
+// radii there is one level and none of this costs anything. Verlet lists,
+// SPH and sort-and-sweep walk the stencil of one level and need a single
+// level.
+#define GRID_MAX_NEIGHBORS 8
+#define GRID_COLOR_COUNT 6
+#define GRID_MAX_LEVELS 4
+// Automatic sizing limit for GRID_DENSE, which allocates every cell
+#define GRID_DENSE_MAX_CELLS_PER_PARTICLE 4
+
+typedef enum GridBackend {
+    GRID_DENSE,
+    GRID_HASHED
+} GridBackend;
+
+// Occupancy of one level, measured from the current binning
+typedef struct GridLevelStats {
+    float cell_size;
+    int partitions;             // Cells of the level, only occupied ones for GRID_HASHED
+    int particles;              // Binned on this level
+    int occupied;               // Partitions holding a particle of this level
+    int max_occupancy;          // Most particles of this level in one partition
+    int finer;                  // Finer-level particles listed in its partitions
+} GridLevelStats;
+
+// The cell size is domain_size / grid_dim. margin widens the minimum cell
+// size beyond the largest collision diameter, for neighbor lists that look
+// further than contact distance. grid_dim <= 0 sizes the grid automatically:
+// cells of that minimum size, or for GRID_DENSE at most
+// GRID_DENSE_MAX_CELLS_PER_PARTICLE cells per particle slot. With
+// max_levels > 1 the minimum only has to fit the smallest particles, as long
+// as the coarsest of max_levels levels fits the largest; grid_dim then sizes
+// the finest level.
+void init_grid(int grid_dim, float margin, GridBackend backend, int max_levels);
+// Changes the cell size without reallocating and rebuilds the grid. grid_dim
+// is clamped to [1, get_max_grid_dim()]; returns the dimension applied.
+// Partition ids change, so call it between steps.
+int set_grid_dim(int grid_dim);
 void cleanup_grid(void);
-Node* get_all_partitions(void);
-Node* compute_partition_for_particle(Node* particle_node);
-void move_particle_to_partition(Node* particle_node, Node* old_partition, Node* new_partition);
-Node** get_adjacent_partitions(Node* partition);
+void rebuild_grid(void);
+int compute_partition_for_particle(int particle_index);
+int get_particle_partition(int particle_index);
+// The partition whose forward stencil holds both particles, where the colored
+// passes meet the pair; -1 when they are not in neighboring cells
+int get_pair_partition(int a, int b);
+// Whether the neighboring cell at offset (dx, dy) is in the forward stencil:
+// (+1, 0) and the three cells above
+static inline int grid_offset_is_forward(int dx, int dy) {
+    return dy == 1 || (dy == 0 && dx == 1);
+}
+// Forward half of the 3x3 stencil, each neighboring pair listed once
+int get_adjacent_partitions(int partition, int* neighbors);
+// All 8 neighbors, for passes where every particle gathers its own sums
+int get_surrounding_partitions(int partition, int* neighbors);
+int get_partition_begin(int partition);
+int get_partition_end(int partition);
+const int* get_sorted_particles(void);
 int get_partition_count(void);
+int get_partition_capacity(void);
+// Cell coordinates within the partition's level
+void get_partition_coords(int partition, int* cx, int* cy);
+int get_grid_level_count(void);
+int get_partition_level(int partition);
+int get_particle_level(int particle_index);
+// Particles of finer levels binned inside the partition; none on level 0
+const int* get_partition_finer(int partition, int* count);
+void get_grid_level_stats(int level, GridLevelStats* stats);
+int get_grid_dim(void);
+int get_max_grid_dim(void);
+// Cells of the finest level
+float get_grid_cell_size(void);
+// Largest collision diameter plus the margin given to init_grid(), or with
+// several levels what the finest level needs
+float get_grid_min_cell_size(void);
+GridBackend get_grid_backend(void);
+const char* grid_backend_name(GridBackend backend);
+// Bytes held by the grid arrays and, for GRID_HASHED, the hash table
+size_t get_grid_memory(void);
+// Average slots visited per hash lookup, 0 for GRID_DENSE
+float get_grid_probe_length(void);
+// GRID_COLOR_COUNT colors per level, finest level first
+int get_grid_color_count(void);
+const int* get_partitions_of_color(int color, int* count);
 
 #endif
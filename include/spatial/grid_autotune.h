@@ -0,0 +1,26 @@
+#ifndef GRID_AUTOTUNE_H
+#define GRID_AUTOTUNE_H
+
+// Warm-up autotuning of the grid cell size. Starting from the automatic
+// size chosen by init_grid(), each candidate cell size (the minimum cell size
+// times one of GRID_AUTOTUNE_FACTORS) runs the same number of physics steps
+// from the same saved particle state, and the fastest one is kept. The
+// particles are restored afterwards, so tuning changes only the grid.
+//
+// Runs after the thread pool, neighbor lists, reordering and collision pairs
+// are set up, and before sleep_init(), so no partition is skipped while the
+// grid changes under the sleep counts.
+#define GRID_AUTOTUNE_FACTORS { 1.0f, 1.5f, 2.0f, 3.0f, 4.0f }
+#define GRID_AUTOTUNE_MAX_CANDIDATES 5
+
+typedef struct GridAutotuneResult {
+    int candidates;
+    int grid_dims[GRID_AUTOTUNE_MAX_CANDIDATES];
+    double ms_per_step[GRID_AUTOTUNE_MAX_CANDIDATES];
+    int best;                   // Index of the candidate kept
+} GridAutotuneResult;
+
+// steps_per_candidate <= 0 keeps the current grid
+void grid_autotune(int steps_per_candidate, float dt, GridAutotuneResult* result);
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef NEIGHBOR_LIST_H
+#define NEIGHBOR_LIST_H
+
+// Verlet neighbor lists built from the grid with a skin margin.
+// For the particle at slot k of get_sorted_particles(), its candidates are
+// indices[offsets[k], offsets[k + 1]): every particle after it in its own
+// partition, or in a forward neighbor partition, closer than the contact
+// distance plus the skin. Each pair is listed once, so the lists keep the
+// partition coloring of the grid and can be processed color by color.
+//
+// The lists (and the grid binning they were built from) stay valid until
+// some particle has moved more than half the skin since the build. Contacts
+// predicted across a gap wider than the skin are picked up one step later,
+// once the pair actually touches.
+
+typedef struct NeighborListStats {
+    int rebuilds;
+    int checks;                 // Steps checked since init
+    long entries;               // Pairs in the current lists
+    int max_neighbors;          // Longest list of one particle
+    float max_displacement;     // At the last check
+} NeighborListStats;
+
+// skin <= 0 disables the lists. Otherwise builds them from the current grid,
+// which must have been created with at least this margin.
+void neighbor_list_init(float skin);
+void neighbor_list_cleanup(void);
+int neighbor_list_enabled(void);
+float neighbor_list_skin(void);
+void neighbor_list_build(void);
+// Returns 1 once some particle has moved more than half the skin
+int neighbor_list_needs_rebuild(void);
+const int* get_neighbor_offsets(void);
+const int* get_neighbor_indices(void);
+const NeighborListStats* get_neighbor_list_stats(void);
+
+#endif
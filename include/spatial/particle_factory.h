@@ -1,6 +1,28 @@
 #ifndef PARTICLE_FACTORY_H
 #define PARTICLE_FACTORY_H
 
-void create_particles(int count);
+#include "core/arena.h"
+
+// radius_spread > 1 draws each radius between the default one and that many
+// times it; 1 places equal particles on a lattice
+void create_particles(int count, float radius_spread);
+
+// Recycling keeps a run creating and destroying particles, a source and sink
+// for testing the particle pool: after every step per_step particles picked
+// at random are removed and as many with the same radius, mass and charge
+// are dropped in at rest just below the top of the domain. Sleepers around a
+// removed particle are woken first. Everything that holds particle indices
+// is fixed up the way a reorder does it: cached pairs and the broad phase
+// are remapped, the grid and neighbor lists rebuilt. Store slots and
+// ids come from the particle store's free list, the index bookkeeping from a
+// scratch arena rewound every pass, so after the first pass recycling never
+// calls the system allocator. per_step <= 0 disables it.
+void recycle_init(int per_step);
+void recycle_cleanup(void);
+int recycle_enabled(void);
+// Call between steps with the grid current
+void recycle_particles(void);
+// The scratch arena, for its usage counters
+const Arena* get_recycle_arena(void);
 
 #endif
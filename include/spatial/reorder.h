@@ -0,0 +1,38 @@
+#ifndef REORDER_H
+#define REORDER_H
+
+// Periodic reordering of the particle store along a Morton (Z-order) curve
+// of the grid cells. Right after a reorder the particles of each cell, and of
+// cells close on the curve, sit next to each other in every field array, so
+// the collision pass streams through memory instead of gathering from all
+// over it.
+//
+// Locality is measured after every step as the fraction of particles, in the
+// grid order the collision pass walks, whose index lies more than
+// REORDER_NEAR_GAP from the previous one, i.e. whose fields most likely sit
+// in a different cache line. Cells are numbered row by row but stored along
+// the curve, so even a fresh reorder scores above 0 on fine grids. A reorder
+// runs when the fraction has risen REORDER_MAX_DEGRADATION above its value
+// right after the last reorder, or when the interval has passed, whichever
+// comes first.
+#define REORDER_NEAR_GAP 16
+#define REORDER_MAX_DEGRADATION 0.25f
+
+typedef struct ReorderStats {
+    int reorders;
+    int triggered_by_locality;  // Reorders started by the locality metric
+    float scattered;                // Scattered fraction at the last check
+    float scattered_before_reorder; // Just before the last reorder
+    float scattered_after_reorder;  // Just after it
+} ReorderStats;
+
+// interval <= 0 disables reordering. Otherwise reorders once right away.
+void reorder_init(int interval);
+void reorder_cleanup(void);
+int reorder_enabled(void);
+// Call between steps. Returns 1 when the particles were reordered.
+int reorder_particles_if_needed(void);
+void reorder_particles(void);
+const ReorderStats* get_reorder_stats(void);
+
+#endif
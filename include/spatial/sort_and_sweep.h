@@ -0,0 +1,51 @@
+#ifndef SORT_AND_SWEEP_H
+#define SORT_AND_SWEEP_H
+
+// Incremental sort-and-sweep broad phase. Every particle's bounds are swept
+// over the coming step (from its position to where its velocity, plus the
+// step's acceleration, carries it, widened by the radius), so any pair the
+// narrow phase can accept has bounds overlapping on both axes. The particles
+// are kept sorted by the lower bound along the dominant axis, the one their
+// positions spread furthest along. Particles move little between steps, so
+// an insertion sort of last step's order takes a few moves per particle; a
+// full sort runs instead when the axis switches, the particle count changes
+// or the insertion sort exceeds SWEEP_MAX_MOVES_PER_PARTICLE moves per
+// particle. Dense or fast scenes reshuffle the order too much for that, so
+// after a failed insertion sort the next SWEEP_INSERTION_BACKOFF updates go
+// straight to the full sort instead of paying for both. The sweep then
+// pairs each particle with the following ones whose lower bound is below
+// its upper bound and whose bounds overlap on the other axis.
+//
+// The candidates are laid out like the Verlet lists: those of the particle
+// at slot k of get_sorted_particles() are indices[offsets[k], offsets[k + 1]),
+// every pair listed once under the particle in the partition whose forward
+// stencil holds both (get_pair_partition()). Pairs not in neighboring cells
+// are out of reach of the colored schedule and are skipped, as the grid
+// stencil would miss them too; they are counted.
+#define SWEEP_MAX_MOVES_PER_PARTICLE 32
+#define SWEEP_INSERTION_BACKOFF 8
+// The other axis takes over once its spread is this much larger
+#define SWEEP_AXIS_SWITCH_RATIO 1.25f
+
+typedef struct SortAndSweepStats {
+    int axis;                   // 0 sweeps along x, 1 along y
+    int axis_switches;
+    int full_sorts;
+    int failed_insertions;      // Insertion sorts abandoned for a full sort
+    int updates;
+    long moves;                 // Insertion sort moves in the last update
+    long total_moves;
+    long candidates;            // Pairs in the last update
+    int beyond_stencil;         // Pairs of the last update in no shared stencil
+} SortAndSweepStats;
+
+void sort_and_sweep_init(void);
+void sort_and_sweep_cleanup(void);
+// Call once the grid is current
+void sort_and_sweep_update(float dt);
+void sort_and_sweep_remap(const int* new_index);
+const int* get_sweep_offsets(void);
+const int* get_sweep_indices(void);
+const SortAndSweepStats* get_sort_and_sweep_stats(void);
+
+#endif
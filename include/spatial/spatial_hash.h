@@ -0,0 +1,35 @@
+#ifndef SPATIAL_HASH_H
+#define SPATIAL_HASH_H
+
+// Open-addressing hash table from integer cell coordinates to compact cell
+// ids 0..count-1, for grids whose memory should follow the occupied cells
+// instead of the domain area. Linear probing over a power-of-two table kept
+// at most half full; the table is sized once for the largest number of cells
+// that can ever be occupied and cleared before every rebuild.
+
+typedef struct SpatialHashEntry {
+    int cx;
+    int cy;
+    int id;                 // -1 marks an empty slot
+} SpatialHashEntry;
+
+typedef struct SpatialHash {
+    SpatialHashEntry* entries;
+    int* cell_x;            // Coordinates of each id
+    int* cell_y;
+    unsigned int mask;      // Table size - 1
+    int count;
+    int max_cells;
+    long probes;            // Slots visited by inserts and lookups since init
+    long lookups;
+} SpatialHash;
+
+void spatial_hash_init(SpatialHash* hash, int max_cells);
+void spatial_hash_free(SpatialHash* hash);
+void spatial_hash_clear(SpatialHash* hash);
+// Returns the id of the cell, adding it if it is not in the table yet
+int spatial_hash_insert(SpatialHash* hash, int cx, int cy);
+// Returns the id of the cell, or -1 when it holds no particle
+int spatial_hash_find(SpatialHash* hash, int cx, int cy);
+
+#endif
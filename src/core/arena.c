@@ -0,0 +1,90 @@
+#include "core/arena.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+struct ArenaBlock {
+    struct ArenaBlock* next;
+    size_t capacity;
+    size_t used;
+    unsigned char* data;        // Aligned start of the usable region
+};
+
+static Arena simulation_arena = {0};
+
+static size_t align_up(size_t value) {
+    return (value + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+}
+
+static ArenaBlock* new_block(Arena* arena, size_t min_capacity) {
+    size_t capacity = arena->block_size;
+    if (capacity < min_capacity)
+        capacity = min_capacity;
+
+    ArenaBlock* block = malloc(sizeof(ArenaBlock) + capacity + ARENA_ALIGNMENT);
+    if (block == NULL) {
+        fprintf(stderr, "error: malloc failed for arena block (%zu bytes)\n", capacity);
+        exit(1);
+    }
+    block->next = NULL;
+    block->capacity = capacity;
+    block->used = 0;
+    block->data = (unsigned char*)align_up((uintptr_t)(block + 1));
+
+    arena->reserved += capacity;
+    arena->system_allocations++;
+    return block;
+}
+
+Arena* get_simulation_arena(void) {
+    return &simulation_arena;
+}
+
+void arena_init(Arena* arena, size_t block_size) {
+    *arena = (Arena){0};
+    arena->block_size = block_size > 0 ? block_size : ARENA_DEFAULT_BLOCK_SIZE;
+}
+
+void* arena_alloc(Arena* arena, size_t size) {
+    size = align_up(size > 0 ? size : 1);
+
+    if (arena->block_size == 0)
+        arena->block_size = ARENA_DEFAULT_BLOCK_SIZE;
+    if (arena->first == NULL)
+        arena->first = arena->current = new_block(arena, size);
+
+    // Move on through blocks kept from before a reset, then grow the chain
+    while (arena->current->used + size > arena->current->capacity) {
+        if (arena->current->next == NULL)
+            arena->current->next = new_block(arena, size);
+        arena->current = arena->current->next;
+    }
+
+    void* memory = arena->current->data + arena->current->used;
+    arena->current->used += size;
+    arena->used += size;
+    if (arena->used > arena->peak)
+        arena->peak = arena->used;
+    arena->allocations++;
+    return memory;
+}
+
+void arena_reset(Arena* arena) {
+    for (ArenaBlock* block = arena->first; block != NULL; block = block->next)
+        block->used = 0;
+    arena->current = arena->first;
+    arena->used = 0;
+    arena->allocations = 0;
+}
+
+void arena_free(Arena* arena) {
+    ArenaBlock* block = arena->first;
+    while (block != NULL) {
+        ArenaBlock* next = block->next;
+        free(block);
+        block = next;
+    }
+    size_t block_size = arena->block_size;
+    *arena = (Arena){0};
+    arena->block_size = block_size;
+}
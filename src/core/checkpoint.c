@@ -0,0 +1,226 @@
+#define _GNU_SOURCE
+#include "core/checkpoint.h"
+#include "core/trace.h"
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define CHECKPOINT_PATH_MAX 4096
+
+// Background writer state. The step loop owns everything except `done`
+// while a write is in flight; the writer thread only reads the staging
+// buffer and path, then sets `done`.
+static pthread_t writer_thread;
+static int writer_running = 0;
+static int writer_done = 0;
+static int writer_result = 1;
+static char* staging = NULL;
+static size_t staging_capacity = 0;
+static size_t staging_size = 0;
+static char target_path[CHECKPOINT_PATH_MAX];
+static char temporary_path[CHECKPOINT_PATH_MAX + 8];
+
+static size_t field_stride_for(uint32_t count) {
+    size_t bytes = (size_t)count * 4;
+    return (bytes + CHECKPOINT_ALIGNMENT - 1) / CHECKPOINT_ALIGNMENT * CHECKPOINT_ALIGNMENT;
+}
+
+static void* store_field(const ParticleStore* store, int field) {
+    switch (field) {
+        case CHECKPOINT_POSITION_X: return store->position_x;
+        case CHECKPOINT_POSITION_Y: return store->position_y;
+        case CHECKPOINT_VELOCITY_X: return store->velocity_x;
+        case CHECKPOINT_VELOCITY_Y: return store->velocity_y;
+        case CHECKPOINT_ACCELERATION_X: return store->acceleration_x;
+        case CHECKPOINT_ACCELERATION_Y: return store->acceleration_y;
+        case CHECKPOINT_RADIUS: return store->radius;
+        case CHECKPOINT_MASS: return store->mass;
+        case CHECKPOINT_CHARGE: return store->charge;
+        case CHECKPOINT_REST_X: return store->rest_x;
+        case CHECKPOINT_REST_Y: return store->rest_y;
+        case CHECKPOINT_CALM_STEPS: return store->calm_steps;
+        case CHECKPOINT_ID: return store->id;
+        default: return NULL;
+    }
+}
+
+int checkpoint_open(const char* path, Checkpoint* checkpoint) {
+    memset(checkpoint, 0, sizeof(*checkpoint));
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror(path);
+        return 0;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(CheckpointHeader)) {
+        fprintf(stderr, "error: %s is not a checkpoint\n", path);
+        close(fd);
+        return 0;
+    }
+
+    void* map = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror(path);
+        return 0;
+    }
+
+    const CheckpointHeader* header = map;
+    const char* problem = NULL;
+    if (memcmp(header->magic, CHECKPOINT_MAGIC, sizeof(header->magic)) != 0)
+        problem = "not a checkpoint";
+    else if (header->byte_order_mark != CHECKPOINT_BYTE_ORDER_MARK)
+        problem = "written with a different byte order";
+    else if (header->version != CHECKPOINT_VERSION)
+        problem = "unsupported version";
+    else if (header->header_size < sizeof(CheckpointHeader) || header->field_count < CHECKPOINT_FIELD_COUNT ||
+             header->field_stride < field_stride_for(header->particle_count))
+        problem = "corrupt header";
+    else if (header->header_size + header->field_count * header->field_stride > (uint64_t)info.st_size)
+        problem = "truncated";
+    if (problem != NULL) {
+        fprintf(stderr, "error: %s: %s\n", path, problem);
+        munmap(map, (size_t)info.st_size);
+        return 0;
+    }
+
+    // The load streams through every array once
+    madvise(map, (size_t)info.st_size, MADV_SEQUENTIAL);
+    checkpoint->map = map;
+    checkpoint->size = (size_t)info.st_size;
+    checkpoint->header = header;
+    return 1;
+}
+
+void checkpoint_close(Checkpoint* checkpoint) {
+    if (checkpoint->map != NULL)
+        munmap(checkpoint->map, checkpoint->size);
+    memset(checkpoint, 0, sizeof(*checkpoint));
+}
+
+void checkpoint_load(const Checkpoint* checkpoint, ParticleStore* store) {
+    TRACE_SCOPE("load checkpoint");
+    const CheckpointHeader* header = checkpoint->header;
+    if (header->particle_count > (uint32_t)store->capacity) {
+        fprintf(stderr, "error: checkpoint holds %u particles, store capacity is %d\n",
+                header->particle_count, store->capacity);
+        exit(1);
+    }
+
+    const char* base = (const char*)checkpoint->map + header->header_size;
+    size_t bytes = (size_t)header->particle_count * 4;
+    particle_store_clear(store);
+    for (int f = 0; f < CHECKPOINT_FIELD_COUNT; f++)
+        memcpy(store_field(store, f), base + f * header->field_stride, bytes);
+
+    store->count = (int)header->particle_count;
+    for (int i = 0; i < store->count; i++) {
+        if (store->id[i] < 0 || store->id[i] >= store->capacity) {
+            fprintf(stderr, "error: checkpoint particle id %d outside the store capacity %d\n", store->id[i],
+                    store->capacity);
+            exit(1);
+        }
+    }
+    particle_store_collect_free_ids(store);
+    store->created += store->count;
+}
+
+// Not traced: every write runs on a fresh thread, and each traced thread
+// keeps its own event buffer until shutdown
+static void* writer_main(void* arg) {
+    (void)arg;
+    int ok = 0;
+    FILE* file = fopen(temporary_path, "wb");
+    if (file == NULL) {
+        perror(temporary_path);
+    } else {
+        ok = fwrite(staging, 1, staging_size, file) == staging_size;
+        ok = fclose(file) == 0 && ok;
+        if (ok)
+            ok = rename(temporary_path, target_path) == 0;
+        if (!ok) {
+            perror(target_path);
+            remove(temporary_path);
+        }
+    }
+
+    writer_result = ok;
+    __atomic_store_n(&writer_done, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+int checkpoint_wait(void) {
+    if (writer_running) {
+        pthread_join(writer_thread, NULL);
+        writer_running = 0;
+    }
+    return writer_result;
+}
+
+int checkpoint_write_async(const char* path, const ParticleStore* store, uint64_t step, float domain) {
+    if (writer_running) {
+        if (!__atomic_load_n(&writer_done, __ATOMIC_ACQUIRE))
+            return 0;
+        checkpoint_wait();
+    }
+    if (strlen(path) >= CHECKPOINT_PATH_MAX) {
+        fprintf(stderr, "error: checkpoint path too long\n");
+        return 0;
+    }
+
+    TRACE_SCOPE("capture checkpoint");
+    uint32_t count = (uint32_t)store->count;
+    size_t stride = field_stride_for(count);
+    size_t size = sizeof(CheckpointHeader) + CHECKPOINT_FIELD_COUNT * stride;
+    if (size > staging_capacity) {
+        char* grown = realloc(staging, size);
+        if (grown == NULL) {
+            fprintf(stderr, "error: realloc failed for checkpoint staging buffer\n");
+            exit(1);
+        }
+        staging = grown;
+        staging_capacity = size;
+    }
+
+    // Zeroed so the padding written to disk is deterministic
+    memset(staging, 0, size);
+    CheckpointHeader* header = (CheckpointHeader*)staging;
+    memcpy(header->magic, CHECKPOINT_MAGIC, sizeof(header->magic));
+    header->version = CHECKPOINT_VERSION;
+    header->byte_order_mark = CHECKPOINT_BYTE_ORDER_MARK;
+    header->header_size = sizeof(CheckpointHeader);
+    header->field_count = CHECKPOINT_FIELD_COUNT;
+    header->particle_count = count;
+    header->domain_size = domain;
+    header->step = step;
+    header->field_stride = stride;
+
+    char* base = staging + sizeof(CheckpointHeader);
+    for (int f = 0; f < CHECKPOINT_FIELD_COUNT; f++)
+        memcpy(base + f * stride, store_field(store, f), (size_t)count * 4);
+    staging_size = size;
+
+    snprintf(target_path, sizeof(target_path), "%s", path);
+    snprintf(temporary_path, sizeof(temporary_path), "%s.tmp", path);
+    writer_done = 0;
+    if (pthread_create(&writer_thread, NULL, writer_main, NULL) != 0) {
+        fprintf(stderr, "error: could not start checkpoint writer\n");
+        return 0;
+    }
+    writer_running = 1;
+    return 1;
+}
+
+void checkpoint_shutdown(void) {
+    checkpoint_wait();
+    free(staging);
+    staging = NULL;
+    staging_capacity = 0;
+    staging_size = 0;
+}
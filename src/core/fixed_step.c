@@ -0,0 +1,43 @@
+#include "core/fixed_step.h"
+
+void fixed_step_init(FixedStepClock* clock, double step_seconds, int max_steps, uint64_t now_ns) {
+    clock->step_ns = (uint64_t)(step_seconds * 1.0e9 + 0.5);
+    clock->next_due_ns = now_ns;
+    clock->max_steps = max_steps > 0 ? max_steps : 1;
+    clock->steps = 0;
+    clock->dropped_steps = 0;
+    clock->capped_calls = 0;
+}
+
+int fixed_step_due(FixedStepClock* clock, uint64_t now_ns) {
+    if (now_ns < clock->next_due_ns)
+        return 0;
+
+    uint64_t due = (now_ns - clock->next_due_ns) / clock->step_ns + 1;
+    if (due > (uint64_t)clock->max_steps) {
+        // Give up on the backlog rather than fall further behind
+        uint64_t dropped = due - clock->max_steps;
+        clock->next_due_ns += dropped * clock->step_ns;
+        clock->dropped_steps += (long)dropped;
+        clock->capped_calls++;
+        due = clock->max_steps;
+    }
+    clock->next_due_ns += due * clock->step_ns;
+    clock->steps += (long)due;
+    return (int)due;
+}
+
+uint64_t fixed_step_time_until_due(const FixedStepClock* clock, uint64_t now_ns) {
+    return now_ns < clock->next_due_ns ? clock->next_due_ns - now_ns : 0;
+}
+
+uint64_t fixed_step_last_due(const FixedStepClock* clock) {
+    return clock->next_due_ns - clock->step_ns;
+}
+
+float fixed_step_alpha(uint64_t step_ns, uint64_t due_ns, uint64_t now_ns) {
+    if (now_ns <= due_ns)
+        return 0.0f;
+    float alpha = (float)(now_ns - due_ns) / (float)step_ns;
+    return alpha < 1.0f ? alpha : 1.0f;
+}
@@ -1,18 +1,20 @@
 #include "core/math_utils.h"
 #include <math.h>
 
-float distance_on_motion(Particle* particle1, Particle* particle2, float dt) {
-    float dx = particle2->position[0] - particle1->position[0];
-    float dy = particle2->position[1] - particle1->position[1];
-    float dvx = particle2->velocity[0] - particle1->velocity[0];
-    float dvy = particle2->velocity[1] - particle1->velocity[1];
+float distance_on_motion(const ParticleStore* store, int a, int b, float dt) {
+    float dx = store->position_x[b] - store->position_x[a];
+    float dy = store->position_y[b] - store->position_y[a];
+    float dvx = store->velocity_x[b] - store->velocity_x[a];
+    float dvy = store->velocity_y[b] - store->velocity_y[a];
 
-    return sqrt(pow(dvx * dt + dx, 2) + pow(dvy * dt + dy, 2));
+    float ex = dvx * dt + dx;
+    float ey = dvy * dt + dy;
+    return sqrtf(ex * ex + ey * ey);
 }
 
-void pointing_vector(Particle* particle1, Particle* particle2, float* result) {
-    result[0] = particle2->position[0] - particle1->position[0];
-    result[1] = particle2->position[1] - particle1->position[1];
+void pointing_vector(const ParticleStore* store, int a, int b, float* result) {
+    result[0] = store->position_x[b] - store->position_x[a];
+    result[1] = store->position_y[b] - store->position_y[a];
 }
 
 void normalized_vector(const float* vector, float* result) {
@@ -30,8 +32,22 @@ float vector_norm(const float* vector) {
     return sqrt(vector[0] * vector[0] + vector[1] * vector[1]);
 }
 
-float distance(Particle* particle1, Particle* particle2) {
-    float dx = particle2->position[0] - particle1->position[0];
-    float dy = particle2->position[1] - particle1->position[1];
+float distance(const ParticleStore* store, int a, int b) {
+    float dx = store->position_x[b] - store->position_x[a];
+    float dy = store->position_y[b] - store->position_y[a];
     return sqrt(dx * dx + dy * dy);
 }
+
+// Spreads the low 16 bits of v to the even bit positions
+static uint32_t spread_bits(uint32_t v) {
+    v &= 0xffff;
+    v = (v | (v << 8)) & 0x00ff00ff;
+    v = (v | (v << 4)) & 0x0f0f0f0f;
+    v = (v | (v << 2)) & 0x33333333;
+    v = (v | (v << 1)) & 0x55555555;
+    return v;
+}
+
+uint32_t morton_encode(uint32_t x, uint32_t y) {
+    return spread_bits(x) | (spread_bits(y) << 1);
+}
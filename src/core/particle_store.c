@@ -0,0 +1,226 @@
+#include "core/particle_store.h"
+#include "core/arena.h"
+#include "core/thread_pool.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PARTICLE_FIELD_COUNT 11
+
+static ParticleStore particle_store = {0};
+static ParticleStore permute_target = {0};  // Spare arrays the next permutation gathers into
+
+typedef struct PermuteContext {
+    float* const* source;
+    float* const* target;
+    const int* source_calm_steps;
+    int* target_calm_steps;
+    const int* source_id;
+    int* target_id;
+    const int* order;
+} PermuteContext;
+
+static float* alloc_field(int capacity) {
+    return arena_alloc(get_simulation_arena(), (size_t)capacity * sizeof(float));
+}
+
+ParticleStore* get_particle_store(void) {
+    return &particle_store;
+}
+
+void particle_store_init(ParticleStore* store, int capacity) {
+    store->position_x = alloc_field(capacity);
+    store->position_y = alloc_field(capacity);
+    store->velocity_x = alloc_field(capacity);
+    store->velocity_y = alloc_field(capacity);
+    store->acceleration_x = alloc_field(capacity);
+    store->acceleration_y = alloc_field(capacity);
+    store->radius = alloc_field(capacity);
+    store->mass = alloc_field(capacity);
+    store->charge = alloc_field(capacity);
+    store->rest_x = alloc_field(capacity);
+    store->rest_y = alloc_field(capacity);
+    store->calm_steps = arena_alloc(get_simulation_arena(), (size_t)capacity * sizeof(int));
+    store->id = arena_alloc(get_simulation_arena(), (size_t)capacity * sizeof(int));
+    store->free_ids = arena_alloc(get_simulation_arena(), (size_t)capacity * sizeof(int));
+    store->free_id_count = 0;
+    store->id_count = 0;
+    store->count = 0;
+    store->capacity = capacity;
+    store->created = 0;
+    store->destroyed = 0;
+}
+
+// The field arrays belong to the simulation arena and are released with it
+void particle_store_free(ParticleStore* store) {
+    *store = (ParticleStore){0};
+    permute_target = (ParticleStore){0};
+}
+
+int particle_store_add(ParticleStore* store, const Particle* particle) {
+    if (store->count >= store->capacity) {
+        fprintf(stderr, "error: particle store full (capacity %d)\n", store->capacity);
+        return -1;
+    }
+
+    int i = store->count++;
+    store->position_x[i] = particle->position[0];
+    store->position_y[i] = particle->position[1];
+    store->velocity_x[i] = particle->velocity[0];
+    store->velocity_y[i] = particle->velocity[1];
+    store->acceleration_x[i] = particle->acceleration[0];
+    store->acceleration_y[i] = particle->acceleration[1];
+    store->radius[i] = particle->radius;
+    store->mass[i] = particle->mass;
+    store->charge[i] = particle->charge;
+    store->rest_x[i] = particle->position[0];
+    store->rest_y[i] = particle->position[1];
+    store->calm_steps[i] = 0;
+    store->id[i] = store->free_id_count > 0 ? store->free_ids[--store->free_id_count] : store->id_count++;
+
+    store->created++;
+    return i;
+}
+
+void particle_store_remove(ParticleStore* store, int index) {
+    if (index < 0 || index >= store->count) {
+        fprintf(stderr, "error: no particle at index %d\n", index);
+        return;
+    }
+
+    store->free_ids[store->free_id_count++] = store->id[index];
+    int last = --store->count;
+    store->position_x[index] = store->position_x[last];
+    store->position_y[index] = store->position_y[last];
+    store->velocity_x[index] = store->velocity_x[last];
+    store->velocity_y[index] = store->velocity_y[last];
+    store->acceleration_x[index] = store->acceleration_x[last];
+    store->acceleration_y[index] = store->acceleration_y[last];
+    store->radius[index] = store->radius[last];
+    store->mass[index] = store->mass[last];
+    store->charge[index] = store->charge[last];
+    store->rest_x[index] = store->rest_x[last];
+    store->rest_y[index] = store->rest_y[last];
+    store->calm_steps[index] = store->calm_steps[last];
+    store->id[index] = store->id[last];
+    store->destroyed++;
+}
+
+void particle_store_clear(ParticleStore* store) {
+    store->destroyed += store->count;
+    store->count = 0;
+    store->free_id_count = 0;
+    store->id_count = 0;
+}
+
+// Marks the live ids in free_ids, then packs the unmarked ones to its front.
+// Every mark is read before the packed list can overwrite it.
+void particle_store_collect_free_ids(ParticleStore* store) {
+    int id_count = 0;
+    for (int i = 0; i < store->count; i++)
+        if (store->id[i] >= id_count)
+            id_count = store->id[i] + 1;
+
+    memset(store->free_ids, 0, (size_t)id_count * sizeof(int));
+    for (int i = 0; i < store->count; i++)
+        store->free_ids[store->id[i]] = 1;
+    int free_count = 0;
+    for (int k = 0; k < id_count; k++)
+        if (store->free_ids[k] == 0)
+            store->free_ids[free_count++] = k;
+
+    store->free_id_count = free_count;
+    store->id_count = id_count;
+}
+
+void particle_store_get(const ParticleStore* store, int index, Particle* out) {
+    out->position[0] = store->position_x[index];
+    out->position[1] = store->position_y[index];
+    out->velocity[0] = store->velocity_x[index];
+    out->velocity[1] = store->velocity_y[index];
+    out->acceleration[0] = store->acceleration_x[index];
+    out->acceleration[1] = store->acceleration_y[index];
+    out->radius = store->radius[index];
+    out->mass = store->mass[index];
+    out->charge = store->charge[index];
+}
+
+static void permute_task(void* context, int thread_index, int begin, int end) {
+    PermuteContext* ctx = context;
+    (void)thread_index;
+
+    for (int f = 0; f < PARTICLE_FIELD_COUNT; f++) {
+        const float* source = ctx->source[f];
+        float* target = ctx->target[f];
+        for (int k = begin; k < end; k++)
+            target[k] = source[ctx->order[k]];
+    }
+    for (int k = begin; k < end; k++) {
+        ctx->target_calm_steps[k] = ctx->source_calm_steps[ctx->order[k]];
+        ctx->target_id[k] = ctx->source_id[ctx->order[k]];
+    }
+}
+
+void particle_store_permute(ParticleStore* store, const int* order) {
+    if (permute_target.capacity != store->capacity)
+        particle_store_init(&permute_target, store->capacity);
+
+    float** fields[PARTICLE_FIELD_COUNT] = {
+        &store->position_x, &store->position_y, &store->velocity_x, &store->velocity_y,
+        &store->acceleration_x, &store->acceleration_y, &store->radius, &store->mass, &store->charge,
+        &store->rest_x, &store->rest_y
+    };
+    float** spare[PARTICLE_FIELD_COUNT] = {
+        &permute_target.position_x, &permute_target.position_y, &permute_target.velocity_x,
+        &permute_target.velocity_y, &permute_target.acceleration_x, &permute_target.acceleration_y,
+        &permute_target.radius, &permute_target.mass, &permute_target.charge,
+        &permute_target.rest_x, &permute_target.rest_y
+    };
+
+    float* source[PARTICLE_FIELD_COUNT];
+    float* target[PARTICLE_FIELD_COUNT];
+    for (int f = 0; f < PARTICLE_FIELD_COUNT; f++) {
+        source[f] = *fields[f];
+        target[f] = *spare[f];
+    }
+
+    PermuteContext ctx = { source, target, store->calm_steps, permute_target.calm_steps, store->id,
+                           permute_target.id, order };
+    thread_pool_parallel_for(store->count, 4096, permute_task, &ctx);
+
+    // The gathered arrays become the store, the old ones the next spare set
+    for (int f = 0; f < PARTICLE_FIELD_COUNT; f++) {
+        *fields[f] = target[f];
+        *spare[f] = source[f];
+    }
+    permute_target.calm_steps = store->calm_steps;
+    store->calm_steps = ctx.target_calm_steps;
+    permute_target.id = store->id;
+    store->id = ctx.target_id;
+}
+
+void particle_store_copy(ParticleStore* dst, const ParticleStore* src) {
+    if (src->count > dst->capacity) {
+        fprintf(stderr, "error: cannot copy %d particles into capacity %d\n", src->count, dst->capacity);
+        exit(1);
+    }
+
+    size_t bytes = (size_t)src->count * sizeof(float);
+    memcpy(dst->position_x, src->position_x, bytes);
+    memcpy(dst->position_y, src->position_y, bytes);
+    memcpy(dst->velocity_x, src->velocity_x, bytes);
+    memcpy(dst->velocity_y, src->velocity_y, bytes);
+    memcpy(dst->acceleration_x, src->acceleration_x, bytes);
+    memcpy(dst->acceleration_y, src->acceleration_y, bytes);
+    memcpy(dst->radius, src->radius, bytes);
+    memcpy(dst->mass, src->mass, bytes);
+    memcpy(dst->charge, src->charge, bytes);
+    memcpy(dst->rest_x, src->rest_x, bytes);
+    memcpy(dst->rest_y, src->rest_y, bytes);
+    memcpy(dst->calm_steps, src->calm_steps, (size_t)src->count * sizeof(int));
+    memcpy(dst->id, src->id, (size_t)src->count * sizeof(int));
+    memcpy(dst->free_ids, src->free_ids, (size_t)src->free_id_count * sizeof(int));
+    dst->free_id_count = src->free_id_count;
+    dst->id_count = src->id_count;
+    dst->count = src->count;
+}
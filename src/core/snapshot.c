@@ -0,0 +1,121 @@
+#include "core/snapshot.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SNAPSHOT_SLOT_MASK 3
+#define SNAPSHOT_FRESH 4
+
+void snapshot_init(PositionSnapshot* snapshot, int capacity) {
+    snapshot->position_x = malloc(capacity * sizeof(float));
+    snapshot->position_y = malloc(capacity * sizeof(float));
+    snapshot->previous_x = malloc(capacity * sizeof(float));
+    snapshot->previous_y = malloc(capacity * sizeof(float));
+    snapshot->speed = malloc(capacity * sizeof(float));
+    snapshot->radius = malloc(capacity * sizeof(float));
+    if (snapshot->position_x == NULL || snapshot->position_y == NULL || snapshot->previous_x == NULL ||
+        snapshot->previous_y == NULL || snapshot->speed == NULL || snapshot->radius == NULL) {
+        fprintf(stderr, "error: malloc failed for position snapshot\n");
+        exit(1);
+    }
+    snapshot->count = 0;
+    snapshot->capacity = capacity;
+    snapshot->has_previous = 0;
+    snapshot->step = 0;
+    snapshot->due_ns = 0;
+    snapshot->physics_ms = 0.0f;
+}
+
+void snapshot_free(PositionSnapshot* snapshot) {
+    free(snapshot->position_x);
+    free(snapshot->position_y);
+    free(snapshot->previous_x);
+    free(snapshot->previous_y);
+    free(snapshot->speed);
+    free(snapshot->radius);
+}
+
+void snapshot_buffer_init(SnapshotBuffer* buffer, int capacity) {
+    for (int s = 0; s < 3; s++)
+        snapshot_init(&buffer->slots[s], capacity);
+    buffer->back = 0;
+    buffer->front = 1;
+    buffer->middle = 2;
+}
+
+void snapshot_buffer_free(SnapshotBuffer* buffer) {
+    for (int s = 0; s < 3; s++)
+        snapshot_free(&buffer->slots[s]);
+}
+
+PositionSnapshot* snapshot_begin_write(SnapshotBuffer* buffer) {
+    return &buffer->slots[buffer->back];
+}
+
+void snapshot_publish(SnapshotBuffer* buffer) {
+    int published = buffer->back | SNAPSHOT_FRESH;
+    int previous = __atomic_exchange_n(&buffer->middle, published, __ATOMIC_ACQ_REL);
+    buffer->back = previous & SNAPSHOT_SLOT_MASK;
+}
+
+void snapshot_capture_previous(PositionSnapshot* snapshot, const ParticleStore* store) {
+    int count = store->count < snapshot->capacity ? store->count : snapshot->capacity;
+    memcpy(snapshot->previous_x, store->position_x, count * sizeof(float));
+    memcpy(snapshot->previous_y, store->position_y, count * sizeof(float));
+    snapshot->has_previous = 1;
+}
+
+void snapshot_capture(PositionSnapshot* snapshot, const ParticleStore* store, uint64_t step, uint64_t due_ns,
+                      float physics_ms) {
+    int count = store->count < snapshot->capacity ? store->count : snapshot->capacity;
+
+    for (int i = 0; i < count; i++) {
+        float vx = store->velocity_x[i];
+        float vy = store->velocity_y[i];
+        snapshot->position_x[i] = store->position_x[i];
+        snapshot->position_y[i] = store->position_y[i];
+        snapshot->speed[i] = sqrtf(vx * vx + vy * vy);
+    }
+    // Reordering permutes the radii too, so they are copied every time
+    memcpy(snapshot->radius, store->radius, count * sizeof(float));
+    // A particle added or removed since snapshot_capture_previous() shifts the indices
+    snapshot->has_previous &= snapshot->count == count;
+    snapshot->count = count;
+    snapshot->step = step;
+    snapshot->due_ns = due_ns;
+    snapshot->physics_ms = physics_ms;
+}
+
+const PositionSnapshot* snapshot_acquire_latest(SnapshotBuffer* buffer) {
+    if (__atomic_load_n(&buffer->middle, __ATOMIC_ACQUIRE) & SNAPSHOT_FRESH) {
+        int taken = __atomic_exchange_n(&buffer->middle, buffer->front, __ATOMIC_ACQ_REL);
+        buffer->front = taken & SNAPSHOT_SLOT_MASK;
+    }
+
+    const PositionSnapshot* latest = &buffer->slots[buffer->front];
+    return latest->step > 0 ? latest : NULL;
+}
+
+void snapshot_interpolate(const PositionSnapshot* snapshot, float alpha, PositionSnapshot* out) {
+    int count = snapshot->count < out->capacity ? snapshot->count : out->capacity;
+
+    if (snapshot->has_previous) {
+        for (int i = 0; i < count; i++) {
+            float x0 = snapshot->previous_x[i];
+            float y0 = snapshot->previous_y[i];
+            out->position_x[i] = x0 + alpha * (snapshot->position_x[i] - x0);
+            out->position_y[i] = y0 + alpha * (snapshot->position_y[i] - y0);
+        }
+    } else {
+        memcpy(out->position_x, snapshot->position_x, count * sizeof(float));
+        memcpy(out->position_y, snapshot->position_y, count * sizeof(float));
+    }
+    memcpy(out->speed, snapshot->speed, count * sizeof(float));
+    memcpy(out->radius, snapshot->radius, count * sizeof(float));
+    out->count = count;
+    out->has_previous = 0;
+    out->step = snapshot->step;
+    out->due_ns = snapshot->due_ns;
+    out->physics_ms = snapshot->physics_ms;
+}
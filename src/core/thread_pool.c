@@ -0,0 +1,145 @@
+#include "core/thread_pool.h"
+#include "core/trace.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static pthread_t workers[THREAD_POOL_MAX_THREADS];
+static int thread_total = 1;
+
+static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t work_ready = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t work_done = PTHREAD_COND_INITIALIZER;
+
+// Current job, published under pool_mutex by bumping job_generation
+static ThreadPoolTask job_task = NULL;
+static void* job_context = NULL;
+static int job_count = 0;
+static int job_grain = 1;
+static const char* job_zone = NULL;     // Trace zone name, NULL for none
+static int job_next = 0;          // Next unclaimed item, advanced atomically
+static int job_generation = 0;
+static int workers_busy = 0;
+static int shutting_down = 0;
+
+static void run_job_chunks(int thread_index) {
+    int traced = 0;
+    for (;;) {
+        int begin = __atomic_fetch_add(&job_next, job_grain, __ATOMIC_RELAXED);
+        if (begin >= job_count)
+            break;
+        int end = begin + job_grain;
+        if (end > job_count)
+            end = job_count;
+        if (!traced && job_zone != NULL) {
+            TRACE_ZONE_BEGIN(job_zone);
+            traced = 1;
+        }
+        job_task(job_context, thread_index, begin, end);
+    }
+    if (traced)
+        TRACE_ZONE_END();
+}
+
+static void* worker_main(void* arg) {
+    int thread_index = (int)(size_t)arg;
+    int seen_generation = 0;
+
+    char name[32];
+    snprintf(name, sizeof(name), "physics worker %d", thread_index);
+    trace_set_thread_name(name);
+
+    pthread_mutex_lock(&pool_mutex);
+    for (;;) {
+        while (job_generation == seen_generation && !shutting_down)
+            pthread_cond_wait(&work_ready, &pool_mutex);
+        if (shutting_down)
+            break;
+        seen_generation = job_generation;
+        pthread_mutex_unlock(&pool_mutex);
+
+        run_job_chunks(thread_index);
+
+        pthread_mutex_lock(&pool_mutex);
+        if (--workers_busy == 0)
+            pthread_cond_signal(&work_done);
+    }
+    pthread_mutex_unlock(&pool_mutex);
+    return NULL;
+}
+
+void thread_pool_init(int thread_count) {
+    if (thread_count < 1)
+        thread_count = 1;
+    if (thread_count > THREAD_POOL_MAX_THREADS)
+        thread_count = THREAD_POOL_MAX_THREADS;
+
+    shutting_down = 0;
+    thread_total = 1;
+    for (int t = 1; t < thread_count; t++) {
+        if (pthread_create(&workers[t], NULL, worker_main, (void*)(size_t)t) != 0) {
+            fprintf(stderr, "error: could not start worker thread %d, using %d threads\n", t, t);
+            break;
+        }
+        thread_total = t + 1;
+    }
+}
+
+void thread_pool_shutdown(void) {
+    pthread_mutex_lock(&pool_mutex);
+    shutting_down = 1;
+    pthread_cond_broadcast(&work_ready);
+    pthread_mutex_unlock(&pool_mutex);
+
+    for (int t = 1; t < thread_total; t++)
+        pthread_join(workers[t], NULL);
+    thread_total = 1;
+}
+
+int thread_pool_size(void) {
+    return thread_total;
+}
+
+static void parallel_for(const char* zone, int count, int grain, ThreadPoolTask task, void* context) {
+    if (count <= 0)
+        return;
+    if (grain < 1)
+        grain = 1;
+
+    // Not worth waking the workers for a single chunk
+    if (thread_total == 1 || count <= grain) {
+        if (zone != NULL)
+            TRACE_ZONE_BEGIN(zone);
+        task(context, 0, 0, count);
+        if (zone != NULL)
+            TRACE_ZONE_END();
+        return;
+    }
+
+    pthread_mutex_lock(&pool_mutex);
+    job_task = task;
+    job_zone = zone;
+    job_context = context;
+    job_count = count;
+    job_grain = grain;
+    job_next = 0;
+    workers_busy = thread_total - 1;
+    job_generation++;
+    pthread_cond_broadcast(&work_ready);
+    pthread_mutex_unlock(&pool_mutex);
+
+    run_job_chunks(0);
+
+    pthread_mutex_lock(&pool_mutex);
+    while (workers_busy > 0)
+        pthread_cond_wait(&work_done, &pool_mutex);
+    pthread_mutex_unlock(&pool_mutex);
+}
+
+void thread_pool_parallel_for(int count, int grain, ThreadPoolTask task, void* context) {
+    parallel_for(NULL, count, grain, task, context);
+}
+
+void thread_pool_parallel_for_traced(const char* zone, int count, int grain, ThreadPoolTask task, void* context) {
+    parallel_for(zone, count, grain, task, context);
+}
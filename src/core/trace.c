@@ -0,0 +1,171 @@
+#define _POSIX_C_SOURCE 200809L
+#include "core/trace.h"
+#include "core/profiler.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TRACE_THREAD_NAME_LENGTH 32
+
+typedef struct TraceEvent {
+    const char* name;
+    uint64_t start_ns;
+    uint64_t duration_ns;
+} TraceEvent;
+
+typedef struct TraceThreadBuffer {
+    TraceEvent* events;
+    int count;
+    int capacity;
+    int dropped;
+    int depth;
+    int thread_id;
+    const char* open_names[TRACE_MAX_DEPTH];
+    uint64_t open_starts[TRACE_MAX_DEPTH];
+    char name[TRACE_THREAD_NAME_LENGTH];
+    struct TraceThreadBuffer* next;
+} TraceThreadBuffer;
+
+int trace_enabled = 0;
+
+static pthread_mutex_t registry_mutex = PTHREAD_MUTEX_INITIALIZER;
+static TraceThreadBuffer* thread_buffers = NULL;  // Every buffer ever registered
+static int registered_threads = 0;
+static int buffer_capacity = TRACE_DEFAULT_EVENTS_PER_THREAD;
+static uint64_t trace_origin_ns = 0;
+
+static __thread TraceThreadBuffer* local_buffer = NULL;
+static __thread char local_thread_name[TRACE_THREAD_NAME_LENGTH];
+
+// Registers the calling thread on its first zone. The only point where
+// tracing takes a lock.
+static TraceThreadBuffer* acquire_local_buffer(void) {
+    if (local_buffer != NULL)
+        return local_buffer;
+
+    TraceThreadBuffer* buffer = calloc(1, sizeof(TraceThreadBuffer));
+    TraceEvent* events = malloc((size_t)buffer_capacity * sizeof(TraceEvent));
+    if (buffer == NULL || events == NULL) {
+        fprintf(stderr, "error: malloc failed for trace buffer\n");
+        exit(1);
+    }
+    buffer->events = events;
+    buffer->capacity = buffer_capacity;
+    memcpy(buffer->name, local_thread_name, TRACE_THREAD_NAME_LENGTH);
+
+    pthread_mutex_lock(&registry_mutex);
+    buffer->thread_id = registered_threads++;
+    buffer->next = thread_buffers;
+    thread_buffers = buffer;
+    pthread_mutex_unlock(&registry_mutex);
+
+    local_buffer = buffer;
+    return buffer;
+}
+
+void trace_init(int events_per_thread) {
+    if (events_per_thread > 0)
+        buffer_capacity = events_per_thread;
+    trace_origin_ns = profiler_now_ns();
+    trace_enabled = 1;
+}
+
+void trace_shutdown(void) {
+    trace_enabled = 0;
+
+    // Buffers stay registered with their threads until shutdown; callers must
+    // make sure no thread is still recording
+    pthread_mutex_lock(&registry_mutex);
+    TraceThreadBuffer* buffer = thread_buffers;
+    while (buffer != NULL) {
+        TraceThreadBuffer* next = buffer->next;
+        free(buffer->events);
+        free(buffer);
+        buffer = next;
+    }
+    thread_buffers = NULL;
+    registered_threads = 0;
+    pthread_mutex_unlock(&registry_mutex);
+    local_buffer = NULL;
+}
+
+void trace_set_thread_name(const char* name) {
+    strncpy(local_thread_name, name, TRACE_THREAD_NAME_LENGTH - 1);
+    local_thread_name[TRACE_THREAD_NAME_LENGTH - 1] = '\0';
+    if (local_buffer != NULL)
+        memcpy(local_buffer->name, local_thread_name, TRACE_THREAD_NAME_LENGTH);
+}
+
+void trace_zone_begin(const char* name) {
+    TraceThreadBuffer* buffer = acquire_local_buffer();
+    if (buffer->depth < TRACE_MAX_DEPTH) {
+        buffer->open_names[buffer->depth] = name;
+        buffer->open_starts[buffer->depth] = profiler_now_ns();
+    }
+    buffer->depth++;
+}
+
+void trace_zone_end(void) {
+    TraceThreadBuffer* buffer = acquire_local_buffer();
+    if (buffer->depth == 0)
+        return;
+    buffer->depth--;
+    if (buffer->depth >= TRACE_MAX_DEPTH)
+        return;
+
+    if (buffer->count == buffer->capacity) {
+        buffer->dropped++;
+        return;
+    }
+
+    TraceEvent* event = &buffer->events[buffer->count++];
+    event->name = buffer->open_names[buffer->depth];
+    event->start_ns = buffer->open_starts[buffer->depth];
+    event->duration_ns = profiler_now_ns() - event->start_ns;
+}
+
+void trace_scope_end(const char** scope) {
+    // Scopes opened while tracing was off never began a zone
+    if (*scope != NULL && local_buffer != NULL)
+        trace_zone_end();
+}
+
+int trace_write_chrome_json(const char* path) {
+    FILE* file = fopen(path, "w");
+    if (file == NULL) {
+        fprintf(stderr, "error: could not open trace file %s\n", path);
+        return 0;
+    }
+
+    int first = 1;
+    int dropped = 0;
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+    pthread_mutex_lock(&registry_mutex);
+    for (TraceThreadBuffer* buffer = thread_buffers; buffer != NULL; buffer = buffer->next) {
+        if (buffer->name[0] != '\0') {
+            fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                    first ? "" : ",\n", buffer->thread_id, buffer->name);
+            first = 0;
+        }
+
+        for (int i = 0; i < buffer->count; i++) {
+            const TraceEvent* event = &buffer->events[i];
+            fprintf(file, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                    first ? "" : ",\n", event->name, buffer->thread_id,
+                    (event->start_ns - trace_origin_ns) / 1000.0, event->duration_ns / 1000.0);
+            first = 0;
+        }
+        dropped += buffer->dropped;
+    }
+    pthread_mutex_unlock(&registry_mutex);
+
+    fprintf(file, "\n]}\n");
+    fclose(file);
+
+    if (dropped > 0)
+        fprintf(stderr, "warning: trace buffers full, %d zones dropped\n", dropped);
+    return 1;
+}
@@ -0,0 +1,238 @@
+#include "core/trajectory.h"
+#include "core/profiler.h"
+#include "core/trace.h"
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Enough to ride out a slow write or two without dropping a frame
+#define TRAJECTORY_STAGING_FRAMES 4
+
+typedef enum StagingState {
+    STAGING_FREE,               // Owned by the physics thread
+    STAGING_FULL,               // Waiting for the writer
+    STAGING_WRITING
+} StagingState;
+
+typedef struct StagingFrame {
+    void* data;                 // Frame header followed by the four arrays
+    size_t size;
+    StagingState state;
+} StagingFrame;
+
+static FILE* trajectory_file = NULL;
+static pthread_t writer_thread;
+static pthread_mutex_t staging_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t staging_filled = PTHREAD_COND_INITIALIZER;
+static StagingFrame staging[TRAJECTORY_STAGING_FRAMES];
+static int next_frame = 0;      // Staging frame the physics thread fills next
+static int closing = 0;
+static int trajectory_every = 1;
+static int trajectory_quantize = 0;
+static float trajectory_domain = 1.0f;
+static uint64_t trajectory_step = 0;
+static TrajectoryStats trajectory_stats;
+
+static void* writer_main(void* arg) {
+    (void)arg;
+    trace_set_thread_name("trajectory writer");
+    int frame = 0;
+
+    // Frames are filled round robin, so writing them round robin keeps them
+    // in step order
+    for (;;) {
+        pthread_mutex_lock(&staging_lock);
+        while (staging[frame].state != STAGING_FULL && !closing)
+            pthread_cond_wait(&staging_filled, &staging_lock);
+        if (staging[frame].state != STAGING_FULL) {
+            pthread_mutex_unlock(&staging_lock);
+            break;
+        }
+        staging[frame].state = STAGING_WRITING;
+        pthread_mutex_unlock(&staging_lock);
+
+        TRACE_ZONE_BEGIN("write trajectory frame");
+        uint64_t start = profiler_now_ns();
+        size_t written = fwrite(staging[frame].data, 1, staging[frame].size, trajectory_file);
+        trajectory_stats.writer_ms += (profiler_now_ns() - start) / 1.0e6;
+        TRACE_ZONE_END();
+
+        pthread_mutex_lock(&staging_lock);
+        trajectory_stats.bytes_written += written;
+        trajectory_stats.frames_written++;
+        staging[frame].state = STAGING_FREE;
+        pthread_mutex_unlock(&staging_lock);
+        if (written != staging[frame].size)
+            fprintf(stderr, "error: trajectory write failed\n");
+        frame = (frame + 1) % TRAJECTORY_STAGING_FRAMES;
+    }
+    return NULL;
+}
+
+int trajectory_enabled(void) {
+    return trajectory_file != NULL;
+}
+
+int trajectory_open(const char* path, int capacity, int every, int quantize, float domain, uint64_t first_step) {
+    trajectory_file = fopen(path, "wb");
+    if (trajectory_file == NULL) {
+        perror(path);
+        return 0;
+    }
+
+    trajectory_every = every > 0 ? every : 1;
+    trajectory_quantize = quantize;
+    trajectory_domain = domain;
+    trajectory_step = first_step;
+    closing = 0;
+    next_frame = 0;
+    memset(&trajectory_stats, 0, sizeof(trajectory_stats));
+
+    TrajectoryHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TRAJECTORY_MAGIC, sizeof(header.magic));
+    header.version = TRAJECTORY_VERSION;
+    header.byte_order_mark = TRAJECTORY_BYTE_ORDER_MARK;
+    header.header_size = sizeof(header);
+    header.flags = quantize ? TRAJECTORY_QUANTIZED : 0;
+    header.every = (uint32_t)trajectory_every;
+    header.domain_size = domain;
+    fwrite(&header, sizeof(header), 1, trajectory_file);
+    trajectory_stats.bytes_written = sizeof(header);
+
+    size_t value_size = quantize ? sizeof(uint16_t) : sizeof(float);
+    size_t frame_capacity = sizeof(TrajectoryFrameHeader) + 4 * (size_t)capacity * value_size;
+    for (int f = 0; f < TRAJECTORY_STAGING_FRAMES; f++) {
+        staging[f].data = malloc(frame_capacity);
+        if (staging[f].data == NULL) {
+            fprintf(stderr, "error: malloc failed for trajectory staging frame\n");
+            exit(1);
+        }
+        staging[f].size = 0;
+        staging[f].state = STAGING_FREE;
+    }
+
+    if (pthread_create(&writer_thread, NULL, writer_main, NULL) != 0) {
+        fprintf(stderr, "error: could not start trajectory writer\n");
+        exit(1);
+    }
+    return 1;
+}
+
+void trajectory_close(void) {
+    if (trajectory_file == NULL)
+        return;
+
+    pthread_mutex_lock(&staging_lock);
+    closing = 1;
+    pthread_cond_signal(&staging_filled);
+    pthread_mutex_unlock(&staging_lock);
+    pthread_join(writer_thread, NULL);
+
+    fclose(trajectory_file);
+    trajectory_file = NULL;
+    if (trajectory_stats.frames_dropped > 0)
+        fprintf(stderr, "warning: %ld trajectory frames dropped, the writer fell behind; "
+                "raise --export-every or use --quantize\n", trajectory_stats.frames_dropped);
+    for (int f = 0; f < TRAJECTORY_STAGING_FRAMES; f++) {
+        free(staging[f].data);
+        staging[f].data = NULL;
+    }
+}
+
+static uint16_t quantize_position(float value) {
+    float scaled = value / trajectory_domain * 65535.0f + 0.5f;
+    if (scaled < 0.0f)
+        scaled = 0.0f;
+    if (scaled > 65535.0f)
+        scaled = 65535.0f;
+    return (uint16_t)scaled;
+}
+
+static size_t fill_quantized(void* data, const ParticleStore* store, TrajectoryFrameHeader* header) {
+    int count = store->id_count;
+    float scale = 0.0f;
+    for (int i = 0; i < store->count; i++) {
+        scale = fmaxf(scale, fabsf(store->velocity_x[i]));
+        scale = fmaxf(scale, fabsf(store->velocity_y[i]));
+    }
+    header->velocity_scale = scale;
+    float to_units = scale > 0.0f ? 32767.0f / scale : 0.0f;
+
+    uint16_t* position_x = data;
+    uint16_t* position_y = position_x + count;
+    int16_t* velocity_x = (int16_t*)(position_y + count);
+    int16_t* velocity_y = velocity_x + count;
+    for (int f = 0; f < store->free_id_count; f++) {
+        int k = store->free_ids[f];
+        position_x[k] = position_y[k] = 0;
+        velocity_x[k] = velocity_y[k] = TRAJECTORY_FREE_ID_QUANTIZED;
+    }
+    for (int i = 0; i < store->count; i++) {
+        int k = store->id[i];
+        position_x[k] = quantize_position(store->position_x[i]);
+        position_y[k] = quantize_position(store->position_y[i]);
+        velocity_x[k] = (int16_t)lrintf(store->velocity_x[i] * to_units);
+        velocity_y[k] = (int16_t)lrintf(store->velocity_y[i] * to_units);
+    }
+    return 4 * (size_t)count * sizeof(uint16_t);
+}
+
+// Scattered by id rather than copied, since storage order changes with
+// reordering and removals
+static size_t fill_plain(void* data, const ParticleStore* store) {
+    int count = store->id_count;
+    float* position_x = data;
+    float* position_y = position_x + count;
+    float* velocity_x = position_y + count;
+    float* velocity_y = velocity_x + count;
+    for (int f = 0; f < store->free_id_count; f++) {
+        int k = store->free_ids[f];
+        position_x[k] = position_y[k] = velocity_x[k] = velocity_y[k] = NAN;
+    }
+    for (int i = 0; i < store->count; i++) {
+        int k = store->id[i];
+        position_x[k] = store->position_x[i];
+        position_y[k] = store->position_y[i];
+        velocity_x[k] = store->velocity_x[i];
+        velocity_y[k] = store->velocity_y[i];
+    }
+    return 4 * (size_t)count * sizeof(float);
+}
+
+void trajectory_capture(const ParticleStore* store) {
+    trajectory_step++;
+    if (trajectory_step % trajectory_every != 0)
+        return;
+
+    StagingFrame* frame = &staging[next_frame];
+    pthread_mutex_lock(&staging_lock);
+    int free_frame = frame->state == STAGING_FREE;
+    if (!free_frame)
+        trajectory_stats.frames_dropped++;
+    pthread_mutex_unlock(&staging_lock);
+    if (!free_frame)
+        return;
+
+    // The frame is ours until it is marked full
+    TRACE_SCOPE("capture trajectory frame");
+    TrajectoryFrameHeader* header = frame->data;
+    header->step = trajectory_step;
+    header->particle_count = (uint32_t)store->id_count;
+    header->velocity_scale = 0.0f;
+    void* arrays = header + 1;
+    size_t bytes = trajectory_quantize ? fill_quantized(arrays, store, header) : fill_plain(arrays, store);
+    frame->size = sizeof(TrajectoryFrameHeader) + bytes;
+
+    pthread_mutex_lock(&staging_lock);
+    frame->state = STAGING_FULL;
+    pthread_cond_signal(&staging_filled);
+    pthread_mutex_unlock(&staging_lock);
+    next_frame = (next_frame + 1) % TRAJECTORY_STAGING_FRAMES;
+}
+
+const TrajectoryStats* get_trajectory_stats(void) {
+    return &trajectory_stats;
+}
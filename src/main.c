@@ -1,33 +1,693 @@
 #define _GNU_SOURCE
+#ifndef HEADLESS_BUILD
 #include <SDL2/SDL.h>
+#endif
+#include <getopt.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <math.h>
 #include <time.h>
 #include <unistd.h>
+#include "physics/collision.h"
+#include "physics/electrostatics.h"
 #include "physics/integrator.h"
+#include "physics/forces.h"
+#include "physics/narrow_phase.h"
+#include "physics/sleep.h"
+#include "physics/sph.h"
+#ifndef HEADLESS_BUILD
 #include "render/renderer.h"
+#endif
+#include "spatial/broad_phase.h"
 #include "spatial/grid.h"
+#include "spatial/sort_and_sweep.h"
+#include "spatial/grid_autotune.h"
+#include "spatial/neighbor_list.h"
 #include "spatial/particle_factory.h"
-#include "core/linked_list.h"
+#include "spatial/reorder.h"
+#include "core/arena.h"
+#include "core/checkpoint.h"
+#include "core/fixed_step.h"
+#include "core/particle_store.h"
 #include "core/profiler.h"
+#include "core/snapshot.h"
+#include "core/thread_pool.h"
+#include "core/trace.h"
+#include "core/trajectory.h"
 
 static const float time_step = 0.01f;
+// Physics steps since the run began, counting the steps of a loaded checkpoint
+static uint64_t steps_done = 0;
 
-int main(void) {
-    if (!init_renderer()) {
-        fprintf(stderr, "Failed to initialize renderer!\n");
-        return 1;
+typedef struct SimulationConfig {
+    int particle_count;
+    int grid_dim;           // 0 sizes the grid from the particle radius
+    int autotune_steps;     // Warm-up steps per candidate cell size, 0 disables autotuning
+    GridBackend grid_backend;
+    int grid_levels;        // Most grid levels for mixed radii, 0 picks them from the other options
+    BroadPhase broad_phase;
+    float domain_size;      // Side of the square tank in meters
+    float radius_spread;    // Largest radius of a new lattice over the default one
+    unsigned int seed;
+    int seed_given;
+    int thread_count;
+    int deterministic;
+    int headless;
+    int render_rate;        // Frames per second presented by the windowed loop
+    int max_substeps;       // Physics steps per scheduler tick before falling behind
+    int steps;              // Steps to run in headless mode
+    const char* trace_path; // Chrome trace JSON written at exit, NULL for none
+    NarrowPhaseKernel narrow_phase;
+    float verlet_skin;      // Neighbor list skin in meters, 0 rebuilds the grid every step
+    int reorder_interval;   // Steps between Morton reorders, 0 disables them
+    int sleep_steps;        // Calm steps before a particle sleeps, 0 disables sleeping
+    int recycle_per_step;   // Particles removed and dropped in again after every step
+    float restitution;      // Share of the normal velocity kept by particle-particle impacts
+    int sph;                // SPH fluid model instead of elastic collisions
+    float cfl;              // Largest move per substep in radii, 0 runs one substep per step
+    int overlap_iterations; // Most overlap solver sweeps per substep
+    int warm_start;         // Carry contact corrections from step to step
+    OverlapSolver overlap_solver;
+    float coulomb_constant; // Coulomb forces between charges, 0 disables them
+    float theta;            // Barnes-Hut opening angle
+    const char* load_path;  // Checkpoint to start from instead of a fresh lattice
+    const char* save_path;  // Checkpoint written at exit, NULL for none
+    int save_interval;      // Steps between background checkpoint writes, 0 only at exit
+    const char* trajectory_path;    // Frame export file, NULL for none
+    int trajectory_every;   // Steps between exported frames
+    int trajectory_quantize;        // 16-bit positions and velocities
+} SimulationConfig;
+
+static void print_usage(const char* program) {
+    printf("Usage: %s [options]\n", program);
+    printf("  -n, --particles N    number of particles (default 10000)\n");
+    printf("  -g, --grid N         grid dimension, N x N partitions (default: from particle radius)\n");
+    printf("  -A, --autotune N     time N warm-up steps per candidate cell size and keep the fastest\n");
+    printf("  -G, --spatial KIND   grid storage: dense, hash (default dense; hash sizes cells from the radius)\n");
+    printf("  -D, --levels N       grid levels for mixed radii, 1 to %d (default %d; 1 with --verlet, sph or sap)\n",
+           GRID_MAX_LEVELS, GRID_MAX_LEVELS);
+    printf("  -B, --broad-phase BP candidate pairs from: grid, sap (sort-and-sweep) (default grid)\n");
+    printf("  -L, --domain L       side of the simulation domain in meters (default 1)\n");
+    printf("  -R, --radii S        new particles get radii from the default up to S times it (default 1)\n");
+    printf("  -s, --seed N         random seed (default: current time)\n");
+    printf("  -t, --threads N      worker threads for the physics step (default 1)\n");
+    printf("  -d, --deterministic  results independent of the thread count\n");
+    printf("  -H, --headless       run without SDL and print a benchmark report\n");
+    printf("  -S, --steps N        steps to run in headless mode (default 1000)\n");
+    printf("  -F, --fps N          frames presented per second in the window (default 60)\n");
+    printf("  -K, --max-substeps K physics steps run at most to catch up per tick (default 5)\n");
+    printf("  -M, --model MODEL    particle interaction: collision, sph (default collision)\n");
+    printf("  -C, --cfl F          split steps so no particle moves more than F radii per substep (default off)\n");
+    printf("  -i, --iterations N   overlap solver sweeps per step at most (default 5)\n");
+    printf("  -w, --warm-start     warm-start the overlap solver from last step's contacts\n");
+    printf("  -O, --solver SOLVER  overlap solver: auto, sequential, partitions, graph, jacobi (default auto)\n");
+    printf("  -Q, --coulomb K      Coulomb constant for forces between charges (default 0, off)\n");
+    printf("  -a, --theta A        Barnes-Hut opening angle, 0 sums all pairs (default %.1f)\n",
+           ELECTROSTATICS_DEFAULT_THETA);
+    printf("  -k, --simd KERNEL    narrow-phase kernel: auto, scalar, sse, avx2 (default auto)\n");
+    printf("  -v, --verlet SKIN    reuse neighbor lists until a particle moves SKIN/2 meters (default off)\n");
+    printf("  -r, --reorder K      reorder particles along a Z-order curve at least every K steps (default off)\n");
+    printf("  -z, --sleep M        put particles to sleep after M calm steps (default off)\n");
+    printf("  -u, --recycle K      remove K random particles after every step and drop K in at the top (default 0)\n");
+    printf("  -E, --restitution E  velocity kept by particle impacts, 0 to 1 (default 1, elastic)\n");
+    printf("  -l, --load FILE      start from a checkpoint instead of a new particle lattice\n");
+    printf("  -o, --save FILE      write a checkpoint to FILE at exit\n");
+    printf("  -e, --save-every K   also write it in the background every K steps\n");
+    printf("  -x, --export FILE    stream positions and velocities to FILE from a writer thread\n");
+    printf("  -X, --export-every N export every Nth step (default 1)\n");
+    printf("  -q, --quantize       export 16-bit values relative to the domain size\n");
+    printf("  -T, --trace FILE     record profiling zones and write a Chrome trace to FILE\n");
+    printf("  -h, --help           show this message\n");
+}
+
+static int parse_grid_backend(const char* name, GridBackend* backend) {
+    static const GridBackend backends[] = { GRID_DENSE, GRID_HASHED };
+    for (size_t b = 0; b < sizeof(backends) / sizeof(backends[0]); b++) {
+        if (strcmp(name, grid_backend_name(backends[b])) == 0) {
+            *backend = backends[b];
+            return 1;
+        }
     }
+    return 0;
+}
 
-    srand((unsigned int)time(NULL));
-    init_grid(256);
-    create_particles(10000);
+static int parse_broad_phase(const char* name, BroadPhase* broad_phase) {
+    static const BroadPhase backends[] = { BROAD_PHASE_GRID, BROAD_PHASE_SORT_AND_SWEEP };
+    for (size_t b = 0; b < sizeof(backends) / sizeof(backends[0]); b++) {
+        if (strcmp(name, broad_phase_name(backends[b])) == 0) {
+            *broad_phase = backends[b];
+            return 1;
+        }
+    }
+    return 0;
+}
 
-    int partition_count = list_count(get_all_partitions());
-    printf("SpacePartitionListLength: %d\n", partition_count);
+static int parse_overlap_solver(const char* name, OverlapSolver* solver) {
+    static const OverlapSolver solvers[] = {
+        OVERLAP_SOLVER_AUTO, OVERLAP_SOLVER_SEQUENTIAL, OVERLAP_SOLVER_PARTITIONS,
+        OVERLAP_SOLVER_GRAPH, OVERLAP_SOLVER_JACOBI
+    };
+    for (size_t k = 0; k < sizeof(solvers) / sizeof(solvers[0]); k++) {
+        if (strcmp(name, overlap_solver_name(solvers[k])) == 0) {
+            *solver = solvers[k];
+            return 1;
+        }
+    }
+    return 0;
+}
 
-    Profiler profiler;
-    profiler_init(&profiler);
+static int parse_narrow_phase_kernel(const char* name, NarrowPhaseKernel* kernel) {
+    static const NarrowPhaseKernel kernels[] = {
+        NARROW_PHASE_AUTO, NARROW_PHASE_SCALAR, NARROW_PHASE_SSE, NARROW_PHASE_AVX2
+    };
+    for (size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++) {
+        if (strcmp(name, narrow_phase_kernel_name(kernels[k])) == 0) {
+            *kernel = kernels[k];
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Returns 0 to continue, 1 to exit successfully, -1 on a usage error
+static int parse_options(int argc, char** argv, SimulationConfig* config) {
+    static const struct option long_options[] = {
+        {"particles", required_argument, NULL, 'n'},
+        {"grid", required_argument, NULL, 'g'},
+        {"autotune", required_argument, NULL, 'A'},
+        {"spatial", required_argument, NULL, 'G'},
+        {"levels", required_argument, NULL, 'D'},
+        {"broad-phase", required_argument, NULL, 'B'},
+        {"domain", required_argument, NULL, 'L'},
+        {"radii", required_argument, NULL, 'R'},
+        {"seed", required_argument, NULL, 's'},
+        {"threads", required_argument, NULL, 't'},
+        {"deterministic", no_argument, NULL, 'd'},
+        {"headless", no_argument, NULL, 'H'},
+        {"steps", required_argument, NULL, 'S'},
+        {"fps", required_argument, NULL, 'F'},
+        {"max-substeps", required_argument, NULL, 'K'},
+        {"trace", required_argument, NULL, 'T'},
+        {"model", required_argument, NULL, 'M'},
+        {"cfl", required_argument, NULL, 'C'},
+        {"iterations", required_argument, NULL, 'i'},
+        {"warm-start", no_argument, NULL, 'w'},
+        {"solver", required_argument, NULL, 'O'},
+        {"coulomb", required_argument, NULL, 'Q'},
+        {"theta", required_argument, NULL, 'a'},
+        {"simd", required_argument, NULL, 'k'},
+        {"verlet", required_argument, NULL, 'v'},
+        {"reorder", required_argument, NULL, 'r'},
+        {"sleep", required_argument, NULL, 'z'},
+        {"recycle", required_argument, NULL, 'u'},
+        {"restitution", required_argument, NULL, 'E'},
+        {"load", required_argument, NULL, 'l'},
+        {"save", required_argument, NULL, 'o'},
+        {"save-every", required_argument, NULL, 'e'},
+        {"export", required_argument, NULL, 'x'},
+        {"export-every", required_argument, NULL, 'X'},
+        {"quantize", no_argument, NULL, 'q'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0}
+    };
+
+    int option;
+    while ((option = getopt_long(argc, argv, "n:g:A:G:D:B:L:R:s:t:dHS:F:K:T:M:C:i:wO:Q:a:k:v:r:z:u:E:l:o:e:x:X:qh", long_options, NULL)) != -1) {
+        switch (option) {
+            case 'n':
+                config->particle_count = atoi(optarg);
+                break;
+            case 'g':
+                config->grid_dim = atoi(optarg);
+                break;
+            case 'A':
+                config->autotune_steps = atoi(optarg);
+                break;
+            case 'G':
+                if (!parse_grid_backend(optarg, &config->grid_backend)) {
+                    fprintf(stderr, "error: unknown grid storage '%s'\n", optarg);
+                    return -1;
+                }
+                break;
+            case 'D':
+                config->grid_levels = atoi(optarg);
+                break;
+            case 'B':
+                if (!parse_broad_phase(optarg, &config->broad_phase)) {
+                    fprintf(stderr, "error: unknown broad phase '%s'\n", optarg);
+                    return -1;
+                }
+                break;
+            case 'L':
+                config->domain_size = (float)atof(optarg);
+                break;
+            case 'R':
+                config->radius_spread = (float)atof(optarg);
+                break;
+            case 's':
+                config->seed = (unsigned int)strtoul(optarg, NULL, 10);
+                config->seed_given = 1;
+                break;
+            case 't':
+                config->thread_count = atoi(optarg);
+                break;
+            case 'd':
+                config->deterministic = 1;
+                break;
+            case 'H':
+                config->headless = 1;
+                break;
+            case 'S':
+                config->steps = atoi(optarg);
+                break;
+            case 'F':
+                config->render_rate = atoi(optarg);
+                break;
+            case 'K':
+                config->max_substeps = atoi(optarg);
+                break;
+            case 'T':
+                config->trace_path = optarg;
+                break;
+            case 'M':
+                if (strcmp(optarg, "sph") == 0) {
+                    config->sph = 1;
+                } else if (strcmp(optarg, "collision") == 0) {
+                    config->sph = 0;
+                } else {
+                    fprintf(stderr, "error: unknown model '%s'\n", optarg);
+                    return -1;
+                }
+                break;
+            case 'C':
+                config->cfl = (float)atof(optarg);
+                break;
+            case 'i':
+                config->overlap_iterations = atoi(optarg);
+                break;
+            case 'w':
+                config->warm_start = 1;
+                break;
+            case 'O':
+                if (!parse_overlap_solver(optarg, &config->overlap_solver)) {
+                    fprintf(stderr, "error: unknown overlap solver '%s'\n", optarg);
+                    return -1;
+                }
+                break;
+            case 'Q':
+                config->coulomb_constant = (float)atof(optarg);
+                break;
+            case 'a':
+                config->theta = (float)atof(optarg);
+                break;
+            case 'k':
+                if (!parse_narrow_phase_kernel(optarg, &config->narrow_phase)) {
+                    fprintf(stderr, "error: unknown narrow-phase kernel '%s'\n", optarg);
+                    return -1;
+                }
+                break;
+            case 'v':
+                config->verlet_skin = (float)atof(optarg);
+                break;
+            case 'r':
+                config->reorder_interval = atoi(optarg);
+                break;
+            case 'z':
+                config->sleep_steps = atoi(optarg);
+                break;
+            case 'u':
+                config->recycle_per_step = atoi(optarg);
+                break;
+            case 'E':
+                config->restitution = (float)atof(optarg);
+                break;
+            case 'l':
+                config->load_path = optarg;
+                break;
+            case 'o':
+                config->save_path = optarg;
+                break;
+            case 'e':
+                config->save_interval = atoi(optarg);
+                break;
+            case 'x':
+                config->trajectory_path = optarg;
+                break;
+            case 'X':
+                config->trajectory_every = atoi(optarg);
+                break;
+            case 'q':
+                config->trajectory_quantize = 1;
+                break;
+            case 'h':
+                print_usage(argv[0]);
+                return 1;
+            default:
+                print_usage(argv[0]);
+                return -1;
+        }
+    }
+
+    if (config->particle_count < 1 || config->steps < 1) {
+        fprintf(stderr, "error: particle and step counts must be positive\n");
+        return -1;
+    }
+    if (config->render_rate < 1 || config->max_substeps < 1) {
+        fprintf(stderr, "error: frame rate and substep cap must be positive\n");
+        return -1;
+    }
+    if (config->domain_size <= 0) {
+        fprintf(stderr, "error: domain size must be positive\n");
+        return -1;
+    }
+    if (config->save_interval > 0 && config->save_path == NULL) {
+        fprintf(stderr, "error: --save-every needs --save FILE\n");
+        return -1;
+    }
+    if (config->trajectory_every < 1) {
+        fprintf(stderr, "error: export interval must be positive\n");
+        return -1;
+    }
+    if (config->sph && (config->verlet_skin > 0 || config->sleep_steps > 0 || config->cfl > 0 ||
+                        config->restitution != 1.0f)) {
+        fprintf(stderr, "error: --verlet, --sleep, --cfl and --restitution only apply to the collision model\n");
+        return -1;
+    }
+    if (config->broad_phase != BROAD_PHASE_GRID && (config->sph || config->verlet_skin > 0)) {
+        fprintf(stderr, "error: --broad-phase sap applies to the collision model without --verlet\n");
+        return -1;
+    }
+    if (config->grid_levels < 0 || config->grid_levels > GRID_MAX_LEVELS) {
+        fprintf(stderr, "error: grid levels must be between 1 and %d\n", GRID_MAX_LEVELS);
+        return -1;
+    }
+    if (config->grid_levels > 1 &&
+        (config->sph || config->verlet_skin > 0 || config->broad_phase != BROAD_PHASE_GRID)) {
+        fprintf(stderr, "error: --levels applies to the collision model without --verlet or --broad-phase sap\n");
+        return -1;
+    }
+    if (!(config->radius_spread >= 1.0f)) {
+        fprintf(stderr, "error: radius spread must be at least 1\n");
+        return -1;
+    }
+    if (config->coulomb_constant > 0 && (config->sph || config->sleep_steps > 0)) {
+        fprintf(stderr, "error: --coulomb applies to the collision model without --sleep\n");
+        return -1;
+    }
+    if (config->coulomb_constant < 0 || config->theta < 0) {
+        fprintf(stderr, "error: Coulomb constant and opening angle must not be negative\n");
+        return -1;
+    }
+    if (config->overlap_iterations < 1) {
+        fprintf(stderr, "error: solver iterations must be positive\n");
+        return -1;
+    }
+    if (!(config->restitution >= 0.0f && config->restitution <= 1.0f)) {
+        fprintf(stderr, "error: restitution must be between 0 and 1\n");
+        return -1;
+    }
+    if (config->cfl < 0) {
+        fprintf(stderr, "error: substep bound must not be negative\n");
+        return -1;
+    }
+    if (config->verlet_skin < 0) {
+        fprintf(stderr, "error: neighbor list skin must not be negative\n");
+        return -1;
+    }
+    return 0;
+}
+
+static void print_benchmark_report(const SimulationConfig* config, const Profiler* prof, double wall_ms) {
+    int steps = prof->physics_steps;
+    double steps_per_second = steps / (wall_ms / 1000.0);
+    double ns_per_particle_step = wall_ms * 1.0e6 / ((double)steps * config->particle_count);
+
+    printf("Benchmark: %d particles, %d steps, %d threads, grid %dx%d (%s), %s broad phase\n",
+           config->particle_count, steps, thread_pool_size(), get_grid_dim(), get_grid_dim(),
+           grid_backend_name(get_grid_backend()), broad_phase_name(get_broad_phase()));
+    printf("  wall time:         %10.3f s\n", wall_ms / 1000.0);
+    printf("  steps/sec:         %10.2f\n", steps_per_second);
+    printf("  ns/particle-step:  %10.2f\n", ns_per_particle_step);
+    printf("  physics ms/step:   %10.3f\n", prof->total_physics_ms / steps);
+    printf("  phase breakdown (ms/step, share of physics):\n");
+    for (int phase = 0; phase < PHASE_COUNT; phase++) {
+        double ms = prof->total_phase_ms[phase];
+        double share = prof->total_physics_ms > 0 ? 100.0 * ms / prof->total_physics_ms : 0.0;
+        printf("    %-20s %10.3f  %5.1f%%\n", profiler_phase_name((ProfilerPhase)phase), ms / steps, share);
+    }
+    printf("  contact pairs:     %d last step, %d peak, %ld dropped, %d buffer growths (%.2f MiB)\n",
+           prof->contact_pairs, prof->contact_pairs_peak, prof->contact_pairs_dropped,
+           prof->contact_buffer_growths, prof->contact_buffer_bytes / 1048576.0);
+    if (!sph_enabled()) {
+        const OverlapSolverStats* solver = get_overlap_solver_stats();
+        printf("  overlap solver:    %.2f sweeps avg, %d peak (limit %d); residual overlap %.2e m deepest "
+               "(%.2e m avg over solves), %.2e m mean, %d pairs above the %.0e m tolerance\n",
+               solver->solves > 0 ? (double)solver->total_iterations / solver->solves : 0.0,
+               solver->peak_iterations, config->overlap_iterations, solver->residual,
+               solver->solves > 0 ? solver->total_residual / solver->solves : 0.0, solver->mean_residual,
+               solver->above_tolerance, get_overlap_tolerance());
+        if (solver->pair_colors > 0)
+            printf("  pair coloring:     %d colors, %d pairs in the serial batch in the last solve\n",
+                   solver->pair_colors, solver->overflow_pairs);
+        if (contact_warm_start_enabled())
+            printf("  contact cache:     %d contacts kept for the next solve\n", solver->cached);
+    }
+    if (config->cfl > 0 || sph_enabled())
+        printf("  substeps:          %.2f avg, %d peak, %d last step%s\n",
+               (double)prof->total_substeps / steps, prof->substeps_peak, prof->substeps,
+               config->cfl > 0 ? "" : " (sound speed bound)");
+    if (config->cfl > 0)
+        printf("  fastest particle:  %.3f m/s in the last position pass\n", physics_max_speed());
+    if (sph_enabled()) {
+        const SphStats* sph = get_sph_stats();
+        printf("  SPH:               h %.4f, rest density %.0f, %d substeps/step, "
+               "%.1f avg / %d max neighbors, mean density %.3f x rest\n",
+               sph_smoothing_length(), sph_rest_density(), sph->substeps,
+               (double)sph->neighbor_entries / config->particle_count, sph->max_neighbors,
+               sph->mean_density_ratio);
+    }
+    if (electrostatics_enabled()) {
+        const ElectrostaticsStats* charges = get_electrostatics_stats();
+        printf("  charge tree:       theta %.2f, %d nodes, %d leaves, %d parallel subtrees, "
+               "%.1f interactions/particle\n",
+               electrostatics_theta(), charges->nodes, charges->leaves, charges->subtrees,
+               (double)charges->interactions / config->particle_count);
+    }
+    if (get_broad_phase() == BROAD_PHASE_SORT_AND_SWEEP) {
+        const SortAndSweepStats* sweep = get_sort_and_sweep_stats();
+        printf("  sort and sweep:    along %c, %.1f candidates/particle, %.1f moves/particle per update, "
+               "%d full sorts (%d after a failed insertion sort), %d axis switches, %d pairs beyond the stencil\n",
+               sweep->axis == 0 ? 'x' : 'y', (double)sweep->candidates / config->particle_count,
+               sweep->updates > 0 ? (double)sweep->total_moves / sweep->updates / config->particle_count : 0.0,
+               sweep->full_sorts, sweep->failed_insertions, sweep->axis_switches, sweep->beyond_stencil);
+    }
+    for (int level = 0; get_grid_level_count() > 1 && level < get_grid_level_count(); level++) {
+        GridLevelStats stats;
+        get_grid_level_stats(level, &stats);
+        printf("  grid level %d:      cell %.4f m, %d particles in %d of %d cells (%.1f avg, %d max), "
+               "%d finer listed\n",
+               level, stats.cell_size, stats.particles, stats.occupied, stats.partitions,
+               stats.occupied > 0 ? (double)stats.particles / stats.occupied : 0.0, stats.max_occupancy,
+               stats.finer);
+    }
+    if (neighbor_list_enabled()) {
+        const NeighborListStats* lists = get_neighbor_list_stats();
+        printf("  neighbor lists:    skin %.4f, %d builds in %d steps (every %.1f steps), "
+               "%.1f avg / %d max neighbors\n",
+               neighbor_list_skin(), lists->rebuilds, lists->checks,
+               lists->rebuilds > 0 ? (double)lists->checks / lists->rebuilds : 0.0,
+               (double)lists->entries / config->particle_count, lists->max_neighbors);
+    }
+    if (sleep_enabled()) {
+        const SleepStats* sleep = get_sleep_stats();
+        printf("  sleeping:          %d particles (%.1f%%), %d partitions, %ld wake-ups "
+               "(%ld by motion nearby)\n",
+               sleep->sleeping, 100.0 * sleep->sleeping / config->particle_count,
+               sleep->sleeping_partitions, sleep->total_woken, sleep->total_shaken);
+    }
+    if (reorder_enabled()) {
+        const ReorderStats* reorder = get_reorder_stats();
+        printf("  Z-order reorders:  %d (%d on locality), %.1f%% of particles scattered now, "
+               "%.1f%% -> %.1f%% at the last reorder\n",
+               reorder->reorders, reorder->triggered_by_locality, 100.0f * reorder->scattered,
+               100.0f * reorder->scattered_before_reorder, 100.0f * reorder->scattered_after_reorder);
+    }
+}
+
+static void print_memory_report(void) {
+    const Arena* arena = get_simulation_arena();
+    const ParticleStore* store = get_particle_store();
+
+    printf("  simulation arena:  %.2f MiB reserved in %d system allocations, %.2f MiB used\n",
+           arena->reserved / 1048576.0, arena->system_allocations, arena->used / 1048576.0);
+    if (recycle_enabled()) {
+        const Arena* scratch = get_recycle_arena();
+        printf("  recycling scratch: %.2f MiB reserved in %d system allocations, peak %.2f MiB per pass\n",
+               scratch->reserved / 1048576.0, scratch->system_allocations, scratch->peak / 1048576.0);
+    }
+    printf("  grid:              %.2f MiB, ", get_grid_memory() / 1048576.0);
+    if (get_grid_backend() == GRID_HASHED)
+        printf("%d of %d cells occupied, %.2f probes per lookup\n",
+               get_partition_count(), get_partition_capacity(), get_grid_probe_length());
+    else
+        printf("%d cells\n", get_partition_count());
+    printf("  particle slots:    %d live / %d capacity, %d free ids, %ld created, %ld destroyed\n",
+           store->count, store->capacity, store->free_id_count, store->created, store->destroyed);
+}
+
+static void print_autotune_report(const GridAutotuneResult* tuning) {
+    for (int c = 0; c < tuning->candidates; c++)
+        printf("Grid autotune: %4dx%-4d cell %.4f m  %8.3f ms/step%s\n",
+               tuning->grid_dims[c], tuning->grid_dims[c], domain_size / tuning->grid_dims[c],
+               tuning->ms_per_step[c], c == tuning->best ? "  <- kept" : "");
+}
+
+// Starts a background checkpoint write every save_interval steps. A write
+// still running from the last interval is left alone rather than waited for.
+static void save_checkpoint_if_due(const SimulationConfig* config) {
+    if (config->save_interval <= 0 || steps_done % config->save_interval != 0)
+        return;
+    if (!checkpoint_write_async(config->save_path, get_particle_store(), steps_done, domain_size))
+        printf("Checkpoint at step %llu skipped, previous write still running\n", (unsigned long long)steps_done);
+}
+
+static void save_final_checkpoint(const SimulationConfig* config) {
+    if (config->save_path == NULL)
+        return;
+    checkpoint_wait();
+    if (checkpoint_write_async(config->save_path, get_particle_store(), steps_done, domain_size) && checkpoint_wait())
+        printf("Checkpoint written to %s (step %llu)\n", config->save_path, (unsigned long long)steps_done);
+}
+
+static void print_trajectory_report(const char* path) {
+    const TrajectoryStats* stats = get_trajectory_stats();
+    printf("Trajectory: %ld frames (%ld dropped) written to %s, %.2f MiB, %.1f ms in the writer\n",
+           stats->frames_written, stats->frames_dropped, path,
+           stats->bytes_written / 1048576.0, stats->writer_ms);
+}
+
+static void run_headless(const SimulationConfig* config, Profiler* profiler) {
+    uint64_t start = profiler_now_ns();
+
+    for (int step = 0; step < config->steps; step++) {
+        TRACE_SCOPE("frame");
+        profiler_start_frame(profiler);
+        profiler_start_physics(profiler);
+        physics_step(time_step);
+        profiler_end_physics(profiler);
+        steps_done++;
+        save_checkpoint_if_due(config);
+        profiler_end_frame(profiler);
+    }
+
+    double wall_ms = (profiler_now_ns() - start) / 1.0e6;
+    print_benchmark_report(config, profiler, wall_ms);
+    print_memory_report();
+}
+
+#ifndef HEADLESS_BUILD
+static void sleep_ns(uint64_t ns) {
+    struct timespec duration = { (time_t)(ns / 1000000000ull), (long)(ns % 1000000000ull) };
+    nanosleep(&duration, NULL);
+}
+
+typedef struct PhysicsThreadContext {
+    const SimulationConfig* config;
+    Profiler* profiler;
+    SnapshotBuffer* snapshots;
+    FixedStepClock clock;   // Owned by the physics thread until it is joined
+    int quit;               // Set by the render loop, read atomically
+} PhysicsThreadContext;
+
+// Runs every step that has come due on the fixed 100 Hz schedule, then
+// publishes one snapshot of the last step and sleeps until the next is due.
+// Never waits on the renderer: a snapshot the renderer has not picked up yet
+// is simply replaced by the next one.
+static void* physics_thread_main(void* arg) {
+    PhysicsThreadContext* ctx = arg;
+    ParticleStore* store = get_particle_store();
+    trace_set_thread_name("physics");
+
+    while (!__atomic_load_n(&ctx->quit, __ATOMIC_ACQUIRE)) {
+        uint64_t now = profiler_now_ns();
+        int due = fixed_step_due(&ctx->clock, now);
+        if (due == 0) {
+            sleep_ns(fixed_step_time_until_due(&ctx->clock, now));
+            continue;
+        }
+
+        PositionSnapshot* snapshot = snapshot_begin_write(ctx->snapshots);
+        for (int substep = 0; substep < due; substep++) {
+            int last = substep == due - 1;
+            int reorders = get_reorder_stats()->reorders;
+            long destroyed = store->destroyed;
+            if (last)
+                snapshot_capture_previous(snapshot, store);
+
+            TRACE_ZONE_BEGIN("frame");
+            profiler_start_frame(ctx->profiler);
+            profiler_start_physics(ctx->profiler);
+            physics_step(time_step);
+            profiler_end_physics(ctx->profiler);
+            steps_done++;
+            save_checkpoint_if_due(ctx->config);
+            profiler_end_frame(ctx->profiler);
+            TRACE_ZONE_END();
+
+            // A reorder or removal moves particles to new slots, so there is
+            // nothing to interpolate from
+            if (last && (get_reorder_stats()->reorders != reorders || store->destroyed != destroyed))
+                snapshot->has_previous = 0;
+        }
+
+        TRACE_ZONE_BEGIN("publish snapshot");
+        snapshot_capture(snapshot, store, steps_done, fixed_step_last_due(&ctx->clock),
+                         ctx->profiler->avg_physics_ms);
+        snapshot_publish(ctx->snapshots);
+        TRACE_ZONE_END();
+    }
+    return NULL;
+}
+
+static void print_scheduler_report(const FixedStepClock* physics, const FixedStepClock* render) {
+    printf("Frame scheduler: %ld physics steps (%ld dropped by the cap in %ld ticks), %ld frames presented "
+           "(%ld skipped)\n",
+           physics->steps, physics->dropped_steps, physics->capped_calls, render->steps, render->dropped_steps);
+}
+
+// SDL wants its window and renderer driven from the thread that created
+// them, so rendering stays on the main thread and physics moves to its own.
+// Frames are presented on their own fixed schedule, each showing the newest
+// snapshot interpolated to the frame's time.
+static void run_windowed(const SimulationConfig* config, Profiler* physics_profiler) {
+    SnapshotBuffer snapshots;
+    snapshot_buffer_init(&snapshots, config->particle_count);
+    PositionSnapshot display;
+    snapshot_init(&display, config->particle_count);
+
+    PhysicsThreadContext physics = {
+        .config = config,
+        .profiler = physics_profiler,
+        .snapshots = &snapshots,
+        .quit = 0,
+    };
+    fixed_step_init(&physics.clock, time_step, config->max_substeps, profiler_now_ns());
+    uint64_t step_ns = physics.clock.step_ns;
+    pthread_t physics_thread;
+    if (pthread_create(&physics_thread, NULL, physics_thread_main, &physics) != 0) {
+        fprintf(stderr, "error: could not start physics thread\n");
+        snapshot_free(&display);
+        snapshot_buffer_free(&snapshots);
+        return;
+    }
+
+    Profiler render_profiler;
+    profiler_init(&render_profiler);
+    // Late frames are skipped, never presented back to back
+    FixedStepClock render_clock;
+    fixed_step_init(&render_clock, 1.0 / config->render_rate, 1, profiler_now_ns());
 
     int should_quit = 0;
     SDL_Event event;
@@ -37,23 +697,217 @@ int main(void) {
             if (event.type == SDL_QUIT)
                 should_quit = 1;
 
-        profiler_start_frame(&profiler);
+        uint64_t now = profiler_now_ns();
+        if (fixed_step_due(&render_clock, now) == 0) {
+            sleep_ns(fixed_step_time_until_due(&render_clock, now));
+            continue;
+        }
+        const PositionSnapshot* snapshot = snapshot_acquire_latest(&snapshots);
+        if (snapshot == NULL)
+            continue;
 
-        profiler_start_physics(&profiler);
-        physics_step(time_step);
-        profiler_end_physics(&profiler);
+        TRACE_ZONE_BEGIN("render");
+        profiler_start_frame(&render_profiler);
+        profiler_start_render(&render_profiler);
+        snapshot_interpolate(snapshot, fixed_step_alpha(step_ns, snapshot->due_ns, now), &display);
+        // Physics timing arrives with the snapshot from the physics thread
+        render_profiler.avg_physics_ms = display.physics_ms;
+        render_frame_with_profiler(&display, &render_profiler);
+        profiler_end_render(&render_profiler);
+        profiler_end_frame(&render_profiler);
+        TRACE_ZONE_END();
+    }
 
-        profiler_start_render(&profiler);
-        render_frame_with_profiler(&profiler, 10000);
-        profiler_end_render(&profiler);
+    __atomic_store_n(&physics.quit, 1, __ATOMIC_RELEASE);
+    pthread_join(physics_thread, NULL);
+    print_scheduler_report(&physics.clock, &render_clock);
+    snapshot_free(&display);
+    snapshot_buffer_free(&snapshots);
+}
+#endif
+
+int main(int argc, char** argv) {
+    SimulationConfig config = {
+        .particle_count = 10000,
+        .grid_dim = 0,
+        .autotune_steps = 0,
+        .grid_backend = GRID_DENSE,
+        .grid_levels = 0,
+        .broad_phase = BROAD_PHASE_GRID,
+        .domain_size = 1.0f,
+        .radius_spread = 1.0f,
+        .seed = 0,
+        .seed_given = 0,
+        .thread_count = 1,
+        .deterministic = 0,
+        .headless = 0,
+        .render_rate = 60,
+        .max_substeps = 5,
+        .steps = 1000,
+        .trace_path = NULL,
+        .narrow_phase = NARROW_PHASE_AUTO,
+        .verlet_skin = 0.0f,
+        .reorder_interval = 0,
+        .sleep_steps = 0,
+        .recycle_per_step = 0,
+        .restitution = 1.0f,
+        .sph = 0,
+        .cfl = 0.0f,
+        .overlap_iterations = 5,
+        .warm_start = 0,
+        .overlap_solver = OVERLAP_SOLVER_AUTO,
+        .coulomb_constant = 0.0f,
+        .theta = ELECTROSTATICS_DEFAULT_THETA,
+        .load_path = NULL,
+        .save_path = NULL,
+        .save_interval = 0,
+        .trajectory_path = NULL,
+        .trajectory_every = 1,
+        .trajectory_quantize = 0,
+    };
 
-        profiler_end_frame(&profiler);
+    int parsed = parse_options(argc, argv, &config);
+    if (parsed != 0)
+        return parsed > 0 ? 0 : 1;
 
-        usleep((useconds_t)(1000000 * time_step));
+#ifdef HEADLESS_BUILD
+    config.headless = 1;
+#else
+    if (!config.headless && !init_renderer()) {
+        fprintf(stderr, "Failed to initialize renderer!\n");
+        return 1;
     }
+#endif
 
+    int exit_code = 0;
+    trace_set_thread_name("main");
+    if (config.trace_path != NULL)
+        trace_init(TRACE_DEFAULT_EVENTS_PER_THREAD);
+
+    if (!config.seed_given)
+        config.seed = (unsigned int)time(NULL);
+    srand(config.seed);
+    printf("Seed: %u\n", config.seed);
+
+    // A checkpoint decides the particle count and domain
+    Checkpoint checkpoint = {0};
+    if (config.load_path != NULL) {
+        if (!checkpoint_open(config.load_path, &checkpoint)) {
+            exit_code = 1;
+            goto stop_trace;
+        }
+        config.particle_count = (int)checkpoint.header->particle_count;
+        config.domain_size = checkpoint.header->domain_size;
+        steps_done = checkpoint.header->step;
+    }
+    domain_size = config.domain_size;
+    particle_restitution = config.restitution;
+
+    // One arena block sized for the particle store and grid arrays
+    arena_init(get_simulation_arena(), (size_t)config.particle_count * 64 + ARENA_DEFAULT_BLOCK_SIZE);
+    particle_store_init(get_particle_store(), config.particle_count);
+    if (config.load_path != NULL) {
+        uint64_t load_start = profiler_now_ns();
+        checkpoint_load(&checkpoint, get_particle_store());
+        checkpoint_close(&checkpoint);
+        printf("Loaded %d particles from %s (step %llu) in %.2f ms\n", config.particle_count, config.load_path,
+               (unsigned long long)steps_done, (profiler_now_ns() - load_start) / 1.0e6);
+    } else {
+        create_particles(config.particle_count, config.radius_spread);
+    }
+    sph_init(config.sph);
+    electrostatics_init(config.coulomb_constant, config.theta);
+    // Verlet lists, SPH and sort-and-sweep only walk one level
+    int grid_levels = config.grid_levels;
+    if (grid_levels == 0)
+        grid_levels = config.sph || config.verlet_skin > 0 || config.broad_phase != BROAD_PHASE_GRID
+                      ? 1 : GRID_MAX_LEVELS;
+    init_grid(config.grid_dim, fmaxf(config.verlet_skin, sph_cell_margin()), config.grid_backend, grid_levels);
+    rebuild_grid();
+
+    thread_pool_init(config.thread_count);
+    neighbor_list_init(config.verlet_skin);
+    broad_phase_init(config.broad_phase);
+    reorder_init(config.reorder_interval);
+    init_collision_pairs(thread_pool_size(), get_partition_capacity());
+    physics_set_deterministic(config.deterministic);
+    physics_set_overlap_iterations(config.overlap_iterations);
+    OverlapSolver overlap_solver = physics_set_overlap_solver(config.overlap_solver);
+    if (config.warm_start)
+        enable_contact_warm_start();
+    NarrowPhaseKernel kernel = narrow_phase_select(config.narrow_phase);
+    if (config.autotune_steps > 0) {
+        GridAutotuneResult tuning;
+        grid_autotune(config.autotune_steps, time_step, &tuning);
+        print_autotune_report(&tuning);
+    }
+    // After autotuning, so the first speed bound comes from the real start state
+    physics_set_adaptive(config.cfl);
+    sleep_init(config.sleep_steps);
+    recycle_init(config.recycle_per_step);
+    // Opened after autotuning so warm-up steps are not exported
+    if (config.trajectory_path != NULL &&
+        !trajectory_open(config.trajectory_path, config.particle_count, config.trajectory_every,
+                         config.trajectory_quantize, domain_size, steps_done)) {
+        exit_code = 1;
+        goto shutdown;
+    }
+
+    printf("Grid: %s %dx%d, cell %.4f m (minimum %.4f m)%s\n",
+           grid_backend_name(get_grid_backend()), get_grid_dim(), get_grid_dim(), get_grid_cell_size(),
+           get_grid_min_cell_size(), config.autotune_steps > 0 ? " after autotuning" :
+           config.grid_dim > 0 ? "" : " chosen automatically");
+    if (get_grid_level_count() > 1)
+        printf("Grid levels: %d, cells up to %.4f m\n", get_grid_level_count(),
+               get_grid_cell_size() * (1 << (get_grid_level_count() - 1)));
+    printf("SpacePartitionListLength: %d\n", get_partition_count());
+    printf("Physics threads: %d%s\n", thread_pool_size(), config.deterministic ? " (deterministic)" : "");
+    printf("Narrow-phase kernel: %s\n", narrow_phase_kernel_name(kernel));
+    if (!config.sph)
+        printf("Overlap solver: %s\n", overlap_solver_name(overlap_solver));
+
+    Profiler profiler;
+    profiler_init(&profiler);
+    physics_set_profiler(&profiler);
+
+    if (config.headless)
+        run_headless(&config, &profiler);
+#ifndef HEADLESS_BUILD
+    else
+        run_windowed(&config, &profiler);
+#endif
+
+    physics_set_profiler(NULL);
+    trajectory_close();
+    if (config.trajectory_path != NULL)
+        print_trajectory_report(config.trajectory_path);
+    save_final_checkpoint(&config);
+
+    // Setup failures after the simulation state exists jump here, earlier
+    // ones to stop_trace
+shutdown:
+    checkpoint_shutdown();
+    thread_pool_shutdown();
+    if (config.trace_path != NULL && exit_code == 0 && trace_write_chrome_json(config.trace_path))
+        printf("Trace written to %s\n", config.trace_path);
+    cleanup_collision_pairs();
+    recycle_cleanup();
+    sleep_cleanup();
+    sph_cleanup();
+    electrostatics_cleanup();
+    reorder_cleanup();
+    neighbor_list_cleanup();
+    broad_phase_cleanup();
     cleanup_grid();
-    shutdown_renderer();
+    particle_store_free(get_particle_store());
+    arena_free(get_simulation_arena());
+stop_trace:
+    if (config.trace_path != NULL)
+        trace_shutdown();
+#ifndef HEADLESS_BUILD
+    if (!config.headless)
+        shutdown_renderer();
+#endif
 
-    return 0;
+    return exit_code;
 }
@@ -1,9 +1,15 @@
 #include "physics/collision.h"
+#include "physics/contact_cache.h"
 #include "core/math_utils.h"
-#include "render/renderer.h"
+#include "physics/forces.h"
+#include "physics/sleep.h"
 #include "spatial/grid.h"
-#include "core/linked_list.h"
+#include "core/thread_pool.h"
+#include "core/trace.h"
 #include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 float particle_restitution = 1.0f;
 float wall_restitution = 0.95f;
@@ -12,39 +18,88 @@ float wall_restitution = 0.95f;
 static const float position_correction_fraction = 0.5f;  // How much to correct per iteration (0-1)
 static const float min_penetration_threshold = 0.0001f;   // Stop iterating when max penetration is below this
 
-// Collision pair cache for eliminating redundant spatial queries
-#define MAX_COLLISION_PAIRS 50000
-static CollisionPair collision_pair_cache[MAX_COLLISION_PAIRS];
-static int collision_pair_count = 0;
-
-void detect_and_resolve_collision(Particle* a, Particle* b, float dt) {
-    if (distance_on_motion(a, b, dt) <= a->radius + b->radius) {
-        float dx = b->position[0] - a->position[0];
-        float dy = b->position[1] - a->position[1];
-        float dvx = a->velocity[0] - b->velocity[0];
-        float dvy = a->velocity[1] - b->velocity[1];
-        float approaching = dx * dvx + dy * dvy;
-
-        if (approaching > 0) {
-            resolve_particle_collision(a, b);
+// Collision pair cache for eliminating redundant spatial queries,
+// one buffer per thread plus the merged buffer the solvers read
+#define COLLISION_PAIRS_INITIAL_CAPACITY 4096
+
+typedef struct PartitionPairRange {
+    int buffer;
+    int begin;
+    int end;
+} PartitionPairRange;
+
+static CollisionPairBuffer* pair_buffers = NULL;
+static int pair_buffer_count = 0;
+static PartitionPairRange* partition_pairs = NULL;
+static int pair_partition_count = 0;
+static int* partition_pair_offsets = NULL;  // Start of each partition in merged_pairs
+static CollisionPairBuffer merged_pairs;
+static CollisionPairStats pair_stats;
+static OverlapSolverStats solver_stats;
+
+// Warm starting, see collision.h. pair_correction runs parallel to
+// merged_pairs and sums what the current solve has applied to each pair.
+static int warm_start = 0;
+static ContactCache contacts;
+static float* pair_correction = NULL;
+
+// Graph-colored and Jacobi solvers, allocated on first use. The per-particle
+// arrays cover the store's capacity, the per-pair ones grow with the merge.
+static uint32_t* particle_pair_colors = NULL;   // Colors taken by each particle's pairs
+static int* particle_pair_offsets = NULL;       // Jacobi: pairs of particle i are
+static int* particle_pairs = NULL;              // particle_pairs[offsets[i], offsets[i + 1])
+static float* delta_x = NULL;
+static float* delta_y = NULL;
+static int solver_particle_capacity = 0;
+static CollisionPair* pair_scratch = NULL;
+static unsigned char* pair_color = NULL;
+static int pair_scratch_capacity = 0;
+static int color_start[PAIR_COLOR_LIMIT + 2];   // Color c is merged pairs [start[c], start[c + 1])
+
+void detect_and_resolve_collision(ParticleStore* store, int a, int b, float dt, CollisionPairBuffer* pairs) {
+    // Two sleepers rest against each other by definition
+    if (particle_is_asleep(store, a) && particle_is_asleep(store, b))
+        return;
+
+    float dx = store->position_x[b] - store->position_x[a];
+    float dy = store->position_y[b] - store->position_y[a];
+    float dvx = store->velocity_x[b] - store->velocity_x[a];
+    float dvy = store->velocity_y[b] - store->velocity_y[a];
+
+    // Predicted separation after dt, compared squared to avoid the sqrt
+    float ex = dvx * dt + dx;
+    float ey = dvy * dt + dy;
+    float contact = store->radius[a] + store->radius[b];
+
+    if (ex * ex + ey * ey <= contact * contact) {
+        // Approaching when the relative velocity points against the offset
+        float closing = dx * dvx + dy * dvy;
+
+        if (closing < 0) {
+            resolve_particle_collision(store, a, b);
+            wake_if_disturbed(store, a);
+            wake_if_disturbed(store, b);
             // Cache this pair for position resolution phase
-            add_collision_pair(a, b);
+            add_collision_pair(pairs, a, b);
+        } else if (warm_start) {
+            // A resting contact, which the warm-started solve keeps pushing
+            add_collision_pair(pairs, a, b);
         }
     }
 }
 
-void resolve_particle_collision(Particle* a, Particle* b) {
-    float vax = a->velocity[0];
-    float vay = a->velocity[1];
-    float vbx = b->velocity[0];
-    float vby = b->velocity[1];
-    float ma = a->mass;
-    float mb = b->mass;
+void resolve_particle_collision(ParticleStore* store, int a, int b) {
+    float vax = store->velocity_x[a];
+    float vay = store->velocity_y[a];
+    float vbx = store->velocity_x[b];
+    float vby = store->velocity_y[b];
+    float ma = store->mass[a];
+    float mb = store->mass[b];
 
     float dvx = vax - vbx;
     float dvy = vay - vby;
-    float dx = a->position[0] - b->position[0];
-    float dy = a->position[1] - b->position[1];
+    float dx = store->position_x[a] - store->position_x[b];
+    float dy = store->position_y[a] - store->position_y[b];
 
     float dot_product = dvx * dx + dvy * dy;
     float distance_squared = dx * dx + dy * dy;
@@ -52,55 +107,63 @@ void resolve_particle_collision(Particle* a, Particle* b) {
     if (distance_squared > 0) {
         float collision_scale = 2 * dot_product / ((ma + mb) * distance_squared);
 
-        a->velocity[0] = particle_restitution * (vax - mb * collision_scale * dx);
-        a->velocity[1] = particle_restitution * (vay - mb * collision_scale * dy);
-        b->velocity[0] = particle_restitution * (vbx + ma * collision_scale * dx);
-        b->velocity[1] = particle_restitution * (vby + ma * collision_scale * dy);
+        store->velocity_x[a] = particle_restitution * (vax - mb * collision_scale * dx);
+        store->velocity_y[a] = particle_restitution * (vay - mb * collision_scale * dy);
+        store->velocity_x[b] = particle_restitution * (vbx + ma * collision_scale * dx);
+        store->velocity_y[b] = particle_restitution * (vby + ma * collision_scale * dy);
     }
 }
 
-void handle_wall_collision(Particle* p, float dt) {
-    float r = p->radius;
+void handle_wall_collision(ParticleStore* store, int i, float dt) {
+    float r = store->radius[i];
+    float* px = &store->position_x[i];
+    float* py = &store->position_y[i];
+    float* vx = &store->velocity_x[i];
+    float* vy = &store->velocity_y[i];
 
     // Predictive velocity reflection (existing behavior)
-    if (p->position[1] + r + p->velocity[1] * dt >= domain_size && p->velocity[1] > 0)
-        p->velocity[1] *= -wall_restitution;
-    if (p->position[1] - r + p->velocity[1] * dt <= 0 && p->velocity[1] < 0)
-        p->velocity[1] *= -wall_restitution;
+    if (*py + r + *vy * dt >= domain_size && *vy > 0)
+        *vy *= -wall_restitution;
+    if (*py - r + *vy * dt <= 0 && *vy < 0)
+        *vy *= -wall_restitution;
 
-    if (p->position[0] + r + p->velocity[0] * dt >= domain_size && p->velocity[0] > 0)
-        p->velocity[0] *= -wall_restitution;
-    if (p->position[0] - r + p->velocity[0] * dt <= 0 && p->velocity[0] < 0)
-        p->velocity[0] *= -wall_restitution;
+    if (*px + r + *vx * dt >= domain_size && *vx > 0)
+        *vx *= -wall_restitution;
+    if (*px - r + *vx * dt <= 0 && *vx < 0)
+        *vx *= -wall_restitution;
 }
 
-void clamp_particle_position(Particle* p) {
-    float r = p->radius;
-    
+void clamp_particle_position(ParticleStore* store, int i) {
+    float r = store->radius[i];
+    float* px = &store->position_x[i];
+    float* py = &store->position_y[i];
+    float* vx = &store->velocity_x[i];
+    float* vy = &store->velocity_y[i];
+
     // Hard position clamping to prevent escape
-    if (p->position[0] < r) {
-        p->position[0] = r;
-        if (p->velocity[0] < 0) p->velocity[0] = 0;
+    if (*px < r) {
+        *px = r;
+        if (*vx < 0) *vx = 0;
     }
-    if (p->position[0] > domain_size - r) {
-        p->position[0] = domain_size - r;
-        if (p->velocity[0] > 0) p->velocity[0] = 0;
+    if (*px > domain_size - r) {
+        *px = domain_size - r;
+        if (*vx > 0) *vx = 0;
     }
-    if (p->position[1] < r) {
-        p->position[1] = r;
-        if (p->velocity[1] < 0) p->velocity[1] = 0;
+    if (*py < r) {
+        *py = r;
+        if (*vy < 0) *vy = 0;
     }
-    if (p->position[1] > domain_size - r) {
-        p->position[1] = domain_size - r;
-        if (p->velocity[1] > 0) p->velocity[1] = 0;
+    if (*py > domain_size - r) {
+        *py = domain_size - r;
+        if (*vy > 0) *vy = 0;
     }
 }
 
-static void resolve_pair_overlap(Particle* a, Particle* b) {
-    float dx = b->position[0] - a->position[0];
-    float dy = b->position[1] - a->position[1];
+static void resolve_pair_overlap(ParticleStore* store, int a, int b) {
+    float dx = store->position_x[b] - store->position_x[a];
+    float dy = store->position_y[b] - store->position_y[a];
     float distance_squared = dx * dx + dy * dy;
-    float min_distance = a->radius + b->radius;
+    float min_distance = store->radius[a] + store->radius[b];
     
     if (distance_squared < min_distance * min_distance && distance_squared > 0) {
         float distance = sqrtf(distance_squared);
@@ -111,80 +174,75 @@ static void resolve_pair_overlap(Particle* a, Particle* b) {
         float ny = dy / distance;
         
         // Position correction (proportional to inverse mass)
-        float total_mass = a->mass + b->mass;
-        float a_ratio = b->mass / total_mass;
-        float b_ratio = a->mass / total_mass;
+        float total_mass = store->mass[a] + store->mass[b];
+        float a_ratio = store->mass[b] / total_mass;
+        float b_ratio = store->mass[a] / total_mass;
         
         float correction = penetration * position_correction_fraction;
         
-        a->position[0] -= nx * correction * a_ratio;
-        a->position[1] -= ny * correction * a_ratio;
-        b->position[0] += nx * correction * b_ratio;
-        b->position[1] += ny * correction * b_ratio;
+        store->position_x[a] -= nx * correction * a_ratio;
+        store->position_y[a] -= ny * correction * a_ratio;
+        store->position_x[b] += nx * correction * b_ratio;
+        store->position_y[b] += ny * correction * b_ratio;
     }
 }
 
+// Checks one candidate pair, resolves it if overlapping and returns the
+// penetration depth (0 when the pair does not overlap)
+static float check_pair_overlap(ParticleStore* store, int a, int b) {
+    float dx = store->position_x[b] - store->position_x[a];
+    float dy = store->position_y[b] - store->position_y[a];
+    float dist_sq = dx * dx + dy * dy;
+    float min_dist = store->radius[a] + store->radius[b];
+
+    if (dist_sq < min_dist * min_dist && dist_sq > 0) {
+        float penetration = min_dist - sqrtf(dist_sq);
+        resolve_pair_overlap(store, a, b);
+        return penetration;
+    }
+    return 0.0f;
+}
+
 void resolve_position_overlaps(int max_iterations) {
+    ParticleStore* store = get_particle_store();
+    const int* sorted = get_sorted_particles();
+    int partition_count = get_partition_count();
+
     for (int iteration = 0; iteration < max_iterations; iteration++) {
         float max_penetration = 0.0f;
         int corrections_made = 0;
         
-        Node* current_partition = get_all_partitions();
-        while (current_partition != NULL) {
-            Node* particle_node = current_partition->item;
-            while (particle_node != NULL) {
-                Particle* particle = (Particle*)particle_node->item;
-                
+        for (int partition = 0; partition < partition_count; partition++) {
+            int end = get_partition_end(partition);
+            int neighbors[GRID_MAX_NEIGHBORS];
+            int neighbor_count = get_adjacent_partitions(partition, neighbors);
+
+            for (int k = get_partition_begin(partition); k < end; k++) {
+                int i = sorted[k];
+
                 // Check against other particles in same partition
-                Node* other = particle_node->next;
-                while (other != NULL) {
-                    Particle* other_particle = (Particle*)other->item;
-                    
-                    float dx = other_particle->position[0] - particle->position[0];
-                    float dy = other_particle->position[1] - particle->position[1];
-                    float dist_sq = dx * dx + dy * dy;
-                    float min_dist = particle->radius + other_particle->radius;
-                    
-                    if (dist_sq < min_dist * min_dist && dist_sq > 0) {
-                        float dist = sqrtf(dist_sq);
-                        float penetration = min_dist - dist;
-                        if (penetration > max_penetration) {
+                for (int m = k + 1; m < end; m++) {
+                    float penetration = check_pair_overlap(store, i, sorted[m]);
+                    if (penetration > 0) {
+                        if (penetration > max_penetration)
                             max_penetration = penetration;
-                        }
-                        resolve_pair_overlap(particle, other_particle);
                         corrections_made++;
                     }
-                    other = other->next;
                 }
                 
                 // Check against particles in adjacent partitions
-                Node** neighbors = get_adjacent_partitions(current_partition);
-                for (int i = 0; i < 8 && neighbors[i] != NULL; i++) {
-                    Node* neighbor_particle = (Node*)neighbors[i]->item;
-                    while (neighbor_particle != NULL) {
-                        Particle* np = (Particle*)neighbor_particle->item;
-                        
-                        float dx = np->position[0] - particle->position[0];
-                        float dy = np->position[1] - particle->position[1];
-                        float dist_sq = dx * dx + dy * dy;
-                        float min_dist = particle->radius + np->radius;
-                        
-                        if (dist_sq < min_dist * min_dist && dist_sq > 0) {
-                            float dist = sqrtf(dist_sq);
-                            float penetration = min_dist - dist;
-                            if (penetration > max_penetration) {
+                for (int n = 0; n < neighbor_count; n++) {
+                    int neighbor_end = get_partition_end(neighbors[n]);
+                    for (int m = get_partition_begin(neighbors[n]); m < neighbor_end; m++) {
+                        float penetration = check_pair_overlap(store, i, sorted[m]);
+                        if (penetration > 0) {
+                            if (penetration > max_penetration)
                                 max_penetration = penetration;
-                            }
-                            resolve_pair_overlap(particle, np);
                             corrections_made++;
                         }
-                        neighbor_particle = neighbor_particle->next;
                     }
                 }
-                
-                particle_node = particle_node->next;
             }
-            current_partition = current_partition->next;
         }
         
         // Early termination if no significant overlaps remain
@@ -195,81 +253,729 @@ void resolve_position_overlaps(int max_iterations) {
 }
 
 void enforce_position_constraints(void) {
-    Node* current_partition = get_all_partitions();
-    while (current_partition != NULL) {
-        Node* particle_node = current_partition->item;
-        while (particle_node != NULL) {
-            Particle* particle = (Particle*)particle_node->item;
-            clamp_particle_position(particle);
-            particle_node = particle_node->next;
+    ParticleStore* store = get_particle_store();
+    for (int i = 0; i < store->count; i++)
+        clamp_particle_position(store, i);
+}
+
+// Collision pair cache management
+void init_collision_pairs(int buffer_count, int partition_count) {
+    pair_buffers = calloc(buffer_count, sizeof(CollisionPairBuffer));
+    partition_pairs = calloc(partition_count, sizeof(PartitionPairRange));
+    partition_pair_offsets = calloc(partition_count, sizeof(int));
+    if (pair_buffers == NULL || partition_pairs == NULL || partition_pair_offsets == NULL) {
+        fprintf(stderr, "error: malloc failed for collision pair buffers\n");
+        exit(1);
+    }
+
+    for (int t = 0; t < buffer_count; t++) {
+        pair_buffers[t].pairs = malloc(COLLISION_PAIRS_INITIAL_CAPACITY * sizeof(CollisionPair));
+        if (pair_buffers[t].pairs == NULL) {
+            fprintf(stderr, "error: malloc failed for collision pair buffer\n");
+            exit(1);
         }
-        current_partition = current_partition->next;
+        pair_buffers[t].capacity = COLLISION_PAIRS_INITIAL_CAPACITY;
     }
+    pair_buffer_count = buffer_count;
+    pair_partition_count = partition_count;
+    memset(&merged_pairs, 0, sizeof(merged_pairs));
+    memset(&pair_stats, 0, sizeof(pair_stats));
+    memset(&solver_stats, 0, sizeof(solver_stats));
+}
+
+float get_overlap_tolerance(void) {
+    return min_penetration_threshold;
+}
+
+const OverlapSolverStats* get_overlap_solver_stats(void) {
+    return &solver_stats;
+}
+
+void cleanup_collision_pairs(void) {
+    for (int t = 0; t < pair_buffer_count; t++)
+        free(pair_buffers[t].pairs);
+    free(pair_buffers);
+    free(partition_pairs);
+    free(partition_pair_offsets);
+    free(merged_pairs.pairs);
+    memset(&merged_pairs, 0, sizeof(merged_pairs));
+    free(particle_pair_colors);
+    free(particle_pair_offsets);
+    free(particle_pairs);
+    free(delta_x);
+    free(delta_y);
+    free(pair_scratch);
+    free(pair_color);
+    free(pair_correction);
+    contact_cache_free(&contacts);
+    particle_pair_colors = NULL;
+    particle_pair_offsets = NULL;
+    particle_pairs = NULL;
+    delta_x = NULL;
+    delta_y = NULL;
+    solver_particle_capacity = 0;
+    pair_scratch = NULL;
+    pair_color = NULL;
+    pair_scratch_capacity = 0;
+    pair_correction = NULL;
+    warm_start = 0;
+    pair_buffers = NULL;
+    partition_pairs = NULL;
+    partition_pair_offsets = NULL;
+    pair_buffer_count = 0;
+    pair_partition_count = 0;
 }
 
-// Collision pair cache management
 void clear_collision_pairs(void) {
-    collision_pair_count = 0;
+    for (int t = 0; t < pair_buffer_count; t++)
+        pair_buffers[t].count = 0;
+    merged_pairs.count = 0;
+    memset(partition_pairs, 0, pair_partition_count * sizeof(PartitionPairRange));
+}
+
+CollisionPairBuffer* get_collision_pair_buffer(int thread_index) {
+    return &pair_buffers[thread_index];
+}
+
+// Doubles the capacity, capped at the per-particle limit. Returns 0 when the
+// buffer is already at the limit.
+static int grow_collision_pair_buffer(CollisionPairBuffer* buffer, int needed) {
+    long limit = (long)COLLISION_PAIRS_PER_PARTICLE * get_particle_store()->count;
+    if (limit < COLLISION_PAIRS_INITIAL_CAPACITY)
+        limit = COLLISION_PAIRS_INITIAL_CAPACITY;
+    if (buffer->capacity >= limit)
+        return 0;
+
+    long capacity = buffer->capacity > 0 ? buffer->capacity : COLLISION_PAIRS_INITIAL_CAPACITY;
+    while (capacity < needed)
+        capacity *= 2;
+    if (capacity > limit)
+        capacity = limit;
+
+    CollisionPair* pairs = realloc(buffer->pairs, capacity * sizeof(CollisionPair));
+    if (pairs == NULL) {
+        fprintf(stderr, "error: realloc failed for collision pair buffer\n");
+        exit(1);
+    }
+    buffer->pairs = pairs;
+    buffer->capacity = (int)capacity;
+    buffer->growths++;
+    return 1;
 }
 
-void add_collision_pair(Particle* a, Particle* b) {
-    if (collision_pair_count < MAX_COLLISION_PAIRS) {
-        collision_pair_cache[collision_pair_count].a = a;
-        collision_pair_cache[collision_pair_count].b = b;
-        collision_pair_count++;
+void add_collision_pair(CollisionPairBuffer* buffer, int a, int b) {
+    if (buffer->count == buffer->capacity &&
+        !grow_collision_pair_buffer(buffer, buffer->count + 1)) {
+        buffer->dropped++;
+        return;
     }
+    buffer->pairs[buffer->count].a = a;
+    buffer->pairs[buffer->count].b = b;
+    buffer->count++;
+}
+
+void record_partition_pairs(int partition, int thread_index, int begin, int end) {
+    partition_pairs[partition].buffer = thread_index;
+    partition_pairs[partition].begin = begin;
+    partition_pairs[partition].end = end;
+}
+
+static void copy_partition_pairs_task(void* context, int thread_index, int begin, int end) {
+    const int* offsets = context;
+    (void)thread_index;
+
+    for (int p = begin; p < end; p++) {
+        PartitionPairRange* range = &partition_pairs[p];
+        int count = range->end - range->begin;
+        if (count > 0)
+            memcpy(merged_pairs.pairs + offsets[p], pair_buffers[range->buffer].pairs + range->begin,
+                   count * sizeof(CollisionPair));
+        range->buffer = -1;
+        range->begin = offsets[p];
+        range->end = offsets[p] + count;
+    }
+}
+
+static void reserve_merged_pairs(int total) {
+    if (total <= merged_pairs.capacity)
+        return;
+    long capacity = merged_pairs.capacity > 0 ? merged_pairs.capacity : COLLISION_PAIRS_INITIAL_CAPACITY;
+    while (capacity < total)
+        capacity *= 2;
+    CollisionPair* pairs = realloc(merged_pairs.pairs, capacity * sizeof(CollisionPair));
+    if (pairs == NULL) {
+        fprintf(stderr, "error: realloc failed for merged collision pairs\n");
+        exit(1);
+    }
+    merged_pairs.pairs = pairs;
+    merged_pairs.capacity = (int)capacity;
+    merged_pairs.growths++;
+
+    if (warm_start) {
+        float* correction = realloc(pair_correction, capacity * sizeof(float));
+        if (correction == NULL) {
+            fprintf(stderr, "error: realloc failed for contact corrections\n");
+            exit(1);
+        }
+        pair_correction = correction;
+    }
+}
+
+void enable_contact_warm_start(void) {
+    long capacity = merged_pairs.capacity > 0 ? merged_pairs.capacity : 1;
+    pair_correction = malloc(capacity * sizeof(float));
+    if (pair_correction == NULL) {
+        fprintf(stderr, "error: malloc failed for contact corrections\n");
+        exit(1);
+    }
+    warm_start = 1;
+}
+
+int contact_warm_start_enabled(void) {
+    return warm_start;
+}
+
+void merge_collision_pairs(void) {
+    TRACE_SCOPE("merge collision pairs");
+    // Only the partitions of the current grid hold ranges; a hashed grid uses
+    // fewer than the capacity
+    int partition_count = get_partition_count();
+    int total = 0;
+    for (int p = 0; p < partition_count; p++) {
+        partition_pair_offsets[p] = total;
+        total += partition_pairs[p].end - partition_pairs[p].begin;
+    }
+
+    reserve_merged_pairs(total);
+    thread_pool_parallel_for(partition_count, 64, copy_partition_pairs_task, partition_pair_offsets);
+    merged_pairs.count = total;
+
+    pair_stats.pairs = total;
+    if (total > pair_stats.peak_pairs)
+        pair_stats.peak_pairs = total;
+    pair_stats.dropped = 0;
+    pair_stats.growths = merged_pairs.growths;
+    pair_stats.reserved_bytes = merged_pairs.capacity * sizeof(CollisionPair);
+    for (int t = 0; t < pair_buffer_count; t++) {
+        pair_stats.dropped += pair_buffers[t].dropped;
+        pair_stats.growths += pair_buffers[t].growths;
+        pair_stats.reserved_bytes += pair_buffers[t].capacity * sizeof(CollisionPair);
+    }
+}
+
+const CollisionPairStats* get_collision_pair_stats(void) {
+    return &pair_stats;
+}
+
+static void remap_pair_buffer(CollisionPairBuffer* buffer, const int* new_index) {
+    int kept = 0;
+    for (int i = 0; i < buffer->count; i++) {
+        CollisionPair pair = buffer->pairs[i];
+        pair.a = new_index[pair.a];
+        pair.b = new_index[pair.b];
+        if (pair.a >= 0 && pair.b >= 0)
+            buffer->pairs[kept++] = pair;
+    }
+    buffer->count = kept;
+}
+
+void remap_collision_pairs(const int* new_index) {
+    for (int t = 0; t < pair_buffer_count; t++)
+        remap_pair_buffer(&pair_buffers[t], new_index);
+    remap_pair_buffer(&merged_pairs, new_index);
+}
+
+// Position correction (proportional to inverse mass). A sleeper holds still,
+// so the awake partner takes the whole correction.
+static void correction_ratios(const ParticleStore* store, int a, int b, float* a_ratio, float* b_ratio) {
+    if (particle_is_asleep(store, a)) {
+        *a_ratio = 0.0f;
+        *b_ratio = 1.0f;
+    } else if (particle_is_asleep(store, b)) {
+        *a_ratio = 1.0f;
+        *b_ratio = 0.0f;
+    } else {
+        float total_mass = store->mass[a] + store->mass[b];
+        *a_ratio = store->mass[b] / total_mass;
+        *b_ratio = store->mass[a] / total_mass;
+    }
+}
+
+// Correction a pair with the given overlap takes in a sweep. With warm
+// starting, the first sweep of a solve first repeats the pair's relaxed
+// correction from the last solve, at most the current overlap, and then
+// takes the usual fraction of what is left.
+static float sweep_correction(const ParticleStore* store, int a, int b, float penetration,
+                              int first_sweep) {
+    float warm = 0.0f;
+    if (warm_start && first_sweep) {
+        warm = CONTACT_WARM_START_FACTOR * contact_cache_lookup(&contacts, store->id[a], store->id[b]);
+        warm = fminf(warm, penetration);
+    }
+    return warm + (penetration - warm) * position_correction_fraction;
+}
+
+// One Gauss-Seidel sweep over pairs[begin, end). Returns the number of
+// corrections made and raises *max_penetration to the deepest overlap seen.
+// With warm starting, sums the correction of every pair over the solve.
+static int solve_pair_range(ParticleStore* store, const CollisionPair* pairs, int begin, int end,
+                            int first_sweep, float* max_penetration) {
+    float* px = store->position_x;
+    float* py = store->position_y;
+    int corrections_made = 0;
+
+    for (int i = begin; i < end; i++) {
+        int a = pairs[i].a;
+        int b = pairs[i].b;
+        if (warm_start && first_sweep)
+            pair_correction[i] = 0.0f;
+
+        // Quick squared distance check
+        float dx = px[b] - px[a];
+        float dy = py[b] - py[a];
+        float dist_sq = dx * dx + dy * dy;
+        float min_dist = store->radius[a] + store->radius[b];
+
+        if (dist_sq < min_dist * min_dist && dist_sq > 0.000001f) {
+            float dist = sqrtf(dist_sq);
+            float penetration = min_dist - dist;
+
+            if (penetration > *max_penetration) {
+                *max_penetration = penetration;
+            }
+
+            // Normal vector
+            float nx = dx / dist;
+            float ny = dy / dist;
+
+            float a_ratio;
+            float b_ratio;
+            correction_ratios(store, a, b, &a_ratio, &b_ratio);
+
+            float correction = sweep_correction(store, a, b, penetration, first_sweep);
+
+            px[a] -= nx * correction * a_ratio;
+            py[a] -= ny * correction * a_ratio;
+            px[b] += nx * correction * b_ratio;
+            py[b] += ny * correction * b_ratio;
+            if (warm_start)
+                pair_correction[i] += correction;
+
+            corrections_made++;
+        }
+    }
+
+    return corrections_made;
+}
+
+// Overlap left among the merged pairs the solver can separate, i.e. not
+// sitting on top of each other. With warm starting, the pairs still
+// overlapping replace the cached contacts along with their corrections, so
+// pairs that came apart are evicted.
+static void measure_residual_penetration(const ParticleStore* store) {
+    float deepest = 0.0f;
+    double sum = 0.0;
+    int overlapping = 0;
+    int above_tolerance = 0;
+
+    if (warm_start)
+        contact_cache_clear(&contacts, merged_pairs.count);
+
+    for (int i = 0; i < merged_pairs.count; i++) {
+        int a = merged_pairs.pairs[i].a;
+        int b = merged_pairs.pairs[i].b;
+        float dx = store->position_x[b] - store->position_x[a];
+        float dy = store->position_y[b] - store->position_y[a];
+        float dist_sq = dx * dx + dy * dy;
+        float min_dist = store->radius[a] + store->radius[b];
+        if (dist_sq >= min_dist * min_dist || dist_sq <= 0.000001f)
+            continue;
+        float penetration = min_dist - sqrtf(dist_sq);
+        deepest = fmaxf(deepest, penetration);
+        sum += penetration;
+        overlapping++;
+        above_tolerance += penetration >= min_penetration_threshold;
+        if (warm_start && pair_correction[i] > 0.0f)
+            contact_cache_insert(&contacts, store->id[a], store->id[b], pair_correction[i]);
+    }
+
+    solver_stats.residual = deepest;
+    solver_stats.mean_residual = overlapping > 0 ? (float)(sum / overlapping) : 0.0f;
+    solver_stats.above_tolerance = above_tolerance;
+    solver_stats.total_residual += deepest;
+    solver_stats.cached = contacts.count;
+}
+
+static void finish_overlap_solve(const ParticleStore* store, int iterations) {
+    solver_stats.iterations = iterations;
+    if (iterations > solver_stats.peak_iterations)
+        solver_stats.peak_iterations = iterations;
+    solver_stats.total_iterations += iterations;
+    solver_stats.solves++;
+    measure_residual_penetration(store);
 }
 
 // Cached version: uses pre-computed collision pairs instead of spatial queries
 void resolve_position_overlaps_cached(int max_iterations) {
-    if (collision_pair_count == 0) return;
-    
-    for (int iteration = 0; iteration < max_iterations; iteration++) {
+    ParticleStore* store = get_particle_store();
+    int iterations = 0;
+
+    while (merged_pairs.count > 0 && iterations < max_iterations) {
         float max_penetration = 0.0f;
         int corrections_made = 0;
-        
+        iterations++;
+
         // Use cached pairs - no spatial queries needed!
-        for (int i = 0; i < collision_pair_count; i++) {
-            Particle* a = collision_pair_cache[i].a;
-            Particle* b = collision_pair_cache[i].b;
-            
-            // Quick squared distance check
-            float dx = b->position[0] - a->position[0];
-            float dy = b->position[1] - a->position[1];
+        corrections_made += solve_pair_range(store, merged_pairs.pairs, 0, merged_pairs.count,
+                                             iterations == 1, &max_penetration);
+        
+        // Early termination if no significant overlaps remain
+        if (max_penetration < min_penetration_threshold || corrections_made == 0) {
+            break;
+        }
+    }
+
+    finish_overlap_solve(store, iterations);
+}
+
+typedef struct ColoredSolveContext {
+    ParticleStore* store;
+    const int* partitions;
+    int first_sweep;
+    float thread_max_penetration[THREAD_POOL_MAX_THREADS];
+    int thread_corrections[THREAD_POOL_MAX_THREADS];
+} ColoredSolveContext;
+
+static void solve_colored_partitions(void* context, int thread_index, int begin, int end) {
+    ColoredSolveContext* ctx = context;
+    for (int k = begin; k < end; k++) {
+        const PartitionPairRange* range = &partition_pairs[ctx->partitions[k]];
+        if (range->begin == range->end)
+            continue;
+        ctx->thread_corrections[thread_index] +=
+            solve_pair_range(ctx->store, merged_pairs.pairs, range->begin, range->end, ctx->first_sweep,
+                             &ctx->thread_max_penetration[thread_index]);
+    }
+}
+
+void resolve_position_overlaps_colored(int max_iterations) {
+    ColoredSolveContext ctx;
+    ctx.store = get_particle_store();
+    int threads = thread_pool_size();
+    int iterations = 0;
+
+    while (iterations < max_iterations) {
+        for (int t = 0; t < threads; t++) {
+            ctx.thread_max_penetration[t] = 0.0f;
+            ctx.thread_corrections[t] = 0;
+        }
+        iterations++;
+        ctx.first_sweep = iterations == 1;
+
+        for (int color = 0; color < get_grid_color_count(); color++) {
+            int partition_count;
+            ctx.partitions = get_partitions_of_color(color, &partition_count);
+            thread_pool_parallel_for_traced("solve partitions", partition_count, 4, solve_colored_partitions, &ctx);
+        }
+
+        float max_penetration = 0.0f;
+        int corrections_made = 0;
+        for (int t = 0; t < threads; t++) {
+            if (ctx.thread_max_penetration[t] > max_penetration)
+                max_penetration = ctx.thread_max_penetration[t];
+            corrections_made += ctx.thread_corrections[t];
+        }
+
+        // Early termination if no significant overlaps remain
+        if (max_penetration < min_penetration_threshold || corrections_made == 0) {
+            break;
+        }
+    }
+
+    finish_overlap_solve(ctx.store, iterations);
+}
+
+const char* overlap_solver_name(OverlapSolver solver) {
+    switch (solver) {
+        case OVERLAP_SOLVER_SEQUENTIAL: return "sequential";
+        case OVERLAP_SOLVER_PARTITIONS: return "partitions";
+        case OVERLAP_SOLVER_GRAPH: return "graph";
+        case OVERLAP_SOLVER_JACOBI: return "jacobi";
+        default: return "auto";
+    }
+}
+
+static void reserve_solver_scratch(const ParticleStore* store, int pair_count) {
+    if (solver_particle_capacity < store->capacity) {
+        int capacity = store->capacity;
+        particle_pair_colors = realloc(particle_pair_colors, capacity * sizeof(uint32_t));
+        particle_pair_offsets = realloc(particle_pair_offsets, (capacity + 1) * sizeof(int));
+        delta_x = realloc(delta_x, capacity * sizeof(float));
+        delta_y = realloc(delta_y, capacity * sizeof(float));
+        if (particle_pair_colors == NULL || particle_pair_offsets == NULL || delta_x == NULL ||
+            delta_y == NULL) {
+            fprintf(stderr, "error: realloc failed for overlap solver\n");
+            exit(1);
+        }
+        solver_particle_capacity = capacity;
+    }
+
+    if (pair_count <= pair_scratch_capacity)
+        return;
+    int capacity = pair_scratch_capacity > 0 ? pair_scratch_capacity : COLLISION_PAIRS_INITIAL_CAPACITY;
+    while (capacity < pair_count)
+        capacity *= 2;
+    pair_scratch = realloc(pair_scratch, capacity * sizeof(CollisionPair));
+    pair_color = realloc(pair_color, capacity * sizeof(unsigned char));
+    particle_pairs = realloc(particle_pairs, 2 * (size_t)capacity * sizeof(int));
+    if (pair_scratch == NULL || pair_color == NULL || particle_pairs == NULL) {
+        fprintf(stderr, "error: realloc failed for overlap solver\n");
+        exit(1);
+    }
+    pair_scratch_capacity = capacity;
+}
+
+// Greedy pair coloring, then a counting sort of the merged pairs by color.
+// The merge order decides the coloring, so it is the same for every thread
+// count. Returns the number of colors used.
+static int color_merged_pairs(const ParticleStore* store) {
+    TRACE_SCOPE("color pairs");
+    int count = merged_pairs.count;
+    int color_count[PAIR_COLOR_LIMIT + 1];
+    memset(color_count, 0, sizeof(color_count));
+    memset(particle_pair_colors, 0, store->count * sizeof(uint32_t));
+
+    for (int i = 0; i < count; i++) {
+        int a = merged_pairs.pairs[i].a;
+        int b = merged_pairs.pairs[i].b;
+        uint32_t free_colors = ~(particle_pair_colors[a] | particle_pair_colors[b]);
+        int color = PAIR_COLOR_LIMIT;
+        if (free_colors != 0) {
+            color = __builtin_ctz(free_colors);
+            particle_pair_colors[a] |= 1u << color;
+            particle_pair_colors[b] |= 1u << color;
+        }
+        pair_color[i] = (unsigned char)color;
+        color_count[color]++;
+    }
+
+    int total = 0;
+    int colors = 0;
+    for (int c = 0; c <= PAIR_COLOR_LIMIT; c++) {
+        color_start[c] = total;
+        total += color_count[c];
+        if (c < PAIR_COLOR_LIMIT && color_count[c] > 0)
+            colors = c + 1;
+    }
+    color_start[PAIR_COLOR_LIMIT + 1] = total;
+
+    int cursor[PAIR_COLOR_LIMIT + 1];
+    memcpy(cursor, color_start, sizeof(cursor));
+    for (int i = 0; i < count; i++) {
+        int slot = cursor[pair_color[i]]++;
+        pair_scratch[slot] = merged_pairs.pairs[i];
+    }
+    memcpy(merged_pairs.pairs, pair_scratch, count * sizeof(CollisionPair));
+
+    solver_stats.pair_colors = colors;
+    solver_stats.overflow_pairs = color_count[PAIR_COLOR_LIMIT];
+    return colors;
+}
+
+typedef struct PairSolveContext {
+    ParticleStore* store;
+    int begin;              // First pair of the batch
+    int first_sweep;
+    float thread_max_penetration[THREAD_POOL_MAX_THREADS];
+    int thread_corrections[THREAD_POOL_MAX_THREADS];
+} PairSolveContext;
+
+static void solve_pair_batch_task(void* context, int thread_index, int begin, int end) {
+    PairSolveContext* ctx = context;
+    ctx->thread_corrections[thread_index] +=
+        solve_pair_range(ctx->store, merged_pairs.pairs, ctx->begin + begin, ctx->begin + end,
+                         ctx->first_sweep, &ctx->thread_max_penetration[thread_index]);
+}
+
+void resolve_position_overlaps_graph(int max_iterations) {
+    PairSolveContext ctx;
+    ctx.store = get_particle_store();
+    int threads = thread_pool_size();
+    int iterations = 0;
+
+    reserve_solver_scratch(ctx.store, merged_pairs.count);
+    int colors = color_merged_pairs(ctx.store);
+
+    while (merged_pairs.count > 0 && iterations < max_iterations) {
+        for (int t = 0; t < threads; t++) {
+            ctx.thread_max_penetration[t] = 0.0f;
+            ctx.thread_corrections[t] = 0;
+        }
+        iterations++;
+        ctx.first_sweep = iterations == 1;
+
+        // Pairs of one color share no particle, so each color is a race-free
+        // parallel batch
+        for (int color = 0; color < colors; color++) {
+            ctx.begin = color_start[color];
+            thread_pool_parallel_for_traced("solve pairs", color_start[color + 1] - ctx.begin, 256,
+                                            solve_pair_batch_task, &ctx);
+        }
+        ctx.thread_corrections[0] +=
+            solve_pair_range(ctx.store, merged_pairs.pairs, color_start[PAIR_COLOR_LIMIT],
+                             merged_pairs.count, ctx.first_sweep, &ctx.thread_max_penetration[0]);
+
+        float max_penetration = 0.0f;
+        int corrections_made = 0;
+        for (int t = 0; t < threads; t++) {
+            if (ctx.thread_max_penetration[t] > max_penetration)
+                max_penetration = ctx.thread_max_penetration[t];
+            corrections_made += ctx.thread_corrections[t];
+        }
+
+        // Early termination if no significant overlaps remain
+        if (max_penetration < min_penetration_threshold || corrections_made == 0) {
+            break;
+        }
+    }
+
+    finish_overlap_solve(ctx.store, iterations);
+}
+
+// Lists the pairs of every particle, CSR style, in merge order
+static void build_particle_pairs(const ParticleStore* store) {
+    TRACE_SCOPE("list particle pairs");
+    int count = merged_pairs.count;
+    memset(particle_pair_offsets, 0, (store->count + 1) * sizeof(int));
+    for (int i = 0; i < count; i++) {
+        particle_pair_offsets[merged_pairs.pairs[i].a + 1]++;
+        particle_pair_offsets[merged_pairs.pairs[i].b + 1]++;
+    }
+    for (int p = 0; p < store->count; p++)
+        particle_pair_offsets[p + 1] += particle_pair_offsets[p];
+    // Filled with the offsets of the next particle as cursors, which end up
+    // where they started
+    for (int i = 0; i < count; i++) {
+        particle_pairs[particle_pair_offsets[merged_pairs.pairs[i].a]++] = i;
+        particle_pairs[particle_pair_offsets[merged_pairs.pairs[i].b]++] = i;
+    }
+    for (int p = store->count; p > 0; p--)
+        particle_pair_offsets[p] = particle_pair_offsets[p - 1];
+    particle_pair_offsets[0] = 0;
+}
+
+typedef struct JacobiContext {
+    ParticleStore* store;
+    int first_sweep;
+    float thread_max_penetration[THREAD_POOL_MAX_THREADS];
+    int thread_corrections[THREAD_POOL_MAX_THREADS];
+} JacobiContext;
+
+// Every pair is evaluated by both its particles from the same positions, so
+// they agree on it; particle a alone counts it and sums its correction.
+static void gather_corrections_task(void* context, int thread_index, int begin, int end) {
+    JacobiContext* ctx = context;
+    const ParticleStore* store = ctx->store;
+    const float* px = store->position_x;
+    const float* py = store->position_y;
+    float max_penetration = ctx->thread_max_penetration[thread_index];
+    int corrections_made = 0;
+
+    for (int p = begin; p < end; p++) {
+        float sum_x = 0.0f;
+        float sum_y = 0.0f;
+        int first = particle_pair_offsets[p];
+        int last = particle_pair_offsets[p + 1];
+
+        for (int k = first; k < last; k++) {
+            int i = particle_pairs[k];
+            int a = merged_pairs.pairs[i].a;
+            int b = merged_pairs.pairs[i].b;
+            float dx = px[b] - px[a];
+            float dy = py[b] - py[a];
             float dist_sq = dx * dx + dy * dy;
-            float min_dist = a->radius + b->radius;
-            
-            if (dist_sq < min_dist * min_dist && dist_sq > 0.000001f) {
-                float dist = sqrtf(dist_sq);
-                float penetration = min_dist - dist;
-                
-                if (penetration > max_penetration) {
-                    max_penetration = penetration;
-                }
-                
-                // Normal vector
-                float nx = dx / dist;
-                float ny = dy / dist;
-                
-                // Position correction (proportional to inverse mass)
-                float total_mass = a->mass + b->mass;
-                float a_ratio = b->mass / total_mass;
-                float b_ratio = a->mass / total_mass;
-                
-                float correction = penetration * position_correction_fraction;
-                
-                a->position[0] -= nx * correction * a_ratio;
-                a->position[1] -= ny * correction * a_ratio;
-                b->position[0] += nx * correction * b_ratio;
-                b->position[1] += ny * correction * b_ratio;
-                
+            float min_dist = store->radius[a] + store->radius[b];
+            if (dist_sq >= min_dist * min_dist || dist_sq <= 0.000001f)
+                continue;
+
+            float dist = sqrtf(dist_sq);
+            float penetration = min_dist - dist;
+            float a_ratio;
+            float b_ratio;
+            correction_ratios(store, a, b, &a_ratio, &b_ratio);
+            float correction = sweep_correction(store, a, b, penetration, ctx->first_sweep);
+
+            float push = correction / dist;
+            if (p == a) {
+                sum_x -= dx * push * a_ratio;
+                sum_y -= dy * push * a_ratio;
+                max_penetration = fmaxf(max_penetration, penetration);
                 corrections_made++;
+                if (warm_start)
+                    pair_correction[i] += correction;
+            } else {
+                sum_x += dx * push * b_ratio;
+                sum_y += dy * push * b_ratio;
             }
         }
-        
+
+        delta_x[p] = sum_x;
+        delta_y[p] = sum_y;
+    }
+
+    ctx->thread_max_penetration[thread_index] = max_penetration;
+    ctx->thread_corrections[thread_index] += corrections_made;
+}
+
+static void apply_corrections_task(void* context, int thread_index, int begin, int end) {
+    (void)thread_index;
+    JacobiContext* ctx = context;
+    float* restrict px = ctx->store->position_x;
+    float* restrict py = ctx->store->position_y;
+    const float* restrict cx = delta_x;
+    const float* restrict cy = delta_y;
+    for (int p = begin; p < end; p++) {
+        px[p] += cx[p];
+        py[p] += cy[p];
+    }
+}
+
+void resolve_position_overlaps_jacobi(int max_iterations) {
+    JacobiContext ctx;
+    ctx.store = get_particle_store();
+    int threads = thread_pool_size();
+    int iterations = 0;
+
+    reserve_solver_scratch(ctx.store, merged_pairs.count);
+    if (merged_pairs.count > 0)
+        build_particle_pairs(ctx.store);
+
+    while (merged_pairs.count > 0 && iterations < max_iterations) {
+        for (int t = 0; t < threads; t++) {
+            ctx.thread_max_penetration[t] = 0.0f;
+            ctx.thread_corrections[t] = 0;
+        }
+        iterations++;
+        ctx.first_sweep = iterations == 1;
+        if (warm_start && ctx.first_sweep)
+            memset(pair_correction, 0, merged_pairs.count * sizeof(float));
+
+        thread_pool_parallel_for_traced("gather corrections", ctx.store->count, 1024, gather_corrections_task, &ctx);
+        thread_pool_parallel_for(ctx.store->count, 4096, apply_corrections_task, &ctx);
+
+        float max_penetration = 0.0f;
+        int corrections_made = 0;
+        for (int t = 0; t < threads; t++) {
+            if (ctx.thread_max_penetration[t] > max_penetration)
+                max_penetration = ctx.thread_max_penetration[t];
+            corrections_made += ctx.thread_corrections[t];
+        }
+
         // Early termination if no significant overlaps remain
         if (max_penetration < min_penetration_threshold || corrections_made == 0) {
             break;
         }
     }
+
+    finish_overlap_solve(ctx.store, iterations);
 }
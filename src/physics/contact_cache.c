@@ -0,0 +1,77 @@
+#include "physics/contact_cache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CONTACT_CACHE_INITIAL_CAPACITY 8192
+
+static uint64_t contact_key(int id_a, int id_b) {
+    uint32_t low = (uint32_t)(id_a < id_b ? id_a : id_b);
+    uint32_t high = (uint32_t)(id_a < id_b ? id_b : id_a);
+    return (uint64_t)low << 32 | high;
+}
+
+// Fibonacci hashing of the packed key into the table's index bits
+static int contact_slot(const ContactCache* cache, uint64_t key) {
+    return (int)((key * 0x9E3779B97F4A7C15ull) >> 32 & (uint64_t)(cache->capacity - 1));
+}
+
+void contact_cache_free(ContactCache* cache) {
+    free(cache->keys);
+    free(cache->correction);
+    free(cache->generation);
+    memset(cache, 0, sizeof(*cache));
+}
+
+void contact_cache_clear(ContactCache* cache, int contacts) {
+    cache->count = 0;
+    cache->current++;
+    if (2 * contacts <= cache->capacity && cache->current != 0)
+        return;
+
+    int capacity = cache->capacity > 0 ? cache->capacity : CONTACT_CACHE_INITIAL_CAPACITY;
+    while (capacity < 2 * contacts)
+        capacity *= 2;
+    free(cache->keys);
+    free(cache->correction);
+    free(cache->generation);
+    cache->keys = malloc(capacity * sizeof(uint64_t));
+    cache->correction = malloc(capacity * sizeof(float));
+    // Generation 0 is never current, so a zeroed table is empty
+    cache->generation = calloc(capacity, sizeof(uint32_t));
+    if (cache->keys == NULL || cache->correction == NULL || cache->generation == NULL) {
+        fprintf(stderr, "error: malloc failed for contact cache\n");
+        exit(1);
+    }
+    cache->capacity = capacity;
+    cache->current = 1;
+}
+
+void contact_cache_insert(ContactCache* cache, int id_a, int id_b, float correction) {
+    uint64_t key = contact_key(id_a, id_b);
+    int slot = contact_slot(cache, key);
+    while (cache->generation[slot] == cache->current) {
+        if (cache->keys[slot] == key) {
+            cache->correction[slot] = correction;
+            return;
+        }
+        slot = (slot + 1) & (cache->capacity - 1);
+    }
+    cache->keys[slot] = key;
+    cache->correction[slot] = correction;
+    cache->generation[slot] = cache->current;
+    cache->count++;
+}
+
+float contact_cache_lookup(const ContactCache* cache, int id_a, int id_b) {
+    if (cache->capacity == 0)
+        return 0.0f;
+    uint64_t key = contact_key(id_a, id_b);
+    int slot = contact_slot(cache, key);
+    while (cache->generation[slot] == cache->current) {
+        if (cache->keys[slot] == key)
+            return cache->correction[slot];
+        slot = (slot + 1) & (cache->capacity - 1);
+    }
+    return 0.0f;
+}
@@ -0,0 +1,503 @@
+#include "physics/electrostatics.h"
+#include "physics/forces.h"
+#include "core/arena.h"
+#include "core/math_utils.h"
+#include "core/particle_store.h"
+#include "core/thread_pool.h"
+#include <float.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PARTICLE_GRAIN 1024
+#define FORCE_GRAIN 256
+#define MAX_SUBTREES (1 << (2 * ELECTROSTATICS_SPLIT_LEVEL))
+// Every opened node pushes at most four children per level
+#define TRAVERSAL_STACK (4 * (ELECTROSTATICS_MAX_LEVEL + 1))
+
+// A square of the tree over sorted[begin, end). Children are stored
+// contiguously from first_child.
+typedef struct QuadNode {
+    float center_x;         // |q|-weighted center of the charges
+    float center_y;
+    float charge;
+    float abs_charge;
+    float size;
+    int begin;
+    int end;
+    int first_child;
+    int child_count;
+    int level;
+} QuadNode;
+
+static int electrostatics_active = 0;
+static float coulomb_constant = 0.0f;
+static float opening_theta_sq = 0.0f;
+static float opening_theta = 0.0f;
+static float softening_sq = 0.0f;
+static ElectrostaticsStats electrostatics_stats;
+
+// Morton order of the particles, rebuilt every step
+static uint32_t* codes = NULL;
+static uint32_t* codes_scratch = NULL;
+static int* order = NULL;
+static int* order_scratch = NULL;
+static float* sorted_x = NULL;
+static float* sorted_y = NULL;
+static float* sorted_q = NULL;
+static float root_x = 0.0f;
+static float root_y = 0.0f;
+static float root_size = 0.0f;
+
+// Grows with the particle count, so it lives on the heap
+static QuadNode* nodes = NULL;
+static int node_count = 0;
+static int node_capacity = 0;
+
+// Nodes at the split level that still need their subtree
+static int subtree_roots[MAX_SUBTREES];
+static int subtree_offsets[MAX_SUBTREES];
+static int subtree_sizes[MAX_SUBTREES];
+static int subtree_count = 0;
+
+typedef struct BoundsContext {
+    const ParticleStore* store;
+    float thread_min_x[THREAD_POOL_MAX_THREADS];
+    float thread_min_y[THREAD_POOL_MAX_THREADS];
+    float thread_max_x[THREAD_POOL_MAX_THREADS];
+    float thread_max_y[THREAD_POOL_MAX_THREADS];
+    float thread_max_radius[THREAD_POOL_MAX_THREADS];
+} BoundsContext;
+
+typedef struct ForceContext {
+    ParticleStore* store;
+    long thread_interactions[THREAD_POOL_MAX_THREADS];
+} ForceContext;
+
+int electrostatics_enabled(void) {
+    return electrostatics_active;
+}
+
+float electrostatics_theta(void) {
+    return opening_theta;
+}
+
+void electrostatics_init(float constant, float theta) {
+    electrostatics_active = constant > 0;
+    memset(&electrostatics_stats, 0, sizeof(electrostatics_stats));
+    if (!electrostatics_active)
+        return;
+
+    coulomb_constant = constant;
+    opening_theta = theta;
+    opening_theta_sq = theta * theta;
+
+    ParticleStore* store = get_particle_store();
+    Arena* arena = get_simulation_arena();
+    codes = arena_alloc(arena, store->capacity * sizeof(uint32_t));
+    codes_scratch = arena_alloc(arena, store->capacity * sizeof(uint32_t));
+    order = arena_alloc(arena, store->capacity * sizeof(int));
+    order_scratch = arena_alloc(arena, store->capacity * sizeof(int));
+    sorted_x = arena_alloc(arena, store->capacity * sizeof(float));
+    sorted_y = arena_alloc(arena, store->capacity * sizeof(float));
+    sorted_q = arena_alloc(arena, store->capacity * sizeof(float));
+}
+
+// Per-particle arrays belong to the simulation arena
+void electrostatics_cleanup(void) {
+    free(nodes);
+    nodes = NULL;
+    node_count = 0;
+    node_capacity = 0;
+    codes = NULL;
+    codes_scratch = NULL;
+    order = NULL;
+    order_scratch = NULL;
+    sorted_x = NULL;
+    sorted_y = NULL;
+    sorted_q = NULL;
+    electrostatics_active = 0;
+}
+
+static void reserve_nodes(int needed) {
+    if (needed <= node_capacity)
+        return;
+    int grown = node_capacity > 0 ? node_capacity : 1024;
+    while (grown < needed)
+        grown *= 2;
+    QuadNode* resized = realloc(nodes, grown * sizeof(QuadNode));
+    if (resized == NULL) {
+        fprintf(stderr, "error: realloc failed for charge tree nodes\n");
+        exit(1);
+    }
+    nodes = resized;
+    node_capacity = grown;
+}
+
+static void bounds_task(void* context, int thread_index, int begin, int end) {
+    BoundsContext* ctx = context;
+    const ParticleStore* store = ctx->store;
+    float min_x = ctx->thread_min_x[thread_index];
+    float min_y = ctx->thread_min_y[thread_index];
+    float max_x = ctx->thread_max_x[thread_index];
+    float max_y = ctx->thread_max_y[thread_index];
+    float max_radius = ctx->thread_max_radius[thread_index];
+
+    for (int i = begin; i < end; i++) {
+        min_x = fminf(min_x, store->position_x[i]);
+        min_y = fminf(min_y, store->position_y[i]);
+        max_x = fmaxf(max_x, store->position_x[i]);
+        max_y = fmaxf(max_y, store->position_y[i]);
+        max_radius = fmaxf(max_radius, store->radius[i]);
+    }
+
+    ctx->thread_min_x[thread_index] = min_x;
+    ctx->thread_min_y[thread_index] = min_y;
+    ctx->thread_max_x[thread_index] = max_x;
+    ctx->thread_max_y[thread_index] = max_y;
+    ctx->thread_max_radius[thread_index] = max_radius;
+}
+
+// Bounding square of all particles, and the softening from the largest radius
+static void compute_bounds(const ParticleStore* store) {
+    BoundsContext ctx;
+    ctx.store = store;
+    for (int t = 0; t < THREAD_POOL_MAX_THREADS; t++) {
+        ctx.thread_min_x[t] = FLT_MAX;
+        ctx.thread_min_y[t] = FLT_MAX;
+        ctx.thread_max_x[t] = -FLT_MAX;
+        ctx.thread_max_y[t] = -FLT_MAX;
+        ctx.thread_max_radius[t] = 0.0f;
+    }
+    thread_pool_parallel_for(store->count, PARTICLE_GRAIN, bounds_task, &ctx);
+
+    float min_x = FLT_MAX, min_y = FLT_MAX, max_x = -FLT_MAX, max_y = -FLT_MAX, max_radius = 0.0f;
+    for (int t = 0; t < thread_pool_size(); t++) {
+        min_x = fminf(min_x, ctx.thread_min_x[t]);
+        min_y = fminf(min_y, ctx.thread_min_y[t]);
+        max_x = fmaxf(max_x, ctx.thread_max_x[t]);
+        max_y = fmaxf(max_y, ctx.thread_max_y[t]);
+        max_radius = fmaxf(max_radius, ctx.thread_max_radius[t]);
+    }
+
+    root_x = min_x;
+    root_y = min_y;
+    root_size = fmaxf(fmaxf(max_x - min_x, max_y - min_y), FLT_MIN);
+    softening_sq = max_radius * max_radius;
+}
+
+static void encode_task(void* context, int thread_index, int begin, int end) {
+    const ParticleStore* store = context;
+    (void)thread_index;
+    // Just below 2^16, so the far edge still maps into 16 bits
+    float scale = 65535.0f / root_size;
+
+    for (int i = begin; i < end; i++) {
+        uint32_t qx = (uint32_t)fminf((store->position_x[i] - root_x) * scale, 65535.0f);
+        uint32_t qy = (uint32_t)fminf((store->position_y[i] - root_y) * scale, 65535.0f);
+        codes[i] = morton_encode(qx, qy);
+        order[i] = i;
+    }
+}
+
+// Four stable counting-sort passes over the code bytes
+static void radix_sort_codes(int count) {
+    uint32_t* keys = codes;
+    uint32_t* keys_out = codes_scratch;
+    int* values = order;
+    int* values_out = order_scratch;
+
+    for (int shift = 0; shift < 32; shift += 8) {
+        int offsets[256] = { 0 };
+        for (int i = 0; i < count; i++)
+            offsets[(keys[i] >> shift) & 0xff]++;
+        int sum = 0;
+        for (int b = 0; b < 256; b++) {
+            int c = offsets[b];
+            offsets[b] = sum;
+            sum += c;
+        }
+        for (int i = 0; i < count; i++) {
+            int slot = offsets[(keys[i] >> shift) & 0xff]++;
+            keys_out[slot] = keys[i];
+            values_out[slot] = values[i];
+        }
+        uint32_t* swap_keys = keys;
+        keys = keys_out;
+        keys_out = swap_keys;
+        int* swap_values = values;
+        values = values_out;
+        values_out = swap_values;
+    }
+    // An even number of passes leaves the result in codes and order
+}
+
+static void gather_task(void* context, int thread_index, int begin, int end) {
+    const ParticleStore* store = context;
+    (void)thread_index;
+    for (int k = begin; k < end; k++) {
+        int i = order[k];
+        sorted_x[k] = store->position_x[i];
+        sorted_y[k] = store->position_y[i];
+        sorted_q[k] = store->charge[i];
+    }
+}
+
+static int is_leaf(int begin, int end, int level) {
+    return end - begin <= ELECTROSTATICS_LEAF_SIZE || level >= ELECTROSTATICS_MAX_LEVEL;
+}
+
+// Splits sorted[begin, end) of a node at the given level into its non-empty
+// quadrants, which are contiguous runs of the Morton order
+static int split_range(int begin, int end, int level, int* child_begin, int* child_end) {
+    int shift = 30 - 2 * level;
+    int count = 0;
+    int k = begin;
+    while (k < end) {
+        uint32_t quadrant = (codes[k] >> shift) & 3;
+        child_begin[count] = k;
+        while (k < end && ((codes[k] >> shift) & 3) == quadrant)
+            k++;
+        child_end[count] = k;
+        count++;
+    }
+    return count;
+}
+
+static void init_node(QuadNode* node, int begin, int end, int level) {
+    node->begin = begin;
+    node->end = end;
+    node->level = level;
+    node->size = root_size / (float)(1 << level);
+    node->first_child = -1;
+    node->child_count = 0;
+}
+
+static void compute_leaf_moments(QuadNode* node) {
+    float charge = 0.0f, abs_charge = 0.0f, sum_x = 0.0f, sum_y = 0.0f;
+    for (int k = node->begin; k < node->end; k++) {
+        float weight = fabsf(sorted_q[k]);
+        charge += sorted_q[k];
+        abs_charge += weight;
+        sum_x += weight * sorted_x[k];
+        sum_y += weight * sorted_y[k];
+    }
+    node->charge = charge;
+    node->abs_charge = abs_charge;
+    // Uncharged nodes contribute nothing; any point inside will do
+    node->center_x = abs_charge > 0 ? sum_x / abs_charge : sorted_x[node->begin];
+    node->center_y = abs_charge > 0 ? sum_y / abs_charge : sorted_y[node->begin];
+}
+
+static void compute_internal_moments(QuadNode* node) {
+    float charge = 0.0f, abs_charge = 0.0f, sum_x = 0.0f, sum_y = 0.0f;
+    for (int c = node->first_child; c < node->first_child + node->child_count; c++) {
+        const QuadNode* child = &nodes[c];
+        charge += child->charge;
+        abs_charge += child->abs_charge;
+        sum_x += child->abs_charge * child->center_x;
+        sum_y += child->abs_charge * child->center_y;
+    }
+    node->charge = charge;
+    node->abs_charge = abs_charge;
+    node->center_x = abs_charge > 0 ? sum_x / abs_charge : nodes[node->first_child].center_x;
+    node->center_y = abs_charge > 0 ? sum_y / abs_charge : nodes[node->first_child].center_y;
+}
+
+// Nodes below one over sorted[begin, end), not counting the node itself
+static int count_descendants(int begin, int end, int level) {
+    if (is_leaf(begin, end, level))
+        return 0;
+    int child_begin[4], child_end[4];
+    int children = split_range(begin, end, level, child_begin, child_end);
+    int count = children;
+    for (int c = 0; c < children; c++)
+        count += count_descendants(child_begin[c], child_end[c], level + 1);
+    return count;
+}
+
+// Builds the subtree below an already placed node, appending nodes at
+// *cursor, and fills in the moments bottom-up. Never grows the node array.
+static void build_subtree(int index, int* cursor) {
+    QuadNode* node = &nodes[index];
+    if (is_leaf(node->begin, node->end, node->level)) {
+        compute_leaf_moments(node);
+        return;
+    }
+
+    int child_begin[4], child_end[4];
+    int children = split_range(node->begin, node->end, node->level, child_begin, child_end);
+    node->first_child = *cursor;
+    node->child_count = children;
+    *cursor += children;
+    for (int c = 0; c < children; c++)
+        init_node(&nodes[node->first_child + c], child_begin[c], child_end[c], node->level + 1);
+    for (int c = 0; c < children; c++)
+        build_subtree(node->first_child + c, cursor);
+    compute_internal_moments(node);
+}
+
+// Lays out the levels above the split serially; moments come later
+static void build_top(int index) {
+    QuadNode* node = &nodes[index];
+    if (is_leaf(node->begin, node->end, node->level))
+        return;
+    if (node->level == ELECTROSTATICS_SPLIT_LEVEL) {
+        subtree_roots[subtree_count++] = index;
+        return;
+    }
+
+    int child_begin[4], child_end[4];
+    int children = split_range(node->begin, node->end, node->level, child_begin, child_end);
+    int level = node->level;
+    reserve_nodes(node_count + children);
+    // The reserve may have moved the array
+    node = &nodes[index];
+    node->first_child = node_count;
+    node->child_count = children;
+    node_count += children;
+    for (int c = 0; c < children; c++)
+        init_node(&nodes[node->first_child + c], child_begin[c], child_end[c], level + 1);
+    int first_child = node->first_child;
+    for (int c = 0; c < children; c++)
+        build_top(first_child + c);
+}
+
+static void count_subtrees_task(void* context, int thread_index, int begin, int end) {
+    (void)context;
+    (void)thread_index;
+    for (int s = begin; s < end; s++) {
+        const QuadNode* root = &nodes[subtree_roots[s]];
+        subtree_sizes[s] = count_descendants(root->begin, root->end, root->level);
+    }
+}
+
+static void build_subtrees_task(void* context, int thread_index, int begin, int end) {
+    (void)context;
+    (void)thread_index;
+    for (int s = begin; s < end; s++) {
+        int cursor = subtree_offsets[s];
+        build_subtree(subtree_roots[s], &cursor);
+    }
+}
+
+void electrostatics_build_tree(void) {
+    ParticleStore* store = get_particle_store();
+    int count = store->count;
+    node_count = 0;
+    subtree_count = 0;
+    if (count == 0)
+        return;
+
+    compute_bounds(store);
+    thread_pool_parallel_for(count, PARTICLE_GRAIN, encode_task, store);
+    radix_sort_codes(count);
+    thread_pool_parallel_for(count, PARTICLE_GRAIN, gather_task, store);
+
+    reserve_nodes(1);
+    init_node(&nodes[0], 0, count, 0);
+    node_count = 1;
+    build_top(0);
+    int top_count = node_count;
+
+    // Each subtree gets its own slice of the node array, sized by a counting
+    // pass, so the builds run in parallel without sharing a cursor
+    thread_pool_parallel_for(subtree_count, 1, count_subtrees_task, NULL);
+    for (int s = 0; s < subtree_count; s++) {
+        subtree_offsets[s] = node_count;
+        node_count += subtree_sizes[s];
+    }
+    reserve_nodes(node_count);
+    thread_pool_parallel_for_traced("build charge subtrees", subtree_count, 1, build_subtrees_task, NULL);
+
+    // Children follow their parent, so a reverse walk sees them finished.
+    // Subtree roots already have their moments.
+    for (int n = top_count - 1; n >= 0; n--) {
+        QuadNode* node = &nodes[n];
+        if (node->child_count == 0)
+            compute_leaf_moments(node);
+        else if (node->level < ELECTROSTATICS_SPLIT_LEVEL)
+            compute_internal_moments(node);
+    }
+
+    int leaves = 0;
+    for (int n = 0; n < node_count; n++)
+        leaves += nodes[n].child_count == 0;
+    electrostatics_stats.nodes = node_count;
+    electrostatics_stats.leaves = leaves;
+    electrostatics_stats.subtrees = subtree_count;
+}
+
+static void force_task(void* context, int thread_index, int begin, int end) {
+    ForceContext* ctx = context;
+    ParticleStore* store = ctx->store;
+    long interactions = 0;
+    int stack[TRAVERSAL_STACK];
+
+    for (int k = begin; k < end; k++) {
+        float xi = sorted_x[k];
+        float yi = sorted_y[k];
+        // Sum of Q r / (r^2 + eps^2)^1.5, scaled by k q_i / m_i at the end
+        float fx = 0.0f;
+        float fy = 0.0f;
+        int top = 0;
+        stack[top++] = 0;
+
+        while (top > 0) {
+            const QuadNode* node = &nodes[stack[--top]];
+            float dx = xi - node->center_x;
+            float dy = yi - node->center_y;
+            float r_sq = dx * dx + dy * dy;
+            int contains = k >= node->begin && k < node->end;
+
+            if (!contains && node->size * node->size < opening_theta_sq * r_sq) {
+                float inv = 1.0f / sqrtf(r_sq + softening_sq);
+                float scale = node->charge * inv * inv * inv;
+                fx += scale * dx;
+                fy += scale * dy;
+                interactions++;
+            } else if (node->child_count == 0) {
+                // The particle itself is at distance 0 and adds nothing
+                for (int m = node->begin; m < node->end; m++) {
+                    float px = xi - sorted_x[m];
+                    float py = yi - sorted_y[m];
+                    float inv = 1.0f / sqrtf(px * px + py * py + softening_sq);
+                    float scale = sorted_q[m] * inv * inv * inv;
+                    fx += scale * px;
+                    fy += scale * py;
+                }
+                interactions += node->end - node->begin;
+            } else {
+                for (int c = 0; c < node->child_count; c++)
+                    stack[top++] = node->first_child + c;
+            }
+        }
+
+        int i = order[k];
+        float factor = coulomb_constant * sorted_q[k] / store->mass[i];
+        apply_gravity(store, i);
+        store->acceleration_x[i] += factor * fx;
+        store->acceleration_y[i] += factor * fy;
+    }
+
+    ctx->thread_interactions[thread_index] += interactions;
+}
+
+void electrostatics_apply_forces(void) {
+    ForceContext ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.store = get_particle_store();
+    if (node_count == 0)
+        return;
+
+    thread_pool_parallel_for_traced("charge forces", ctx.store->count, FORCE_GRAIN, force_task, &ctx);
+    electrostatics_stats.interactions = 0;
+    for (int t = 0; t < thread_pool_size(); t++)
+        electrostatics_stats.interactions += ctx.thread_interactions[t];
+}
+
+const ElectrostaticsStats* get_electrostatics_stats(void) {
+    return &electrostatics_stats;
+}
@@ -1,8 +1,9 @@
 #include "physics/forces.h"
 
 float gravity_acceleration = 10.0f;
+float domain_size = 1.0f;
 
-void apply_gravity(Particle* p) {
-    p->acceleration[0] = 0;
-    p->acceleration[1] = -gravity_acceleration;
+void apply_gravity(ParticleStore* store, int i) {
+    store->acceleration_x[i] = 0;
+    store->acceleration_y[i] = -gravity_acceleration;
 }
@@ -1,90 +1,511 @@
 #include "physics/integrator.h"
 #include "physics/collision.h"
+#include "physics/electrostatics.h"
 #include "physics/forces.h"
+#include "physics/narrow_phase.h"
+#include "physics/sleep.h"
+#include "physics/sph.h"
+#include "spatial/broad_phase.h"
 #include "spatial/grid.h"
-#include "core/particle.h"
-#include "core/linked_list.h"
+#include "spatial/neighbor_list.h"
+#include "spatial/particle_factory.h"
+#include "spatial/reorder.h"
+#include "core/particle_store.h"
+#include "core/profiler.h"
+#include "core/thread_pool.h"
+#include "core/trace.h"
+#include "core/trajectory.h"
+#include <math.h>
+#include <stddef.h>
 
-static void update_acceleration(Node* current, float dt) {
-    Particle* particle = (Particle*)current->item;
-    apply_gravity(particle);
+#define PARTICLE_GRAIN 1024
+#define PARTITION_GRAIN 4
 
-    Node* other_particle = current->next;
-    while (other_particle != NULL) {
-        detect_and_resolve_collision(particle, (Particle*)other_particle->item, dt);
-        other_particle = other_particle->next;
+static int deterministic_mode = 0;
+static int overlap_iterations = 5;
+static OverlapSolver overlap_solver = OVERLAP_SOLVER_AUTO;
+static Profiler* step_profiler = NULL;
+
+// Adaptive substepping, off while adaptive_fraction is 0
+static float adaptive_fraction = 0.0f;
+static float adaptive_min_radius = 0.0f;
+static float max_speed = 0.0f;          // Fastest particle in the last position pass
+static float max_acceleration = 0.0f;   // Largest acceleration in the last velocity pass
+
+typedef struct StepContext {
+    ParticleStore* store;
+    const int* sorted;
+    const int* partitions;  // Partition ids handed to the collision task
+    float time_step;
+    float thread_max_speed_sq[THREAD_POOL_MAX_THREADS];
+    float thread_max_acceleration_sq[THREAD_POOL_MAX_THREADS];
+} StepContext;
+
+void physics_set_deterministic(int enabled) {
+    deterministic_mode = enabled;
+}
+
+void physics_set_overlap_iterations(int iterations) {
+    overlap_iterations = iterations > 0 ? iterations : 1;
+}
+
+OverlapSolver physics_set_overlap_solver(OverlapSolver solver) {
+    if (solver == OVERLAP_SOLVER_AUTO)
+        solver = deterministic_mode || thread_pool_size() > 1 ? OVERLAP_SOLVER_PARTITIONS
+                                                              : OVERLAP_SOLVER_SEQUENTIAL;
+    overlap_solver = solver;
+    return solver;
+}
+
+void physics_set_adaptive(float fraction) {
+    adaptive_fraction = fraction > 0 ? fraction : 0.0f;
+    if (adaptive_fraction == 0)
+        return;
+
+    // The substep bound holds for the smallest particle, so for all of them.
+    // The initial speeds matter when starting from a checkpoint.
+    ParticleStore* store = get_particle_store();
+    adaptive_min_radius = 0.0f;
+    float max_speed_sq = 0.0f;
+    for (int i = 0; i < store->count; i++) {
+        if (i == 0 || store->radius[i] < adaptive_min_radius)
+            adaptive_min_radius = store->radius[i];
+        float vx = store->velocity_x[i];
+        float vy = store->velocity_y[i];
+        max_speed_sq = fmaxf(max_speed_sq, vx * vx + vy * vy);
     }
+    max_speed = sqrtf(max_speed_sq);
+    // Coulomb forces are not known before the first step computes them
+    max_acceleration = gravity_acceleration;
+}
 
-    Node* partition = compute_partition_for_particle(current);
-    Node** neighbors = get_adjacent_partitions(partition);
+float physics_max_speed(void) {
+    return max_speed;
+}
 
-    for (int i = 0; i < 8 && neighbors[i] != NULL; i++) {
-        Node* neighbor_particle = (Node*)neighbors[i]->item;
-        while (neighbor_particle != NULL) {
-            detect_and_resolve_collision(particle, (Particle*)neighbor_particle->item, dt);
-            neighbor_particle = neighbor_particle->next;
-        }
+void physics_set_profiler(Profiler* prof) {
+    step_profiler = prof;
+}
+
+static void begin_phase(ProfilerPhase phase) {
+    TRACE_ZONE_BEGIN(profiler_phase_name(phase));
+    if (step_profiler != NULL)
+        profiler_start_phase(step_profiler, phase);
+}
+
+static void end_phase(ProfilerPhase phase) {
+    if (step_profiler != NULL)
+        profiler_end_phase(step_profiler, phase);
+    TRACE_ZONE_END();
+}
+
+// Collides the particle at slot k of the sorted order with the particles after
+// it in its own partition and with every particle of the forward neighbors.
+// All candidates are contiguous slices of the sorted particle array, tested a
+// whole partition at a time by the batched narrow-phase.
+static void update_acceleration(ParticleStore* store, const int* sorted, int k, int partition,
+                                const int* neighbors, int neighbor_count, float dt,
+                                CollisionPairBuffer* pairs) {
+    int i = sorted[k];
+
+    int end = get_partition_end(partition);
+    narrow_phase_collide(store, i, sorted + k + 1, end - k - 1, dt, pairs);
+
+    for (int n = 0; n < neighbor_count; n++) {
+        int neighbor_begin = get_partition_begin(neighbors[n]);
+        int neighbor_size = get_partition_end(neighbors[n]) - neighbor_begin;
+        if (neighbor_size > 0)
+            narrow_phase_collide(store, i, sorted + neighbor_begin, neighbor_size, dt, pairs);
     }
 }
 
-void physics_step(float time_step) {
-    // Clear collision pair cache from previous frame
-    clear_collision_pairs();
-    
-    // Phase 1: Velocity integration and collision detection for velocity response
-    Node* current_partition = get_all_partitions();
+// Pairs across levels on a coarser level's partition: its particles against
+// the finer particles listed in it and in its forward neighbors, and the
+// finer particles listed in it against the forward neighbors' particles
+static void collide_finer(StepContext* ctx, int partition, const int* neighbors, int neighbor_count,
+                          CollisionPairBuffer* pairs) {
+    // The lists are short, so empty ones are skipped rather than handed to
+    // the narrow phase
+    const int* finer[GRID_MAX_NEIGHBORS + 1];
+    int finer_count[GRID_MAX_NEIGHBORS + 1];
+    int lists = 0;
+    finer[lists] = get_partition_finer(partition, &finer_count[lists]);
+    lists += finer_count[lists] > 0;
+    for (int n = 0; n < neighbor_count; n++) {
+        finer[lists] = get_partition_finer(neighbors[n], &finer_count[lists]);
+        lists += finer_count[lists] > 0;
+    }
+
+    int end = get_partition_end(partition);
+    for (int k = get_partition_begin(partition); k < end; k++)
+        for (int l = 0; l < lists; l++)
+            narrow_phase_collide(ctx->store, ctx->sorted[k], finer[l], finer_count[l], ctx->time_step, pairs);
+
+    int own_count;
+    const int* own = get_partition_finer(partition, &own_count);
+    if (own_count == 0)
+        return;
+    for (int n = 0; n < neighbor_count; n++) {
+        int neighbor_begin = get_partition_begin(neighbors[n]);
+        int neighbor_size = get_partition_end(neighbors[n]) - neighbor_begin;
+        if (neighbor_size == 0)
+            continue;
+        for (int f = 0; f < own_count; f++)
+            narrow_phase_collide(ctx->store, own[f], ctx->sorted + neighbor_begin, neighbor_size,
+                                 ctx->time_step, pairs);
+    }
+}
+
+// Same collisions read from candidate lists (Verlet or sort-and-sweep): the
+// candidates of slot k are already gathered into one contiguous run
+static void collide_candidate_lists(StepContext* ctx, int partition, const int* offsets, const int* indices,
+                                    CollisionPairBuffer* pairs) {
+    int end = get_partition_end(partition);
+    for (int k = get_partition_begin(partition); k < end; k++)
+        narrow_phase_collide(ctx->store, ctx->sorted[k], indices + offsets[k], offsets[k + 1] - offsets[k],
+                             ctx->time_step, pairs);
+}
+
+static void collide_partition(StepContext* ctx, int partition, int thread_index) {
+    // Empty cells are most cells of a sparse finest level; only a coarser
+    // one's may still list finer particles to pair
+    if (get_partition_begin(partition) == get_partition_end(partition)) {
+        int finer_count;
+        get_partition_finer(partition, &finer_count);
+        if (finer_count == 0)
+            return;
+    }
+
+    CollisionPairBuffer* pairs = get_collision_pair_buffer(thread_index);
+    int first_pair = pairs->count;
+
+    const int* offsets;
+    const int* indices;
+    if (sleep_enabled() && partition_stencil_asleep(partition)) {
+        // Nothing in reach is awake
+    } else if (broad_phase_candidates(&offsets, &indices)) {
+        collide_candidate_lists(ctx, partition, offsets, indices, pairs);
+    } else {
+        int neighbors[GRID_MAX_NEIGHBORS];
+        int neighbor_count = get_adjacent_partitions(partition, neighbors);
+
+        int end = get_partition_end(partition);
+        for (int k = get_partition_begin(partition); k < end; k++)
+            update_acceleration(ctx->store, ctx->sorted, k, partition, neighbors, neighbor_count,
+                                ctx->time_step, pairs);
+        if (get_partition_level(partition) > 0)
+            collide_finer(ctx, partition, neighbors, neighbor_count, pairs);
+    }
+
+    record_partition_pairs(partition, thread_index, first_pair, pairs->count);
+}
+
+static void collide_partitions_task(void* context, int thread_index, int begin, int end) {
+    StepContext* ctx = context;
+    for (int k = begin; k < end; k++)
+        collide_partition(ctx, ctx->partitions[k], thread_index);
+}
+
+static void integrate_velocities_task(void* context, int thread_index, int begin, int end) {
+    StepContext* ctx = context;
+    ParticleStore* store = ctx->store;
+
+    float max_acceleration_sq = ctx->thread_max_acceleration_sq[thread_index];
+
+    for (int i = begin; i < end; i++) {
+        if (particle_is_asleep(store, i))
+            continue;
+        float ax = store->acceleration_x[i];
+        float ay = store->acceleration_y[i];
+        store->velocity_x[i] += ax * ctx->time_step;
+        store->velocity_y[i] += ay * ctx->time_step;
+        max_acceleration_sq = fmaxf(max_acceleration_sq, ax * ax + ay * ay);
+        apply_gravity(store, i);
+    }
+
+    ctx->thread_max_acceleration_sq[thread_index] = max_acceleration_sq;
+}
+
+// Measures the speeds the particles actually move with, after the
+// collision responses of the velocity pass
+static void integrate_positions_task(void* context, int thread_index, int begin, int end) {
+    StepContext* ctx = context;
+    ParticleStore* store = ctx->store;
+    float max_speed_sq = ctx->thread_max_speed_sq[thread_index];
 
-    while (current_partition != NULL) {
-        Node* particle_node = current_partition->item;
-        while (particle_node != NULL) {
-            Particle* particle = (Particle*)particle_node->item;
+    for (int i = begin; i < end; i++) {
+        if (particle_is_asleep(store, i))
+            continue;
+        float vx = store->velocity_x[i];
+        float vy = store->velocity_y[i];
+        max_speed_sq = fmaxf(max_speed_sq, vx * vx + vy * vy);
+        store->position_x[i] += vx * ctx->time_step;
+        store->position_y[i] += vy * ctx->time_step;
 
-            particle->velocity[0] += particle->acceleration[0] * time_step;
-            particle->velocity[1] += particle->acceleration[1] * time_step;
+        handle_wall_collision(store, i, ctx->time_step);
+    }
+
+    ctx->thread_max_speed_sq[thread_index] = max_speed_sq;
+}
+
+static void constrain_positions_task(void* context, int thread_index, int begin, int end) {
+    StepContext* ctx = context;
+    (void)thread_index;
 
-            update_acceleration(particle_node, time_step);
+    for (int i = begin; i < end; i++)
+        if (!particle_is_asleep(ctx->store, i))
+            clamp_particle_position(ctx->store, i);
+}
+
+// Phases shared by both models, once the grid is current
+static void finish_step(StepContext* ctx) {
+    // Phase 6: Remove particles and drop new ones in, for --recycle
+    if (recycle_enabled()) {
+        begin_phase(PHASE_RECYCLE);
+        recycle_particles();
+        end_phase(PHASE_RECYCLE);
+    }
 
-            particle_node = particle_node->next;
+    // Phase 7: Restore memory locality along a Z-order curve once the
+    // particles have drifted away from their storage order
+    if (reorder_enabled()) {
+        begin_phase(PHASE_REORDER);
+        reorder_particles_if_needed();
+        end_phase(PHASE_REORDER);
+    }
+
+    // Phase 8: Put calm particles to sleep and find partitions with nothing
+    // awake, for the next step to skip
+    if (sleep_enabled()) {
+        begin_phase(PHASE_SLEEP);
+        update_sleep_states(ctx->time_step);
+        end_phase(PHASE_SLEEP);
+    }
+
+    // Phase 9: Hand positions and velocities to the trajectory writer
+    if (trajectory_enabled()) {
+        begin_phase(PHASE_EXPORT);
+        trajectory_capture(ctx->store);
+        end_phase(PHASE_EXPORT);
+    }
+}
+
+// SPH moves every particle from its own accelerations, then handles walls as
+// the collision model does
+static void integrate_sph_task(void* context, int thread_index, int begin, int end) {
+    StepContext* ctx = context;
+    ParticleStore* store = ctx->store;
+    (void)thread_index;
+
+    for (int i = begin; i < end; i++) {
+        store->velocity_x[i] += store->acceleration_x[i] * ctx->time_step;
+        store->velocity_y[i] += store->acceleration_y[i] * ctx->time_step;
+        handle_wall_collision(store, i, ctx->time_step);
+        store->position_x[i] += store->velocity_x[i] * ctx->time_step;
+        store->position_y[i] += store->velocity_y[i] * ctx->time_step;
+        clamp_particle_position(store, i);
+    }
+}
+
+// The SPH model replaces phases 1-4 with density and force passes, repeated
+// for every substep on a freshly binned grid
+static void sph_step(StepContext* ctx, float time_step) {
+    int substeps = sph_substeps(time_step);
+    ctx->time_step = time_step / substeps;
+    int count = ctx->store->count;
+
+    for (int substep = 0; substep < substeps; substep++) {
+        // The grid from the end of the previous step serves the first substep
+        if (substep > 0) {
+            begin_phase(PHASE_REPARTITION);
+            rebuild_grid();
+            end_phase(PHASE_REPARTITION);
         }
-        current_partition = current_partition->next;
+
+        begin_phase(PHASE_SPH_DENSITY);
+        sph_compute_density();
+        end_phase(PHASE_SPH_DENSITY);
+
+        begin_phase(PHASE_SPH_FORCES);
+        sph_compute_forces();
+        end_phase(PHASE_SPH_FORCES);
+
+        begin_phase(PHASE_POSITION);
+        thread_pool_parallel_for(count, PARTICLE_GRAIN, integrate_sph_task, ctx);
+        end_phase(PHASE_POSITION);
     }
 
-    // Phase 2: Position integration
-    current_partition = get_all_partitions();
-    while (current_partition != NULL) {
-        Node* particle_node = current_partition->item;
-        while (particle_node != NULL) {
-            Particle* particle = (Particle*)particle_node->item;
+    begin_phase(PHASE_REPARTITION);
+    rebuild_grid();
+    end_phase(PHASE_REPARTITION);
+}
+
+// Substeps that keep the fastest particle within adaptive_fraction of the
+// smallest radius per substep over the next `duration` seconds. The velocity
+// passes add at most the largest acceleration of the last one, gravity plus
+// any Coulomb force, times the duration to the last measured speed.
+static int adaptive_substeps(float duration) {
+    float speed_bound = max_speed + max_acceleration * duration;
+    float travel = speed_bound * duration / (adaptive_fraction * adaptive_min_radius);
+    int substeps = (int)ceilf(travel);
+    if (substeps < 1)
+        return 1;
+    return substeps < PHYSICS_MAX_SUBSTEPS ? substeps : PHYSICS_MAX_SUBSTEPS;
+}
+
+// Phases 0-5 of the collision model over one substep of ctx->time_step
+static void collision_substep(StepContext* ctx, int colored) {
+    int count = ctx->store->count;
+    ctx->sorted = get_sorted_particles();
+    ctx->partitions = NULL;
 
-            particle->position[0] += particle->velocity[0] * time_step;
-            particle->position[1] += particle->velocity[1] * time_step;
+    // Phase 0: Coulomb forces replace the gravity-only acceleration that
+    // Phase 1 integrates
+    if (electrostatics_enabled()) {
+        begin_phase(PHASE_CHARGE_TREE);
+        electrostatics_build_tree();
+        end_phase(PHASE_CHARGE_TREE);
 
-            handle_wall_collision(particle, time_step);
+        begin_phase(PHASE_CHARGE_FORCES);
+        electrostatics_apply_forces();
+        end_phase(PHASE_CHARGE_FORCES);
+    }
 
-            particle_node = particle_node->next;
+    // Clear collision pair cache from previous frame
+    clear_collision_pairs();
+
+    if (get_broad_phase() != BROAD_PHASE_GRID) {
+        begin_phase(PHASE_BROAD_PHASE);
+        broad_phase_update(ctx->time_step);
+        end_phase(PHASE_BROAD_PHASE);
+    }
+    
+    // Phase 1: Velocity integration and collision detection for velocity response
+    begin_phase(PHASE_VELOCITY_COLLISION);
+    for (int t = 0; t < thread_pool_size(); t++)
+        ctx->thread_max_acceleration_sq[t] = 0.0f;
+    thread_pool_parallel_for(count, PARTICLE_GRAIN, integrate_velocities_task, ctx);
+    float max_acceleration_sq = 0.0f;
+    for (int t = 0; t < thread_pool_size(); t++)
+        max_acceleration_sq = fmaxf(max_acceleration_sq, ctx->thread_max_acceleration_sq[t]);
+    max_acceleration = sqrtf(max_acceleration_sq);
+
+    if (colored) {
+        // Partitions of one color never share a particle, so each color is a
+        // race-free parallel batch
+        for (int color = 0; color < get_grid_color_count(); color++) {
+            int partition_count;
+            ctx->partitions = get_partitions_of_color(color, &partition_count);
+            thread_pool_parallel_for_traced("collide partitions", partition_count, PARTITION_GRAIN,
+                                            collide_partitions_task, ctx);
         }
-        current_partition = current_partition->next;
+    } else {
+        int partition_count = get_partition_count();
+        for (int partition = 0; partition < partition_count; partition++)
+            collide_partition(ctx, partition, 0);
     }
+    end_phase(PHASE_VELOCITY_COLLISION);
+
+    // Phase 2: Position integration
+    begin_phase(PHASE_POSITION);
+    for (int t = 0; t < thread_pool_size(); t++)
+        ctx->thread_max_speed_sq[t] = 0.0f;
+    thread_pool_parallel_for(count, PARTICLE_GRAIN, integrate_positions_task, ctx);
+    float max_speed_sq = 0.0f;
+    for (int t = 0; t < thread_pool_size(); t++)
+        max_speed_sq = fmaxf(max_speed_sq, ctx->thread_max_speed_sq[t]);
+    max_speed = sqrtf(max_speed_sq);
+    end_phase(PHASE_POSITION);
 
     // Phase 3: Position-based overlap resolution using cached collision pairs
     // This eliminates redundant spatial queries - uses pairs detected in Phase 1
-    resolve_position_overlaps_cached(5);
+    begin_phase(PHASE_OVERLAP);
+    merge_collision_pairs();
+    switch (overlap_solver) {
+        case OVERLAP_SOLVER_SEQUENTIAL:
+            resolve_position_overlaps_cached(overlap_iterations);
+            break;
+        case OVERLAP_SOLVER_PARTITIONS:
+            resolve_position_overlaps_colored(overlap_iterations);
+            break;
+        case OVERLAP_SOLVER_GRAPH:
+            resolve_position_overlaps_graph(overlap_iterations);
+            break;
+        case OVERLAP_SOLVER_JACOBI:
+            resolve_position_overlaps_jacobi(overlap_iterations);
+            break;
+        default:
+            if (colored)
+                resolve_position_overlaps_colored(overlap_iterations);
+            else
+                resolve_position_overlaps_cached(overlap_iterations);
+            break;
+    }
+    end_phase(PHASE_OVERLAP);
+
+    if (step_profiler != NULL) {
+        const CollisionPairStats* stats = get_collision_pair_stats();
+        profiler_record_contacts(step_profiler, stats->pairs, stats->dropped, stats->growths,
+                                 stats->reserved_bytes);
+    }
 
     // Phase 4: Enforce hard position constraints (prevent escape)
-    enforce_position_constraints();
-
-    // Phase 5: Update spatial partitions based on new positions
-    current_partition = get_all_partitions();
-    while (current_partition != NULL) {
-        Node* particle_node = current_partition->item;
-        while (particle_node != NULL) {
-            Node* old_partition = current_partition;
-            Node* new_partition = compute_partition_for_particle(particle_node);
-            if (old_partition != new_partition)
-                move_particle_to_partition(particle_node, old_partition, new_partition);
-
-            particle_node = particle_node->next;
+    begin_phase(PHASE_CONSTRAINTS);
+    thread_pool_parallel_for(count, PARTICLE_GRAIN, constrain_positions_task, ctx);
+    end_phase(PHASE_CONSTRAINTS);
+
+    // Phase 5: Rebin every particle with a counting sort (O(n)). With
+    // neighbor lists the binning is kept, together with the lists, until a
+    // particle may have moved beyond the skin.
+    begin_phase(PHASE_REPARTITION);
+    if (!neighbor_list_enabled()) {
+        rebuild_grid();
+    } else if (neighbor_list_needs_rebuild()) {
+        rebuild_grid();
+        neighbor_list_build();
+    }
+    end_phase(PHASE_REPARTITION);
+}
+
+void physics_step(float time_step) {
+    TRACE_SCOPE("physics_step");
+    StepContext ctx;
+    ctx.store = get_particle_store();
+    ctx.sorted = get_sorted_particles();
+    ctx.partitions = NULL;
+    ctx.time_step = time_step;
+
+    if (sph_enabled()) {
+        sph_step(&ctx, time_step);
+        ctx.time_step = time_step;
+        if (step_profiler != NULL)
+            profiler_record_substeps(step_profiler, get_sph_stats()->substeps);
+        finish_step(&ctx);
+        return;
+    }
+
+    int colored = deterministic_mode || thread_pool_size() > 1;
+    int substeps = adaptive_fraction > 0 ? adaptive_substeps(time_step) : 1;
+    float remaining = time_step;
+    for (int substep = 0; substep < substeps; substep++) {
+        ctx.time_step = remaining / (substeps - substep);
+        collision_substep(&ctx, colored);
+        remaining -= ctx.time_step;
+
+        // Impacts can speed particles up past the bound the step was split
+        // for, so the rest of it is split again from the measured speed
+        if (adaptive_fraction > 0 && substep + 1 < substeps) {
+            int needed = substep + 1 + adaptive_substeps(remaining);
+            if (needed > substeps)
+                substeps = needed < PHYSICS_MAX_SUBSTEPS ? needed : PHYSICS_MAX_SUBSTEPS;
         }
-        current_partition = current_partition->next;
+        // The last substep's counts come from finish_step()
+        if (sleep_enabled() && substep + 1 < substeps)
+            refresh_sleeping_partitions();
     }
+    if (step_profiler != NULL)
+        profiler_record_substeps(step_profiler, substeps);
+
+    ctx.time_step = time_step;
+    finish_step(&ctx);
 }
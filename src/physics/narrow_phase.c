@@ -0,0 +1,188 @@
+#include "physics/narrow_phase.h"
+#include <stdio.h>
+
+#if defined(__x86_64__)
+#define NARROW_PHASE_X86 1
+#include <immintrin.h>
+#endif
+
+typedef void (*NarrowPhaseFn)(ParticleStore* store, int i, const int* candidates, int count,
+                              float dt, CollisionPairBuffer* pairs);
+
+static void collide_scalar(ParticleStore* store, int i, const int* candidates, int count,
+                           float dt, CollisionPairBuffer* pairs) {
+    for (int m = 0; m < count; m++)
+        detect_and_resolve_collision(store, i, candidates[m], dt, pairs);
+}
+
+// Finishes a batch whose lane mask flagged a hit. Lanes before the first
+// hit were tested with the velocities the scalar kernel would see, so they
+// are misses. Resolving the hit changes the velocity of i, which the rest of
+// the batch was tested against, so from the hit on every lane goes through
+// the scalar test, exactly as collide_scalar() would run them.
+static void resolve_hits(ParticleStore* store, int i, const int* candidates, int lanes, unsigned int mask,
+                         float dt, CollisionPairBuffer* pairs) {
+    int first = __builtin_ctz(mask);
+    collide_scalar(store, i, candidates + first, lanes - first, dt, pairs);
+}
+
+#ifdef NARROW_PHASE_X86
+static void collide_sse(ParticleStore* store, int i, const int* candidates, int count,
+                        float dt, CollisionPairBuffer* pairs) {
+    const float* px = store->position_x;
+    const float* py = store->position_y;
+    const float* vx = store->velocity_x;
+    const float* vy = store->velocity_y;
+    const float* radius = store->radius;
+
+    __m128 pix = _mm_set1_ps(px[i]);
+    __m128 piy = _mm_set1_ps(py[i]);
+    __m128 ri = _mm_set1_ps(radius[i]);
+    __m128 step = _mm_set1_ps(dt);
+    __m128 zero = _mm_setzero_ps();
+    // Warm starting keeps resting contacts too
+    int resting = contact_warm_start_enabled();
+
+    int m = 0;
+    for (; m + 4 <= count; m += 4) {
+        const int* c = candidates + m;
+        // Velocity of i may have changed in the previous batch
+        __m128 vix = _mm_set1_ps(vx[i]);
+        __m128 viy = _mm_set1_ps(vy[i]);
+
+        __m128 dx = _mm_sub_ps(_mm_set_ps(px[c[3]], px[c[2]], px[c[1]], px[c[0]]), pix);
+        __m128 dy = _mm_sub_ps(_mm_set_ps(py[c[3]], py[c[2]], py[c[1]], py[c[0]]), piy);
+        __m128 dvx = _mm_sub_ps(_mm_set_ps(vx[c[3]], vx[c[2]], vx[c[1]], vx[c[0]]), vix);
+        __m128 dvy = _mm_sub_ps(_mm_set_ps(vy[c[3]], vy[c[2]], vy[c[1]], vy[c[0]]), viy);
+        __m128 rsum = _mm_add_ps(_mm_set_ps(radius[c[3]], radius[c[2]], radius[c[1]], radius[c[0]]), ri);
+
+        __m128 ex = _mm_add_ps(_mm_mul_ps(dvx, step), dx);
+        __m128 ey = _mm_add_ps(_mm_mul_ps(dvy, step), dy);
+        __m128 dist_sq = _mm_add_ps(_mm_mul_ps(ex, ex), _mm_mul_ps(ey, ey));
+        __m128 in_range = _mm_cmple_ps(dist_sq, _mm_mul_ps(rsum, rsum));
+
+        // Approaching when the relative velocity points against the offset
+        __m128 closing = _mm_add_ps(_mm_mul_ps(dx, dvx), _mm_mul_ps(dy, dvy));
+        __m128 approaching = _mm_cmplt_ps(closing, zero);
+
+        unsigned int mask = (unsigned int)_mm_movemask_ps(resting ? in_range : _mm_and_ps(in_range, approaching));
+        if (mask != 0)
+            resolve_hits(store, i, c, 4, mask, dt, pairs);
+    }
+
+    collide_scalar(store, i, candidates + m, count - m, dt, pairs);
+}
+
+__attribute__((target("avx2")))
+static void collide_avx2(ParticleStore* store, int i, const int* candidates, int count,
+                         float dt, CollisionPairBuffer* pairs) {
+    const float* px = store->position_x;
+    const float* py = store->position_y;
+    const float* vx = store->velocity_x;
+    const float* vy = store->velocity_y;
+    const float* radius = store->radius;
+
+    __m256 pix = _mm256_set1_ps(px[i]);
+    __m256 piy = _mm256_set1_ps(py[i]);
+    __m256 ri = _mm256_set1_ps(radius[i]);
+    __m256 step = _mm256_set1_ps(dt);
+    __m256 zero = _mm256_setzero_ps();
+    int resting = contact_warm_start_enabled();
+
+    int m = 0;
+    for (; m + 8 <= count; m += 8) {
+        __m256i index = _mm256_loadu_si256((const __m256i*)(candidates + m));
+        // Velocity of i may have changed in the previous batch
+        __m256 vix = _mm256_set1_ps(vx[i]);
+        __m256 viy = _mm256_set1_ps(vy[i]);
+
+        __m256 dx = _mm256_sub_ps(_mm256_i32gather_ps(px, index, 4), pix);
+        __m256 dy = _mm256_sub_ps(_mm256_i32gather_ps(py, index, 4), piy);
+        __m256 dvx = _mm256_sub_ps(_mm256_i32gather_ps(vx, index, 4), vix);
+        __m256 dvy = _mm256_sub_ps(_mm256_i32gather_ps(vy, index, 4), viy);
+        __m256 rsum = _mm256_add_ps(_mm256_i32gather_ps(radius, index, 4), ri);
+
+        __m256 ex = _mm256_add_ps(_mm256_mul_ps(dvx, step), dx);
+        __m256 ey = _mm256_add_ps(_mm256_mul_ps(dvy, step), dy);
+        __m256 dist_sq = _mm256_add_ps(_mm256_mul_ps(ex, ex), _mm256_mul_ps(ey, ey));
+        __m256 in_range = _mm256_cmp_ps(dist_sq, _mm256_mul_ps(rsum, rsum), _CMP_LE_OQ);
+
+        // Approaching when the relative velocity points against the offset
+        __m256 closing = _mm256_add_ps(_mm256_mul_ps(dx, dvx), _mm256_mul_ps(dy, dvy));
+        __m256 approaching = _mm256_cmp_ps(closing, zero, _CMP_LT_OQ);
+
+        unsigned int mask =
+            (unsigned int)_mm256_movemask_ps(resting ? in_range : _mm256_and_ps(in_range, approaching));
+        if (mask != 0)
+            resolve_hits(store, i, candidates + m, 8, mask, dt, pairs);
+    }
+
+    collide_sse(store, i, candidates + m, count - m, dt, pairs);
+}
+#endif
+
+static NarrowPhaseFn active_kernel = collide_scalar;
+
+static int kernel_supported(NarrowPhaseKernel kernel) {
+    switch (kernel) {
+        case NARROW_PHASE_SCALAR:
+            return 1;
+#ifdef NARROW_PHASE_X86
+        case NARROW_PHASE_SSE:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("sse2");
+        case NARROW_PHASE_AVX2:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx2");
+#endif
+        default:
+            return 0;
+    }
+}
+
+NarrowPhaseKernel narrow_phase_select(NarrowPhaseKernel requested) {
+    if (requested != NARROW_PHASE_AUTO && !kernel_supported(requested)) {
+        fprintf(stderr, "warning: %s narrow-phase not supported on this CPU\n",
+                narrow_phase_kernel_name(requested));
+        requested = NARROW_PHASE_AUTO;
+    }
+
+    if (requested == NARROW_PHASE_AUTO) {
+        if (kernel_supported(NARROW_PHASE_AVX2))
+            requested = NARROW_PHASE_AVX2;
+        else if (kernel_supported(NARROW_PHASE_SSE))
+            requested = NARROW_PHASE_SSE;
+        else
+            requested = NARROW_PHASE_SCALAR;
+    }
+
+    switch (requested) {
+#ifdef NARROW_PHASE_X86
+        case NARROW_PHASE_SSE:
+            active_kernel = collide_sse;
+            break;
+        case NARROW_PHASE_AVX2:
+            active_kernel = collide_avx2;
+            break;
+#endif
+        default:
+            requested = NARROW_PHASE_SCALAR;
+            active_kernel = collide_scalar;
+            break;
+    }
+    return requested;
+}
+
+const char* narrow_phase_kernel_name(NarrowPhaseKernel kernel) {
+    switch (kernel) {
+        case NARROW_PHASE_SCALAR: return "scalar";
+        case NARROW_PHASE_SSE: return "sse";
+        case NARROW_PHASE_AVX2: return "avx2";
+        default: return "auto";
+    }
+}
+
+void narrow_phase_collide(ParticleStore* store, int i, const int* candidates, int count,
+                          float dt, CollisionPairBuffer* pairs) {
+    active_kernel(store, i, candidates, count, dt, pairs);
+}
@@ -0,0 +1,328 @@
+#include "physics/sleep.h"
+#include "physics/forces.h"
+#include "spatial/grid.h"
+#include "core/arena.h"
+#include "core/thread_pool.h"
+#include "core/trace.h"
+#include <limits.h>
+#include <string.h>
+
+#define PARTICLE_GRAIN 1024
+#define PARTITION_GRAIN 64
+
+int sleep_after_steps = INT_MAX;
+static float sleep_speed_squared = 0.0f;
+static int* partition_awake = NULL;     // Awake particles per partition
+static unsigned char* partition_moving = NULL;  // Holds an awake particle above the sleep speed
+static unsigned char* partition_shaken = NULL;  // Moving itself or next to a moving partition
+static SleepStats sleep_stats;
+
+typedef struct SleepUpdateContext {
+    ParticleStore* store;
+    int thread_sleeping[THREAD_POOL_MAX_THREADS];
+    int thread_fell_asleep[THREAD_POOL_MAX_THREADS];
+    int thread_woken[THREAD_POOL_MAX_THREADS];
+    int thread_shaken[THREAD_POOL_MAX_THREADS];
+    int thread_sleeping_partitions[THREAD_POOL_MAX_THREADS];
+} SleepUpdateContext;
+
+int sleep_enabled(void) {
+    return sleep_after_steps != INT_MAX;
+}
+
+void sleep_init(int steps) {
+    sleep_after_steps = steps > 0 ? steps : INT_MAX;
+    memset(&sleep_stats, 0, sizeof(sleep_stats));
+    if (!sleep_enabled())
+        return;
+
+    // calm_steps and the rest anchors start from the store: zero and the
+    // spawn position for new particles, the saved values for a checkpoint
+    int capacity = get_partition_capacity();
+    partition_awake = arena_alloc(get_simulation_arena(), capacity * sizeof(int));
+    partition_moving = arena_alloc(get_simulation_arena(), capacity);
+    partition_shaken = arena_alloc(get_simulation_arena(), capacity);
+    // Nothing sleeps yet, so no partition may be skipped before the first update
+    for (int p = 0; p < capacity; p++)
+        partition_awake[p] = 1;
+}
+
+// The partition counts belong to the simulation arena
+void sleep_cleanup(void) {
+    partition_awake = NULL;
+    partition_moving = NULL;
+    partition_shaken = NULL;
+    sleep_after_steps = INT_MAX;
+}
+
+static int particle_is_moving(const ParticleStore* store, int i) {
+    float vx = store->velocity_x[i];
+    float vy = store->velocity_y[i];
+    return !particle_is_asleep(store, i) && vx * vx + vy * vy >= sleep_speed_squared;
+}
+
+static void find_moving_partitions_task(void* context, int thread_index, int begin, int end) {
+    (void)thread_index;
+    SleepUpdateContext* ctx = context;
+    const int* sorted = get_sorted_particles();
+
+    for (int p = begin; p < end; p++) {
+        int moving = 0;
+        int partition_end = get_partition_end(p);
+        for (int k = get_partition_begin(p); k < partition_end && !moving; k++)
+            moving = particle_is_moving(ctx->store, sorted[k]);
+        int finer_count;
+        const int* finer = get_partition_finer(p, &finer_count);
+        for (int f = 0; f < finer_count && !moving; f++)
+            moving = particle_is_moving(ctx->store, finer[f]);
+        partition_moving[p] = (unsigned char)moving;
+    }
+}
+
+static void find_shaken_partitions_task(void* context, int thread_index, int begin, int end) {
+    (void)context;
+    (void)thread_index;
+    for (int p = begin; p < end; p++) {
+        int shaken = partition_moving[p];
+        int neighbors[GRID_MAX_NEIGHBORS];
+        int neighbor_count = get_surrounding_partitions(p, neighbors);
+        for (int n = 0; n < neighbor_count && !shaken; n++)
+            shaken = partition_moving[neighbors[n]];
+        partition_shaken[p] = (unsigned char)shaken;
+    }
+}
+
+static void wake_shaken_particles_task(void* context, int thread_index, int begin, int end) {
+    SleepUpdateContext* ctx = context;
+    ParticleStore* store = ctx->store;
+    int shaken = 0;
+    for (int i = begin; i < end; i++) {
+        if (particle_is_asleep(store, i) && partition_shaken[get_particle_partition(i)]) {
+            store->calm_steps[i] = SLEEP_WOKEN;
+            shaken++;
+        }
+    }
+    ctx->thread_shaken[thread_index] += shaken;
+}
+
+// Wakes the sleepers around every partition where something moves faster
+// than the sleep speed. Impacts wake the sleepers they hit, but a sleeper
+// whose support moves away is hit by nothing and would hang in the air.
+static int wake_shaken_sleepers(SleepUpdateContext* ctx) {
+    int partition_count = get_partition_count();
+    thread_pool_parallel_for(partition_count, PARTITION_GRAIN, find_moving_partitions_task, ctx);
+    thread_pool_parallel_for(partition_count, PARTITION_GRAIN, find_shaken_partitions_task, ctx);
+    thread_pool_parallel_for(ctx->store->count, PARTICLE_GRAIN, wake_shaken_particles_task, ctx);
+
+    int shaken = 0;
+    for (int t = 0; t < thread_pool_size(); t++)
+        shaken += ctx->thread_shaken[t];
+    // Finer particles listed on a coarser level rest against its particles
+    // too; they are few, so they are handled here rather than in a race
+    // with their own partition
+    if (get_grid_level_count() > 1) {
+        for (int p = 0; p < partition_count; p++) {
+            if (get_partition_level(p) == 0 || !partition_shaken[p])
+                continue;
+            int finer_count;
+            const int* finer = get_partition_finer(p, &finer_count);
+            for (int f = 0; f < finer_count; f++) {
+                if (particle_is_asleep(ctx->store, finer[f])) {
+                    ctx->store->calm_steps[finer[f]] = SLEEP_WOKEN;
+                    shaken++;
+                }
+            }
+        }
+    }
+    return shaken;
+}
+
+static void update_particles_task(void* context, int thread_index, int begin, int end) {
+    SleepUpdateContext* ctx = context;
+    ParticleStore* store = ctx->store;
+    int sleeping = 0;
+    int fell_asleep = 0;
+    int woken = 0;
+
+    for (int i = begin; i < end; i++) {
+        int calm = store->calm_steps[i];
+        if (calm >= sleep_after_steps) {
+            sleeping++;
+            continue;
+        }
+        if (calm == SLEEP_WOKEN) {
+            woken++;
+            calm = 0;
+        }
+
+        float vx = store->velocity_x[i];
+        float vy = store->velocity_y[i];
+        if (vx * vx + vy * vy >= sleep_speed_squared) {
+            store->calm_steps[i] = 0;
+            continue;
+        }
+        if (calm == 0) {
+            store->rest_x[i] = store->position_x[i];
+            store->rest_y[i] = store->position_y[i];
+        }
+
+        calm++;
+        if (calm >= sleep_after_steps) {
+            float dx = store->position_x[i] - store->rest_x[i];
+            float dy = store->position_y[i] - store->rest_y[i];
+            float max_drift = SLEEP_DRIFT_FACTOR * store->radius[i];
+            if (dx * dx + dy * dy < max_drift * max_drift) {
+                store->velocity_x[i] = 0.0f;
+                store->velocity_y[i] = 0.0f;
+                sleeping++;
+                fell_asleep++;
+            } else {
+                // Calm but sinking: start a new streak from here
+                calm = 1;
+                store->rest_x[i] = store->position_x[i];
+                store->rest_y[i] = store->position_y[i];
+            }
+        }
+        store->calm_steps[i] = calm;
+    }
+
+    ctx->thread_sleeping[thread_index] += sleeping;
+    ctx->thread_fell_asleep[thread_index] += fell_asleep;
+    ctx->thread_woken[thread_index] += woken;
+}
+
+static void count_partitions_task(void* context, int thread_index, int begin, int end) {
+    SleepUpdateContext* ctx = context;
+    const int* sorted = get_sorted_particles();
+    int sleeping_partitions = 0;
+
+    for (int p = begin; p < end; p++) {
+        int partition_begin = get_partition_begin(p);
+        int partition_end = get_partition_end(p);
+        int awake = 0;
+        for (int k = partition_begin; k < partition_end; k++)
+            awake += !particle_is_asleep(ctx->store, sorted[k]);
+        // Finer particles listed here meet this partition's pairs too
+        int finer_count;
+        const int* finer = get_partition_finer(p, &finer_count);
+        for (int f = 0; f < finer_count; f++)
+            awake += !particle_is_asleep(ctx->store, finer[f]);
+        partition_awake[p] = awake;
+        sleeping_partitions += awake == 0 && partition_end > partition_begin;
+    }
+
+    ctx->thread_sleeping_partitions[thread_index] += sleeping_partitions;
+}
+
+void update_sleep_states(float dt) {
+    TRACE_SCOPE("update sleep states");
+    float sleep_speed = SLEEP_SPEED_FACTOR * gravity_acceleration * dt;
+    sleep_speed_squared = sleep_speed * sleep_speed;
+
+    SleepUpdateContext ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.store = get_particle_store();
+    int threads = thread_pool_size();
+
+    sleep_stats.shaken = wake_shaken_sleepers(&ctx);
+    sleep_stats.total_shaken += sleep_stats.shaken;
+    thread_pool_parallel_for(ctx.store->count, PARTICLE_GRAIN, update_particles_task, &ctx);
+    sleep_stats.sleeping = 0;
+    sleep_stats.fell_asleep = 0;
+    sleep_stats.woken = 0;
+    for (int t = 0; t < threads; t++) {
+        sleep_stats.sleeping += ctx.thread_sleeping[t];
+        sleep_stats.fell_asleep += ctx.thread_fell_asleep[t];
+        sleep_stats.woken += ctx.thread_woken[t];
+    }
+    sleep_stats.total_woken += sleep_stats.woken;
+
+    thread_pool_parallel_for(get_partition_count(), PARTITION_GRAIN, count_partitions_task, &ctx);
+    sleep_stats.sleeping_partitions = 0;
+    for (int t = 0; t < threads; t++)
+        sleep_stats.sleeping_partitions += ctx.thread_sleeping_partitions[t];
+}
+
+void refresh_sleeping_partitions(void) {
+    TRACE_SCOPE("count sleeping partitions");
+    SleepUpdateContext ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.store = get_particle_store();
+    thread_pool_parallel_for(get_partition_count(), PARTITION_GRAIN, count_partitions_task, &ctx);
+}
+
+int partition_stencil_asleep(int partition) {
+    if (partition_awake[partition] > 0)
+        return 0;
+
+    int neighbors[GRID_MAX_NEIGHBORS];
+    int neighbor_count = get_adjacent_partitions(partition, neighbors);
+    for (int n = 0; n < neighbor_count; n++)
+        if (partition_awake[neighbors[n]] > 0)
+            return 0;
+    return 1;
+}
+
+void wake_if_disturbed(ParticleStore* store, int i) {
+    if (!particle_is_asleep(store, i))
+        return;
+
+    float vx = store->velocity_x[i];
+    float vy = store->velocity_y[i];
+    if (vx * vx + vy * vy > sleep_speed_squared) {
+        store->calm_steps[i] = SLEEP_WOKEN;
+    } else {
+        store->velocity_x[i] = 0.0f;
+        store->velocity_y[i] = 0.0f;
+    }
+}
+
+static void wake_partition(ParticleStore* store, int partition) {
+    const int* sorted = get_sorted_particles();
+    int end = get_partition_end(partition);
+    for (int k = get_partition_begin(partition); k < end; k++)
+        if (particle_is_asleep(store, sorted[k]))
+            store->calm_steps[sorted[k]] = SLEEP_WOKEN;
+    int finer_count;
+    const int* finer = get_partition_finer(partition, &finer_count);
+    for (int f = 0; f < finer_count; f++)
+        if (particle_is_asleep(store, finer[f]))
+            store->calm_steps[finer[f]] = SLEEP_WOKEN;
+}
+
+static void wake_partition_and_surroundings(ParticleStore* store, int partition) {
+    int neighbors[GRID_MAX_NEIGHBORS];
+    int neighbor_count = get_surrounding_partitions(partition, neighbors);
+    wake_partition(store, partition);
+    for (int n = 0; n < neighbor_count; n++)
+        wake_partition(store, neighbors[n]);
+}
+
+void wake_around_particle(ParticleStore* store, int i) {
+    if (!sleep_enabled())
+        return;
+
+    wake_partition_and_surroundings(store, get_particle_partition(i));
+    // Coarser particles resting on i are binned on their own level, in a
+    // partition that lists i among its finer particles
+    if (get_grid_level_count() == 1)
+        return;
+    int level = get_particle_level(i);
+    int partition_count = get_partition_count();
+    for (int p = 0; p < partition_count; p++) {
+        if (get_partition_level(p) <= level)
+            continue;
+        int finer_count;
+        const int* finer = get_partition_finer(p, &finer_count);
+        for (int f = 0; f < finer_count; f++) {
+            if (finer[f] == i) {
+                wake_partition_and_surroundings(store, p);
+                break;
+            }
+        }
+    }
+}
+
+const SleepStats* get_sleep_stats(void) {
+    return &sleep_stats;
+}
@@ -0,0 +1,354 @@
+#include "physics/sph.h"
+#include "physics/forces.h"
+#include "spatial/grid.h"
+#include "core/arena.h"
+#include "core/particle_store.h"
+#include "core/thread_pool.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PARTITION_GRAIN 4
+#define PARTICLE_GRAIN 1024
+#define SPH_PI 3.14159265358979f
+
+static int sph_active = 0;
+static float max_radius = 0.0f;
+
+// Kernel constants, fixed once h is known
+static float smoothing_length = 0.0f;
+static float smoothing_length_sq = 0.0f;
+static float poly6_factor = 0.0f;           // 4 / (pi h^8)
+static float spiky_gradient_factor = 0.0f;  // -30 / (pi h^5)
+static float viscosity_factor = 0.0f;       // 40 / (pi h^5)
+static float rest_density = 0.0f;
+static float stiffness = 0.0f;              // c^2
+
+static float* density = NULL;
+static float* pressure = NULL;
+static SphStats sph_stats;
+
+// The density pass collects each thread's neighbors in its own buffer; every
+// particle remembers where its run starts, so the force pass reads them back
+// whichever thread handles the particle
+typedef struct ThreadNeighborBuffer {
+    int* indices;
+    long count;
+    long capacity;
+} ThreadNeighborBuffer;
+
+typedef struct NeighborRun {
+    int thread;
+    int count;
+    long begin;
+} NeighborRun;
+
+// Candidates of one partition: its own particles and those of its 8
+// neighbors, copied together
+typedef struct CandidateScratch {
+    int* index;
+    float* x;
+    float* y;
+    float* mass;
+    int count;
+    int capacity;
+} CandidateScratch;
+
+static ThreadNeighborBuffer thread_buffers[THREAD_POOL_MAX_THREADS];
+static CandidateScratch thread_scratch[THREAD_POOL_MAX_THREADS];
+static NeighborRun* neighbor_runs = NULL;   // Indexed by particle
+
+typedef struct DensityContext {
+    ParticleStore* store;
+    const int* sorted;
+    long thread_entries[THREAD_POOL_MAX_THREADS];
+    int thread_max_neighbors[THREAD_POOL_MAX_THREADS];
+    double thread_density[THREAD_POOL_MAX_THREADS];
+} DensityContext;
+
+static float poly6(float r_sq) {
+    float d = smoothing_length_sq - r_sq;
+    return poly6_factor * d * d * d;
+}
+
+int sph_enabled(void) {
+    return sph_active;
+}
+
+float sph_smoothing_length(void) {
+    return smoothing_length;
+}
+
+float sph_rest_density(void) {
+    return rest_density;
+}
+
+float sph_cell_margin(void) {
+    return sph_active ? smoothing_length - 2 * max_radius : 0.0f;
+}
+
+void sph_init(int enabled) {
+    sph_active = enabled;
+    memset(&sph_stats, 0, sizeof(sph_stats));
+    if (!sph_active)
+        return;
+
+    ParticleStore* store = get_particle_store();
+    float mass = 0.0f;
+    max_radius = 0.0f;
+    for (int i = 0; i < store->count; i++) {
+        if (store->radius[i] > max_radius)
+            max_radius = store->radius[i];
+        if (store->mass[i] > mass)
+            mass = store->mass[i];
+    }
+
+    float h = SPH_SMOOTHING_FACTOR * 2 * max_radius;
+    smoothing_length = h;
+    smoothing_length_sq = h * h;
+    poly6_factor = 4.0f / (SPH_PI * powf(h, 8));
+    spiky_gradient_factor = -30.0f / (SPH_PI * powf(h, 5));
+    viscosity_factor = 40.0f / (SPH_PI * powf(h, 5));
+    stiffness = SPH_SOUND_SPEED * SPH_SOUND_SPEED;
+
+    // Rest density: a square lattice of touching particles
+    float spacing = 2 * max_radius;
+    int reach = (int)(h / spacing) + 1;
+    rest_density = 0.0f;
+    for (int a = -reach; a <= reach; a++) {
+        for (int b = -reach; b <= reach; b++) {
+            float r_sq = (a * a + b * b) * spacing * spacing;
+            if (r_sq < smoothing_length_sq)
+                rest_density += mass * poly6(r_sq);
+        }
+    }
+
+    Arena* arena = get_simulation_arena();
+    density = arena_alloc(arena, store->capacity * sizeof(float));
+    pressure = arena_alloc(arena, store->capacity * sizeof(float));
+    neighbor_runs = arena_alloc(arena, store->capacity * sizeof(NeighborRun));
+}
+
+// Per-particle arrays belong to the simulation arena
+void sph_cleanup(void) {
+    for (int t = 0; t < THREAD_POOL_MAX_THREADS; t++) {
+        free(thread_buffers[t].indices);
+        free(thread_scratch[t].index);
+        free(thread_scratch[t].x);
+        free(thread_scratch[t].y);
+        free(thread_scratch[t].mass);
+    }
+    memset(thread_buffers, 0, sizeof(thread_buffers));
+    memset(thread_scratch, 0, sizeof(thread_scratch));
+    density = NULL;
+    pressure = NULL;
+    neighbor_runs = NULL;
+    sph_active = 0;
+}
+
+int sph_substeps(float time_step) {
+    int substeps = (int)ceilf(time_step * SPH_SOUND_SPEED / (SPH_CFL * smoothing_length));
+    sph_stats.substeps = substeps > 1 ? substeps : 1;
+    return sph_stats.substeps;
+}
+
+static void reserve_candidates(CandidateScratch* scratch, int needed) {
+    if (needed <= scratch->capacity)
+        return;
+    int grown = scratch->capacity > 0 ? scratch->capacity : 256;
+    while (grown < needed)
+        grown *= 2;
+    scratch->index = realloc(scratch->index, grown * sizeof(int));
+    scratch->x = realloc(scratch->x, grown * sizeof(float));
+    scratch->y = realloc(scratch->y, grown * sizeof(float));
+    scratch->mass = realloc(scratch->mass, grown * sizeof(float));
+    if (scratch->index == NULL || scratch->x == NULL || scratch->y == NULL || scratch->mass == NULL) {
+        fprintf(stderr, "error: realloc failed for SPH candidates\n");
+        exit(1);
+    }
+    scratch->capacity = grown;
+}
+
+static void reserve_neighbors(ThreadNeighborBuffer* buffer, long needed) {
+    if (needed <= buffer->capacity)
+        return;
+    long grown = buffer->capacity > 0 ? buffer->capacity : 4096;
+    while (grown < needed)
+        grown *= 2;
+    int* resized = realloc(buffer->indices, grown * sizeof(int));
+    if (resized == NULL) {
+        fprintf(stderr, "error: realloc failed for SPH neighbors\n");
+        exit(1);
+    }
+    buffer->indices = resized;
+    buffer->capacity = grown;
+}
+
+// Appends the particles of sorted[begin, end) to the candidates, with their
+// positions and masses copied alongside so the density loop reads them
+// contiguously
+static void collect_candidates(const DensityContext* ctx, CandidateScratch* scratch, int begin, int end) {
+    const ParticleStore* store = ctx->store;
+    for (int m = begin; m < end; m++) {
+        int j = ctx->sorted[m];
+        int c = scratch->count++;
+        scratch->index[c] = j;
+        scratch->x[c] = store->position_x[j];
+        scratch->y[c] = store->position_y[j];
+        scratch->mass[c] = store->mass[j];
+    }
+}
+
+// Density of particle i over all candidates; the ones within h become its
+// neighbors
+static float accumulate_density(const CandidateScratch* scratch, ThreadNeighborBuffer* buffer, int i,
+                                float xi, float yi) {
+    reserve_neighbors(buffer, buffer->count + scratch->count);
+    int* out = buffer->indices + buffer->count;
+    int found = 0;
+    float sum = 0.0f;
+
+    // Branchless: every candidate is written, kept only when within h, and
+    // adds nothing to the density beyond h. The particle itself adds density
+    // but is no neighbor.
+    for (int c = 0; c < scratch->count; c++) {
+        float dx = scratch->x[c] - xi;
+        float dy = scratch->y[c] - yi;
+        float r_sq = dx * dx + dy * dy;
+        float d = fmaxf(smoothing_length_sq - r_sq, 0.0f);
+        sum += scratch->mass[c] * d * d * d;
+        int j = scratch->index[c];
+        out[found] = j;
+        found += (r_sq < smoothing_length_sq) & (j != i);
+    }
+    buffer->count += found;
+    return poly6_factor * sum;
+}
+
+static void density_task(void* context, int thread_index, int begin, int end) {
+    DensityContext* ctx = context;
+    ThreadNeighborBuffer* buffer = &thread_buffers[thread_index];
+    CandidateScratch* scratch = &thread_scratch[thread_index];
+    ParticleStore* store = ctx->store;
+    long entries = 0;
+    int max_neighbors = ctx->thread_max_neighbors[thread_index];
+    double density_sum = 0.0;
+
+    for (int partition = begin; partition < end; partition++) {
+        int partition_begin = get_partition_begin(partition);
+        int partition_end = get_partition_end(partition);
+        if (partition_begin == partition_end)
+            continue;
+
+        // Candidates are shared by every particle of the partition, so they
+        // are gathered once
+        int neighbors[GRID_MAX_NEIGHBORS];
+        int neighbor_count = get_surrounding_partitions(partition, neighbors);
+        int candidates = partition_end - partition_begin;
+        for (int n = 0; n < neighbor_count; n++)
+            candidates += get_partition_end(neighbors[n]) - get_partition_begin(neighbors[n]);
+        reserve_candidates(scratch, candidates);
+        scratch->count = 0;
+        collect_candidates(ctx, scratch, partition_begin, partition_end);
+        for (int n = 0; n < neighbor_count; n++)
+            collect_candidates(ctx, scratch, get_partition_begin(neighbors[n]), get_partition_end(neighbors[n]));
+
+        for (int k = partition_begin; k < partition_end; k++) {
+            int i = ctx->sorted[k];
+            long first = buffer->count;
+            float rho = accumulate_density(scratch, buffer, i, store->position_x[i], store->position_y[i]);
+
+            int count = (int)(buffer->count - first);
+            neighbor_runs[i] = (NeighborRun){ thread_index, count, first };
+            density[i] = rho;
+            pressure[i] = rho > rest_density ? stiffness * (rho - rest_density) : 0.0f;
+
+            entries += count;
+            if (count > max_neighbors)
+                max_neighbors = count;
+            density_sum += rho;
+        }
+    }
+
+    ctx->thread_entries[thread_index] += entries;
+    ctx->thread_max_neighbors[thread_index] = max_neighbors;
+    ctx->thread_density[thread_index] += density_sum;
+}
+
+void sph_compute_density(void) {
+    DensityContext ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.store = get_particle_store();
+    ctx.sorted = get_sorted_particles();
+
+    int threads = thread_pool_size();
+    for (int t = 0; t < threads; t++)
+        thread_buffers[t].count = 0;
+    thread_pool_parallel_for_traced("sph density", get_partition_count(), PARTITION_GRAIN, density_task, &ctx);
+
+    double density_sum = 0.0;
+    sph_stats.neighbor_entries = 0;
+    sph_stats.max_neighbors = 0;
+    for (int t = 0; t < threads; t++) {
+        sph_stats.neighbor_entries += ctx.thread_entries[t];
+        if (ctx.thread_max_neighbors[t] > sph_stats.max_neighbors)
+            sph_stats.max_neighbors = ctx.thread_max_neighbors[t];
+        density_sum += ctx.thread_density[t];
+    }
+    int count = ctx.store->count;
+    sph_stats.mean_density_ratio = count > 0 ? (float)(density_sum / count / rest_density) : 0.0f;
+}
+
+static void force_task(void* context, int thread_index, int begin, int end) {
+    ParticleStore* store = context;
+    (void)thread_index;
+
+    for (int i = begin; i < end; i++) {
+        const NeighborRun* run = &neighbor_runs[i];
+        const int* neighbors = thread_buffers[run->thread].indices + run->begin;
+        float xi = store->position_x[i];
+        float yi = store->position_y[i];
+        float vxi = store->velocity_x[i];
+        float vyi = store->velocity_y[i];
+        float pressure_term = pressure[i] / (density[i] * density[i]);
+        float ax = 0.0f;
+        float ay = 0.0f;
+        float viscous_x = 0.0f;
+        float viscous_y = 0.0f;
+
+        for (int n = 0; n < run->count; n++) {
+            int j = neighbors[n];
+            float dx = xi - store->position_x[j];
+            float dy = yi - store->position_y[j];
+            float r = sqrtf(dx * dx + dy * dy);
+            float q = smoothing_length - r;
+            float mj = store->mass[j];
+
+            // Symmetric pressure term, so pairs push each other equally
+            if (r > 0.0f) {
+                float gradient = spiky_gradient_factor * q * q / r;
+                float scale = -mj * (pressure_term + pressure[j] / (density[j] * density[j])) * gradient;
+                ax += scale * dx;
+                ay += scale * dy;
+            }
+
+            float weight = mj / density[j] * viscosity_factor * q;
+            viscous_x += weight * (store->velocity_x[j] - vxi);
+            viscous_y += weight * (store->velocity_y[j] - vyi);
+        }
+
+        apply_gravity(store, i);
+        store->acceleration_x[i] += ax + SPH_KINEMATIC_VISCOSITY * viscous_x;
+        store->acceleration_y[i] += ay + SPH_KINEMATIC_VISCOSITY * viscous_y;
+    }
+}
+
+void sph_compute_forces(void) {
+    ParticleStore* store = get_particle_store();
+    thread_pool_parallel_for_traced("sph forces", store->count, PARTICLE_GRAIN, force_task, store);
+}
+
+const SphStats* get_sph_stats(void) {
+    return &sph_stats;
+}
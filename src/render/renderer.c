@@ -1,9 +1,9 @@
 #include <SDL2/SDL.h>
 #include "render/renderer.h"
-#include "spatial/grid.h"
-#include "core/math_utils.h"
-#include "core/linked_list.h"
 #include "core/profiler.h"
+#include "core/trace.h"
+#include "physics/forces.h"
+#include "render/profiler_overlay.h"
 #include <stdio.h>
 #include <math.h>
 #include <stdlib.h>
@@ -14,13 +14,17 @@ int window_height = 600;
 SDL_Window* window = NULL;
 SDL_Renderer* renderer = NULL;
 
-float domain_size = 1.0f;
-static float particle_visual_radius = 0.005f;
+static float particle_visual_radius = 0.005f;  // Of the circle texture; quads take each particle's own
 static float pixels_per_meter;
 static SDL_Texture* particle_texture = NULL;
 
+// Quad geometry for every particle, submitted in one SDL_RenderGeometry call
+static SDL_Vertex* particle_vertices = NULL;
+static int* particle_indices = NULL;
+static int geometry_capacity = 0;  // Particles the buffers can hold
+
 static SDL_Texture* create_particle_texture(void);
-static void draw_particle(Particle* p);
+static void draw_particles(const PositionSnapshot* snapshot);
 
 int init_renderer(void) {
     if (SDL_Init(SDL_INIT_VIDEO) < 0) {
@@ -35,12 +39,19 @@ int init_renderer(void) {
         return 0;
     }
 
-    renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_SOFTWARE);
+    // Prefer a hardware renderer; fall back to software when none is available
+    renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_TARGETTEXTURE);
+    if (renderer == NULL)
+        renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_SOFTWARE);
     if (renderer == NULL) {
         fprintf(stderr, "Renderer could not be created! SDL Error: %s\n", SDL_GetError());
         return 0;
     }
 
+    SDL_RendererInfo info;
+    if (SDL_GetRendererInfo(renderer, &info) == 0)
+        printf("Renderer: %s%s\n", info.name, (info.flags & SDL_RENDERER_ACCELERATED) ? " (accelerated)" : "");
+
     particle_visual_radius = 0.005f;
     pixels_per_meter = window_width / domain_size;
 
@@ -52,6 +63,12 @@ int init_renderer(void) {
 }
 
 void shutdown_renderer(void) {
+    free(particle_vertices);
+    free(particle_indices);
+    particle_vertices = NULL;
+    particle_indices = NULL;
+    geometry_capacity = 0;
+
     SDL_DestroyTexture(particle_texture);
     SDL_DestroyRenderer(renderer);
     SDL_DestroyWindow(window);
@@ -60,19 +77,11 @@ void shutdown_renderer(void) {
     SDL_Quit();
 }
 
-void render_frame(void) {
+void render_frame(const PositionSnapshot* snapshot) {
     SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
     SDL_RenderClear(renderer);
 
-    Node* current_partition = get_all_partitions();
-    while (current_partition != NULL) {
-        Node* current = current_partition->item;
-        while (current != NULL) {
-            draw_particle((Particle*)current->item);
-            current = current->next;
-        }
-        current_partition = current_partition->next;
-    }
+    draw_particles(snapshot);
 
     SDL_RenderPresent(renderer);
 }
@@ -99,47 +108,101 @@ static SDL_Texture* create_particle_texture(void) {
     return circle_tex;
 }
 
-static void draw_particle(Particle* p) {
-    float x = (domain_size - p->position[0]) * window_width;
-    float y = (domain_size - p->position[1]) * window_height;
-    int radius = (int)(particle_visual_radius * pixels_per_meter);
+// Grows the vertex/index buffers to hold `count` particle quads. The index
+// pattern never changes, so it is written only when the buffers grow.
+static int reserve_particle_geometry(int count) {
+    if (count <= geometry_capacity)
+        return 1;
 
-    SDL_Rect dst = {
-        .x = (int)x - radius,
-        .y = (int)y - radius,
-        .w = 2 * radius,
-        .h = 2 * radius
-    };
+    SDL_Vertex* vertices = realloc(particle_vertices, (size_t)count * 4 * sizeof(SDL_Vertex));
+    if (vertices == NULL)
+        return 0;
+    particle_vertices = vertices;
 
-    float speed = vector_norm(p->velocity);
-    int r = (int)(150.0f * speed);
-    int g = 255 - r / 2;
-    int b = 255 - r;
+    int* indices = realloc(particle_indices, (size_t)count * 6 * sizeof(int));
+    if (indices == NULL)
+        return 0;
+    particle_indices = indices;
+
+    for (int i = geometry_capacity; i < count; i++) {
+        int v = 4 * i;
+        int* quad = &particle_indices[6 * i];
+        quad[0] = v;
+        quad[1] = v + 1;
+        quad[2] = v + 2;
+        quad[3] = v + 2;
+        quad[4] = v + 3;
+        quad[5] = v;
+
+        // Texture corners are fixed too: top-left, top-right, bottom-right, bottom-left
+        particle_vertices[v].tex_coord = (SDL_FPoint){0.0f, 0.0f};
+        particle_vertices[v + 1].tex_coord = (SDL_FPoint){1.0f, 0.0f};
+        particle_vertices[v + 2].tex_coord = (SDL_FPoint){1.0f, 1.0f};
+        particle_vertices[v + 3].tex_coord = (SDL_FPoint){0.0f, 1.0f};
+    }
 
-    if (r > 255) r = 255;
-    if (g < 0) g = 0;
-    if (b < 0) b = 0;
+    geometry_capacity = count;
+    return 1;
+}
+
+// Fills one textured quad per particle, colored by speed (red = fast,
+// white = slow), and submits all of them with a single draw call
+static void draw_particles(const PositionSnapshot* snapshot) {
+    int count = snapshot->count;
+    if (count == 0)
+        return;
+    if (!reserve_particle_geometry(count)) {
+        fprintf(stderr, "error: malloc failed for particle geometry\n");
+        return;
+    }
 
-    SDL_SetTextureColorMod(particle_texture, r, g, b);
-    SDL_RenderCopy(renderer, particle_texture, NULL, &dst);
+    for (int i = 0; i < count; i++) {
+        // Whole pixels, as the texture is drawn, but never vanishing
+        float radius = (float)(int)(snapshot->radius[i] * pixels_per_meter);
+        if (radius < 1.0f)
+            radius = 1.0f;
+        float x = (domain_size - snapshot->position_x[i]) * pixels_per_meter;
+        float y = (domain_size - snapshot->position_y[i]) * pixels_per_meter;
+
+        int r = (int)(150.0f * snapshot->speed[i]);
+        int g = 255 - r / 2;
+        int b = 255 - r;
+
+        if (r > 255) r = 255;
+        if (g < 0) g = 0;
+        if (b < 0) b = 0;
+
+        SDL_Color color = {(Uint8)r, (Uint8)g, (Uint8)b, 255};
+        SDL_Vertex* quad = &particle_vertices[4 * i];
+        quad[0].position = (SDL_FPoint){x - radius, y - radius};
+        quad[1].position = (SDL_FPoint){x + radius, y - radius};
+        quad[2].position = (SDL_FPoint){x + radius, y + radius};
+        quad[3].position = (SDL_FPoint){x - radius, y + radius};
+        quad[0].color = color;
+        quad[1].color = color;
+        quad[2].color = color;
+        quad[3].color = color;
+    }
+
+    SDL_RenderGeometry(renderer, particle_texture, particle_vertices, 4 * count, particle_indices, 6 * count);
 }
 
-void render_frame_with_profiler(Profiler* prof, int particle_count) {
+void render_frame_with_profiler(const PositionSnapshot* snapshot, Profiler* prof) {
+    TRACE_ZONE_BEGIN("clear");
     SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
     SDL_RenderClear(renderer);
+    TRACE_ZONE_END();
 
-    Node* current_partition = get_all_partitions();
-    while (current_partition != NULL) {
-        Node* current = current_partition->item;
-        while (current != NULL) {
-            draw_particle((Particle*)current->item);
-            current = current->next;
-        }
-        current_partition = current_partition->next;
-    }
+    TRACE_ZONE_BEGIN("draw particles");
+    draw_particles(snapshot);
+    TRACE_ZONE_END();
 
     // Draw profiler metrics overlay
-    profiler_draw_metrics(renderer, prof, particle_count);
+    TRACE_ZONE_BEGIN("metrics overlay");
+    profiler_draw_metrics(renderer, prof, snapshot->count);
+    TRACE_ZONE_END();
 
+    TRACE_ZONE_BEGIN("present");
     SDL_RenderPresent(renderer);
+    TRACE_ZONE_END();
 }
@@ -0,0 +1,49 @@
+#include "spatial/broad_phase.h"
+#include "spatial/neighbor_list.h"
+#include "spatial/sort_and_sweep.h"
+
+static BroadPhase active_backend = BROAD_PHASE_GRID;
+
+void broad_phase_init(BroadPhase backend) {
+    active_backend = backend;
+    if (backend == BROAD_PHASE_SORT_AND_SWEEP)
+        sort_and_sweep_init();
+}
+
+void broad_phase_cleanup(void) {
+    if (active_backend == BROAD_PHASE_SORT_AND_SWEEP)
+        sort_and_sweep_cleanup();
+    active_backend = BROAD_PHASE_GRID;
+}
+
+BroadPhase get_broad_phase(void) {
+    return active_backend;
+}
+
+const char* broad_phase_name(BroadPhase backend) {
+    return backend == BROAD_PHASE_SORT_AND_SWEEP ? "sap" : "grid";
+}
+
+void broad_phase_update(float dt) {
+    if (active_backend == BROAD_PHASE_SORT_AND_SWEEP)
+        sort_and_sweep_update(dt);
+}
+
+int broad_phase_candidates(const int** offsets, const int** indices) {
+    if (active_backend == BROAD_PHASE_SORT_AND_SWEEP) {
+        *offsets = get_sweep_offsets();
+        *indices = get_sweep_indices();
+        return 1;
+    }
+    if (neighbor_list_enabled()) {
+        *offsets = get_neighbor_offsets();
+        *indices = get_neighbor_indices();
+        return 1;
+    }
+    return 0;
+}
+
+void broad_phase_remap(const int* new_index) {
+    if (active_backend == BROAD_PHASE_SORT_AND_SWEEP)
+        sort_and_sweep_remap(new_index);
+}
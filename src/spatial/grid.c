@@ -1,132 +1,706 @@
 #include "spatial/grid.h"
-#include "render/renderer.h"
-#include "core/particle.h"
-#include <stdlib.h>
-#include <stdio.h>
+#include "physics/forces.h"
+#include "core/arena.h"
+#include "core/particle_store.h"
+#include "core/trace.h"
+#include "spatial/spatial_hash.h"
 #include <math.h>
+#include <stdio.h>
+#include <string.h>
 
-static Node* partition_list = NULL;
-static Node** partition_array = NULL;  // O(1) lookup array
+static int* partition_start = NULL;     // Prefix sum: partition p owns [start[p], start[p + 1])
+static int* partition_cursor = NULL;    // Scatter cursor reused by every rebuild
+static int* sorted_particles = NULL;    // Particle indices ordered by partition
+static int* particle_partition = NULL;  // Partition each particle was binned into
+static int* color_partitions = NULL;    // Partition ids grouped by color
+static int color_start[GRID_MAX_LEVELS * GRID_COLOR_COUNT + 1];
 static int num_partitions = 0;
+static int partition_capacity = 0;
+static int grid_dimension = 0;
+static int max_grid_dimension = 0;
+static float cell_size = 0.0f;
+static float min_cell_size = 0.0f;
+static GridBackend grid_backend = GRID_DENSE;
+static size_t grid_memory = 0;
+
+// Levels, see grid.h. Level 0 is the grid of grid_dimension cells of
+// cell_size; each coarser one doubles the cell size.
+typedef struct GridLevel {
+    float cell_size;
+    int dim;                    // GRID_DENSE: cells per side
+    int first_partition;
+    int partition_count;
+    SpatialHash hash;           // GRID_HASHED: occupied cells of the level
+} GridLevel;
+
+static GridLevel grid_levels[GRID_MAX_LEVELS];
+static int level_count = 1;
+static int max_level_count = 1;
+static int hashed_level_count = 0;      // Levels with an allocated hash
+static float max_contact_size = 0.0f;   // Largest collision diameter plus the margin
+static float cell_margin = 0.0f;
+
+// Only allocated when the particles need several levels
+static unsigned char* particle_level = NULL;
+static int* particle_cell_x = NULL;     // Level 0 cell of each particle at the last rebuild
+static int* particle_cell_y = NULL;
+static int* finer_start = NULL;         // Partition p lists finer_particles[finer_start[p], finer_start[p + 1])
+static int* finer_cursor = NULL;
+static int* finer_particles = NULL;
+static int* finer_entry_partition = NULL;   // Finer entries in binning order, before sorting
+static int* finer_entry_particle = NULL;
+
+// GRID_HASHED only: occupied cells and their neighbors, found once per
+// rebuild instead of once per query
+static int* hashed_neighbors = NULL;    // STENCIL_SIZE slots per partition, forward ones first
+static int* hashed_forward_count = NULL;
+static int* hashed_neighbor_count = NULL;
+
+#define FORWARD_STENCIL_SIZE 4
+#define STENCIL_SIZE 8
+
+// The forward half of the 3x3 stencil, then its mirror image
+static const int stencil[STENCIL_SIZE][2] = {
+    {1, 0}, {-1, 1}, {0, 1}, {1, 1},
+    {-1, 0}, {1, -1}, {0, -1}, {-1, -1}
+};
+
+static int cell_color(int cx, int cy) {
+    // Positive remainders, as hashed cells may have negative coordinates
+    return ((cx % 3) + 3) % 3 + 3 * (((cy % 2) + 2) % 2);
+}
 
-Node* compute_partition_for_particle(Node* particle_node) {
-    Particle* particle = particle_node->item;
-    int grid_dim = (int)sqrt(num_partitions);
-    float cell_size = domain_size / grid_dim;
-    int partition_id = (int)(particle->position[0] / cell_size) +
-                       (int)(particle->position[1] / cell_size) * grid_dim;
+static void* alloc_grid_array(size_t bytes) {
+    grid_memory += bytes;
+    return arena_alloc(get_simulation_arena(), bytes);
+}
 
-    if (partition_id >= num_partitions)
-        partition_id = num_partitions - 1;
-    if (partition_id < 0)
-        partition_id = 0;
+// Coordinate, levels_up levels coarser, of the cell holding level 0 cell c;
+// rounds down for the negative coordinates of hashed cells
+static int coarser_coord(int c, int levels_up) {
+    return c >= 0 ? c >> levels_up : ~(~c >> levels_up);
+}
+
+// Levels needed for the largest particle to fit the coarsest cells
+static int levels_for_cell_size(float size) {
+    int count = 1;
+    while (count < max_level_count && size * (1 << (count - 1)) < max_contact_size)
+        count++;
+    return count;
+}
 
-    return partition_array[partition_id];  // O(1) array access
+// The finest level whose cells fit the particle's collision diameter
+static int level_of_radius(float radius) {
+    float contact = 2 * radius + cell_margin;
+    int level = 0;
+    while (level < level_count - 1 && contact > grid_levels[level].cell_size)
+        level++;
+    return level;
 }
 
-void move_particle_to_partition(Node* particle_node, Node* old_partition, Node* new_partition) {
-    list_unlink((Node**)&old_partition->item, particle_node);
-    list_append((Node**)&new_partition->item, particle_node);
+int compute_partition_for_particle(int particle_index) {
+    ParticleStore* store = get_particle_store();
+
+    if (grid_backend == GRID_HASHED) {
+        int cx = (int)floorf(store->position_x[particle_index] / cell_size);
+        int cy = (int)floorf(store->position_y[particle_index] / cell_size);
+        return spatial_hash_find(&grid_levels[0].hash, cx, cy);
+    }
+
+    int x = (int)(store->position_x[particle_index] / cell_size);
+    int y = (int)(store->position_y[particle_index] / cell_size);
+
+    if (x < 0) x = 0;
+    if (x >= grid_dimension) x = grid_dimension - 1;
+    if (y < 0) y = 0;
+    if (y >= grid_dimension) y = grid_dimension - 1;
+
+    return x + y * grid_dimension;
 }
 
-void init_grid(int num_parts) {
-    num_partitions = num_parts;
+// Sets the cell size for grid_dim cells per side; the arrays must already
+// hold grid_dim * grid_dim partitions for GRID_DENSE
+static void configure_grid_dim(int grid_dim) {
+    grid_dimension = grid_dim;
+    cell_size = domain_size / grid_dim;
+    level_count = levels_for_cell_size(cell_size);
 
-    // Allocate O(1) lookup array
-    partition_array = malloc(num_parts * sizeof(Node*));
-    if (partition_array == NULL) {
-        fprintf(stderr, "error: malloc failed for partition array\n");
-        exit(1);
+    int first = 0;
+    for (int level = 0; level < level_count; level++) {
+        GridLevel* grid_level = &grid_levels[level];
+        grid_level->cell_size = cell_size * (1 << level);
+        grid_level->dim = (grid_dim + (1 << level) - 1) >> level;
+        if (grid_backend == GRID_DENSE) {
+            grid_level->first_partition = first;
+            grid_level->partition_count = grid_level->dim * grid_level->dim;
+            first += grid_level->partition_count;
+        }
     }
+    if (grid_backend == GRID_HASHED)
+        return;
 
-    for (int i = 0; i < num_parts; i++) {
-        Node* new_node = malloc(sizeof(Node));
-        if (new_node == NULL) {
-            fprintf(stderr, "error: malloc failed for space partition\n");
-            exit(1);
+    num_partitions = first;
+    int filled = 0;
+    for (int level = 0; level < level_count; level++) {
+        const GridLevel* grid_level = &grid_levels[level];
+        for (int color = 0; color < GRID_COLOR_COUNT; color++) {
+            color_start[level * GRID_COLOR_COUNT + color] = filled;
+            for (int local = 0; local < grid_level->partition_count; local++) {
+                int x = local % grid_level->dim;
+                int y = local / grid_level->dim;
+                if ((x % 3) + 3 * (y % 2) == color)
+                    color_partitions[filled++] = grid_level->first_partition + local;
+            }
         }
-        new_node->item = NULL;
-        new_node->next = NULL;
-        list_append(&partition_list, new_node);
-        partition_array[i] = new_node;  // Store in array for O(1) access
     }
+    color_start[level_count * GRID_COLOR_COUNT] = filled;
 }
 
-Node** get_adjacent_partitions(Node* partition_node) {
-    static Node* neighbors[8];
-    int count = 0;
+void init_grid(int grid_dim, float margin, GridBackend backend, int max_levels) {
+    ParticleStore* store = get_particle_store();
+
+    // Neighbor search only looks one cell away, so a cell may never be
+    // narrower than the largest collision diameter on its level plus the
+    // margin.
+    float max_radius = 0.0f;
+    float min_radius = 0.0f;
+    for (int i = 0; i < store->count; i++) {
+        if (store->radius[i] > max_radius)
+            max_radius = store->radius[i];
+        if (i == 0 || store->radius[i] < min_radius)
+            min_radius = store->radius[i];
+    }
+    max_contact_size = 2 * max_radius + margin;
+    cell_margin = margin;
+    max_level_count = max_levels < 1 ? 1 : max_levels > GRID_MAX_LEVELS ? GRID_MAX_LEVELS : max_levels;
+
+    // Every coarser level doubles the cell size, so once the coarsest level
+    // fits the largest particles the finest only has to fit the smallest
+    min_cell_size = max_contact_size;
+    for (int level = 1; level < max_level_count && min_cell_size / 2 >= 2 * min_radius + margin; level++)
+        min_cell_size /= 2;
+    int max_dim = min_cell_size > 0 ? (int)(domain_size / min_cell_size) : 1;
+    if (max_dim < 1)
+        max_dim = 1;
+
+    // Cells of exactly the minimum size test the fewest candidates. Dense
+    // grids stop short of that when most of those cells would stay empty.
+    int auto_dim = max_dim;
+    if (backend == GRID_DENSE) {
+        int particles = store->capacity > 1 ? store->capacity : 1;
+        int dense_dim = (int)sqrt((double)GRID_DENSE_MAX_CELLS_PER_PARTICLE * particles);
+        if (dense_dim < auto_dim)
+            auto_dim = dense_dim > 0 ? dense_dim : 1;
+    }
+
+    if (grid_dim <= 0) {
+        grid_dim = auto_dim;
+    } else if (grid_dim > max_dim) {
+        printf("Grid dimension %d too fine for cell size %.4f, using %d\n", grid_dim, min_cell_size, max_dim);
+        grid_dim = max_dim;
+    }
+
+    grid_backend = backend;
+    grid_memory = 0;
+    // set_grid_dim() may later pick any size up to this one
+    max_grid_dimension = backend == GRID_HASHED ? max_dim : grid_dim;
+
+    // The finest cells set_grid_dim() may pick need the most levels
+    int levels = levels_for_cell_size(domain_size / max_grid_dimension);
+
+    // Grid arrays live as long as the simulation, so they come from its
+    // arena. A hashed level can never have more occupied cells than particles.
+    partition_capacity = 0;
+    for (int level = 0; level < levels; level++) {
+        int dim = (max_grid_dimension + (1 << level) - 1) >> level;
+        partition_capacity += backend == GRID_HASHED ? store->capacity : dim * dim;
+    }
+    num_partitions = 0;
+    partition_start = alloc_grid_array((partition_capacity + 1) * sizeof(int));
+    partition_cursor = alloc_grid_array(partition_capacity * sizeof(int));
+    sorted_particles = alloc_grid_array(store->capacity * sizeof(int));
+    particle_partition = alloc_grid_array(store->capacity * sizeof(int));
+    color_partitions = alloc_grid_array(partition_capacity * sizeof(int));
+
+    memset(partition_start, 0, (partition_capacity + 1) * sizeof(int));
+    memset(color_start, 0, sizeof(color_start));
+
+    if (levels > 1) {
+        size_t entries = (size_t)store->capacity * (levels - 1);
+        particle_level = alloc_grid_array(store->capacity);
+        particle_cell_x = alloc_grid_array(store->capacity * sizeof(int));
+        particle_cell_y = alloc_grid_array(store->capacity * sizeof(int));
+        finer_start = alloc_grid_array((partition_capacity + 1) * sizeof(int));
+        finer_cursor = alloc_grid_array(partition_capacity * sizeof(int));
+        finer_particles = alloc_grid_array(entries * sizeof(int));
+        finer_entry_partition = alloc_grid_array(entries * sizeof(int));
+        finer_entry_particle = alloc_grid_array(entries * sizeof(int));
+    }
+
+    if (backend == GRID_HASHED) {
+        hashed_level_count = levels;
+        for (int level = 0; level < levels; level++) {
+            SpatialHash* hash = &grid_levels[level].hash;
+            spatial_hash_init(hash, store->capacity);
+            grid_memory += (hash->mask + 1) * sizeof(SpatialHashEntry) + 2 * store->capacity * sizeof(int);
+        }
+        hashed_neighbors = alloc_grid_array(partition_capacity * STENCIL_SIZE * sizeof(int));
+        hashed_forward_count = alloc_grid_array(partition_capacity * sizeof(int));
+        hashed_neighbor_count = alloc_grid_array(partition_capacity * sizeof(int));
+    }
+
+    configure_grid_dim(grid_dim);
+}
+
+int set_grid_dim(int grid_dim) {
+    if (grid_dim > max_grid_dimension)
+        grid_dim = max_grid_dimension;
+    if (grid_dim < 1)
+        grid_dim = 1;
+
+    configure_grid_dim(grid_dim);
+    rebuild_grid();
+    return grid_dim;
+}
 
-    // Find partition_id using array (O(n) but only once, not per neighbor)
-    int partition_id = -1;
-    for (int i = 0; i < num_partitions; i++) {
-        if (partition_array[i] == partition_node) {
-            partition_id = i;
-            break;
+// Inserts every particle's cell into the hash, numbering cells in the order
+// particles first reach them
+static void bin_hashed_particles(ParticleStore* store) {
+    SpatialHash* hash = &grid_levels[0].hash;
+    spatial_hash_clear(hash);
+    for (int i = 0; i < store->count; i++) {
+        int cx = (int)floorf(store->position_x[i] / cell_size);
+        int cy = (int)floorf(store->position_y[i] / cell_size);
+        particle_partition[i] = spatial_hash_insert(hash, cx, cy);
+    }
+    num_partitions = hash->count;
+    grid_levels[0].first_partition = 0;
+    grid_levels[0].partition_count = num_partitions;
+}
+
+// Local id of the level's cell holding level 0 cell (cx, cy); hashed levels
+// add the cell when it is new
+static int level_cell(GridLevel* grid_level, int level, int cx, int cy) {
+    int x = coarser_coord(cx, level);
+    int y = coarser_coord(cy, level);
+    if (grid_backend == GRID_HASHED)
+        return spatial_hash_insert(&grid_level->hash, x, y);
+    return x + y * grid_level->dim;
+}
+
+// Bins every particle on its own level and, as a finer entry, in the
+// partition holding it on every coarser level. Returns the finer entries.
+static int bin_levels(ParticleStore* store) {
+    int count = store->count;
+    for (int i = 0; i < count; i++) {
+        particle_level[i] = (unsigned char)level_of_radius(store->radius[i]);
+        int cx, cy;
+        if (grid_backend == GRID_HASHED) {
+            cx = (int)floorf(store->position_x[i] / cell_size);
+            cy = (int)floorf(store->position_y[i] / cell_size);
+        } else {
+            int partition = compute_partition_for_particle(i);
+            cx = partition % grid_dimension;
+            cy = partition / grid_dimension;
+        }
+        particle_cell_x[i] = cx;
+        particle_cell_y[i] = cy;
+    }
+
+    // Level by level, so each level's partitions follow the finer ones
+    int entries = 0;
+    int first = 0;
+    for (int level = 0; level < level_count; level++) {
+        GridLevel* grid_level = &grid_levels[level];
+        if (grid_backend == GRID_HASHED)
+            spatial_hash_clear(&grid_level->hash);
+        grid_level->first_partition = first;
+        for (int i = 0; i < count; i++) {
+            if (particle_level[i] > level)
+                continue;
+            int partition = first + level_cell(grid_level, level, particle_cell_x[i], particle_cell_y[i]);
+            if (particle_level[i] == level) {
+                particle_partition[i] = partition;
+            } else {
+                finer_entry_partition[entries] = partition;
+                finer_entry_particle[entries] = i;
+                entries++;
+            }
         }
+        if (grid_backend == GRID_HASHED)
+            grid_level->partition_count = grid_level->hash.count;
+        first += grid_level->partition_count;
     }
-    if (partition_id == -1) {
-        while (count < 8)
-            neighbors[count++] = NULL;
-        return neighbors;
+    num_partitions = first;
+    return entries;
+}
+
+// Counting sort of the finer entries by partition, stable like the particles
+static void sort_finer_entries(int entries) {
+    memset(finer_cursor, 0, num_partitions * sizeof(int));
+    for (int e = 0; e < entries; e++)
+        finer_cursor[finer_entry_partition[e]]++;
+
+    int offset = 0;
+    for (int p = 0; p < num_partitions; p++) {
+        int size = finer_cursor[p];
+        finer_start[p] = offset;
+        finer_cursor[p] = offset;
+        offset += size;
+    }
+    finer_start[num_partitions] = offset;
+
+    for (int e = 0; e < entries; e++)
+        finer_particles[finer_cursor[finer_entry_partition[e]]++] = finer_entry_particle[e];
+}
+
+// Colors and neighbors of the occupied cells of every level
+static void index_hashed_partitions(void) {
+    int color_total = level_count * GRID_COLOR_COUNT;
+    int color_count[GRID_MAX_LEVELS * GRID_COLOR_COUNT] = {0};
+    for (int level = 0; level < level_count; level++) {
+        const SpatialHash* hash = &grid_levels[level].hash;
+        for (int local = 0; local < grid_levels[level].partition_count; local++)
+            color_count[level * GRID_COLOR_COUNT + cell_color(hash->cell_x[local], hash->cell_y[local])]++;
+    }
+
+    int offset = 0;
+    int color_cursor[GRID_MAX_LEVELS * GRID_COLOR_COUNT];
+    for (int color = 0; color < color_total; color++) {
+        color_start[color] = offset;
+        color_cursor[color] = offset;
+        offset += color_count[color];
     }
+    color_start[color_total] = offset;
 
-    int grid_dim = (int)sqrt(num_partitions);
-    int x = partition_id % grid_dim;
-    int y = partition_id / grid_dim;
+    for (int level = 0; level < level_count; level++) {
+        GridLevel* grid_level = &grid_levels[level];
+        for (int local = 0; local < grid_level->partition_count; local++) {
+            int p = grid_level->first_partition + local;
+            int cx = grid_level->hash.cell_x[local];
+            int cy = grid_level->hash.cell_y[local];
+            color_partitions[color_cursor[level * GRID_COLOR_COUNT + cell_color(cx, cy)]++] = p;
+
+            int count = 0;
+            for (int s = 0; s < STENCIL_SIZE; s++) {
+                if (s == FORWARD_STENCIL_SIZE)
+                    hashed_forward_count[p] = count;
+                int neighbor = spatial_hash_find(&grid_level->hash, cx + stencil[s][0], cy + stencil[s][1]);
+                if (neighbor >= 0)
+                    hashed_neighbors[p * STENCIL_SIZE + count++] = grid_level->first_partition + neighbor;
+            }
+            hashed_neighbor_count[p] = count;
+        }
+    }
+}
+
+void rebuild_grid(void) {
+    TRACE_SCOPE("rebuild_grid");
+    ParticleStore* store = get_particle_store();
+    int count = store->count;
+    int finer_entries = 0;
+
+    // Histogram of particles per partition
+    if (level_count > 1) {
+        finer_entries = bin_levels(store);
+        memset(partition_cursor, 0, num_partitions * sizeof(int));
+        for (int i = 0; i < count; i++)
+            partition_cursor[particle_partition[i]]++;
+    } else if (grid_backend == GRID_HASHED) {
+        bin_hashed_particles(store);
+        memset(partition_cursor, 0, num_partitions * sizeof(int));
+        for (int i = 0; i < count; i++)
+            partition_cursor[particle_partition[i]]++;
+    } else {
+        memset(partition_cursor, 0, num_partitions * sizeof(int));
+        for (int i = 0; i < count; i++) {
+            int partition = compute_partition_for_particle(i);
+            particle_partition[i] = partition;
+            partition_cursor[partition]++;
+        }
+    }
 
+    // Exclusive prefix sum turns counts into range starts
+    int offset = 0;
+    for (int p = 0; p < num_partitions; p++) {
+        int partition_size = partition_cursor[p];
+        partition_start[p] = offset;
+        partition_cursor[p] = offset;
+        offset += partition_size;
+    }
+    partition_start[num_partitions] = offset;
+
+    // Stable scatter keeps particles in index order within a partition
+    for (int i = 0; i < count; i++)
+        sorted_particles[partition_cursor[particle_partition[i]]++] = i;
+
+    if (level_count > 1)
+        sort_finer_entries(finer_entries);
+    if (grid_backend == GRID_HASHED)
+        index_hashed_partitions();
+}
+
+int get_adjacent_partitions(int partition_id, int* neighbors) {
+    int count = 0;
+
+    if (partition_id < 0 || partition_id >= num_partitions)
+        return 0;
+
+    if (grid_backend == GRID_HASHED) {
+        count = hashed_forward_count[partition_id];
+        for (int n = 0; n < count; n++)
+            neighbors[n] = hashed_neighbors[partition_id * STENCIL_SIZE + n];
+        return count;
+    }
+
+    const GridLevel* grid_level = &grid_levels[get_partition_level(partition_id)];
+    int dim = grid_level->dim;
+    int first = grid_level->first_partition;
+    int x = (partition_id - first) % dim;
+    int y = (partition_id - first) / dim;
+
+    // Forward half of the 3x3 stencil: (+1, 0) and the three cells above.
+    // Each unordered pair of neighboring partitions is visited exactly once.
     for (int dy = 0; dy <= 1; dy++) {
-        int dx_start = (dy == 0) ? 1 : 0;
+        int dx_start = (dy == 0) ? 1 : -1;
         for (int dx = dx_start; dx <= 1; dx++) {
-            if (dx == 0 && dy == 0) continue;
-
             int nx = x + dx;
             int ny = y + dy;
 
-            if (nx >= 0 && nx < grid_dim && ny >= 0 && ny < grid_dim) {
-                int neighbor_id = nx + ny * grid_dim;
-                neighbors[count++] = partition_array[neighbor_id];  // O(1) array access
-            }
+            if (nx >= 0 && nx < dim && ny >= 0 && ny < dim)
+                neighbors[count++] = first + nx + ny * dim;
         }
     }
 
-    while (count < 8)
-        neighbors[count++] = NULL;
+    return count;
+}
+
+int get_surrounding_partitions(int partition_id, int* neighbors) {
+    int count = 0;
+
+    if (partition_id < 0 || partition_id >= num_partitions)
+        return 0;
+
+    if (grid_backend == GRID_HASHED) {
+        count = hashed_neighbor_count[partition_id];
+        for (int n = 0; n < count; n++)
+            neighbors[n] = hashed_neighbors[partition_id * STENCIL_SIZE + n];
+        return count;
+    }
+
+    const GridLevel* grid_level = &grid_levels[get_partition_level(partition_id)];
+    int dim = grid_level->dim;
+    int first = grid_level->first_partition;
+    int x = (partition_id - first) % dim;
+    int y = (partition_id - first) / dim;
+    for (int s = 0; s < STENCIL_SIZE; s++) {
+        int nx = x + stencil[s][0];
+        int ny = y + stencil[s][1];
+        if (nx >= 0 && nx < dim && ny >= 0 && ny < dim)
+            neighbors[count++] = first + nx + ny * dim;
+    }
+    return count;
+}
+
+int get_grid_color_count(void) {
+    return level_count * GRID_COLOR_COUNT;
+}
+
+const int* get_partitions_of_color(int color, int* count) {
+    *count = color_start[color + 1] - color_start[color];
+    return color_partitions + color_start[color];
+}
+
+int get_partition_begin(int partition) {
+    return partition_start[partition];
+}
+
+int get_partition_end(int partition) {
+    return partition_start[partition + 1];
+}
+
+const int* get_sorted_particles(void) {
+    return sorted_particles;
+}
 
-    return neighbors;
+int get_particle_partition(int particle_index) {
+    return particle_partition[particle_index];
 }
 
-Node* get_all_partitions(void) {
-    return partition_list;
+// Partition of the level's cell (x, y), which some particle was binned into
+static int level_partition(int level, int x, int y) {
+    GridLevel* grid_level = &grid_levels[level];
+    if (grid_backend == GRID_HASHED)
+        return grid_level->first_partition + spatial_hash_find(&grid_level->hash, x, y);
+    return grid_level->first_partition + x + y * grid_level->dim;
+}
+
+// A pair across levels is met on the coarser particle's level, where the
+// finer particle counts by the cell it is listed in
+static int cross_level_pair_partition(int a, int b) {
+    int level = particle_level[a] > particle_level[b] ? particle_level[a] : particle_level[b];
+    int ax = coarser_coord(particle_cell_x[a], level);
+    int ay = coarser_coord(particle_cell_y[a], level);
+    int bx = coarser_coord(particle_cell_x[b], level);
+    int by = coarser_coord(particle_cell_y[b], level);
+    int dx = bx - ax;
+    int dy = by - ay;
+    if (dx < -1 || dx > 1 || dy < -1 || dy > 1)
+        return -1;
+    if (dx == 0 && dy == 0)
+        return particle_partition[particle_level[a] == level ? a : b];
+    if (grid_offset_is_forward(dx, dy))
+        return particle_level[a] == level ? particle_partition[a] : level_partition(level, ax, ay);
+    return particle_level[b] == level ? particle_partition[b] : level_partition(level, bx, by);
+}
+
+int get_pair_partition(int a, int b) {
+    int pa = particle_partition[a];
+    int pb = particle_partition[b];
+    if (pa == pb)
+        return pa;
+    if (level_count > 1 && particle_level[a] != particle_level[b])
+        return cross_level_pair_partition(a, b);
+
+    int ax, ay, bx, by;
+    get_partition_coords(pa, &ax, &ay);
+    get_partition_coords(pb, &bx, &by);
+    int dx = bx - ax;
+    int dy = by - ay;
+    if (dx < -1 || dx > 1 || dy < -1 || dy > 1)
+        return -1;
+    return grid_offset_is_forward(dx, dy) ? pa : pb;
 }
 
 int get_partition_count(void) {
     return num_partitions;
 }
 
-void cleanup_grid(void) {
-    Node* partition_node = partition_list;
-    while (partition_node != NULL) {
-        Node* particle_node = partition_node->item;
-        while (particle_node != NULL) {
-            Node* next_particle = particle_node->next;
-            free(particle_node->item);
-            free(particle_node);
-            particle_node = next_particle;
-        }
-        partition_node->item = NULL;
-        partition_node = partition_node->next;
+int get_partition_capacity(void) {
+    return partition_capacity;
+}
+
+void get_partition_coords(int partition, int* cx, int* cy) {
+    const GridLevel* grid_level = &grid_levels[get_partition_level(partition)];
+    int local = partition - grid_level->first_partition;
+    if (grid_backend == GRID_HASHED) {
+        *cx = grid_level->hash.cell_x[local];
+        *cy = grid_level->hash.cell_y[local];
+    } else {
+        *cx = local % grid_level->dim;
+        *cy = local / grid_level->dim;
+    }
+}
+
+int get_grid_level_count(void) {
+    return level_count;
+}
+
+int get_partition_level(int partition) {
+    int level = level_count - 1;
+    while (level > 0 && partition < grid_levels[level].first_partition)
+        level--;
+    return level;
+}
+
+int get_particle_level(int particle_index) {
+    return level_count > 1 ? particle_level[particle_index] : 0;
+}
+
+const int* get_partition_finer(int partition, int* count) {
+    if (level_count == 1) {
+        *count = 0;
+        return NULL;
     }
+    *count = finer_start[partition + 1] - finer_start[partition];
+    return finer_particles + finer_start[partition];
+}
+
+void get_grid_level_stats(int level, GridLevelStats* stats) {
+    memset(stats, 0, sizeof(*stats));
+    if (level < 0 || level >= level_count)
+        return;
 
-    partition_node = partition_list;
-    while (partition_node != NULL) {
-        Node* next_partition = partition_node->next;
-        free(partition_node);
-        partition_node = next_partition;
+    const GridLevel* grid_level = &grid_levels[level];
+    int first = grid_level->first_partition;
+    int end = first + grid_level->partition_count;
+    stats->cell_size = grid_level->cell_size;
+    stats->partitions = grid_level->partition_count;
+    for (int p = first; p < end; p++) {
+        int size = partition_start[p + 1] - partition_start[p];
+        stats->particles += size;
+        stats->occupied += size > 0;
+        if (size > stats->max_occupancy)
+            stats->max_occupancy = size;
     }
+    if (level_count > 1)
+        stats->finer = finer_start[end] - finer_start[first];
+}
 
-    partition_list = NULL;
-    
-    free(partition_array);
-    partition_array = NULL;
+int get_grid_dim(void) {
+    return grid_dimension;
+}
+
+int get_max_grid_dim(void) {
+    return max_grid_dimension;
+}
+
+float get_grid_cell_size(void) {
+    return cell_size;
+}
+
+float get_grid_min_cell_size(void) {
+    return min_cell_size;
+}
+
+GridBackend get_grid_backend(void) {
+    return grid_backend;
+}
+
+const char* grid_backend_name(GridBackend backend) {
+    return backend == GRID_HASHED ? "hash" : "dense";
+}
+
+size_t get_grid_memory(void) {
+    return grid_memory;
+}
+
+float get_grid_probe_length(void) {
+    long probes = 0;
+    long lookups = 0;
+    for (int level = 0; level < hashed_level_count; level++) {
+        probes += grid_levels[level].hash.probes;
+        lookups += grid_levels[level].hash.lookups;
+    }
+    if (grid_backend != GRID_HASHED || lookups == 0)
+        return 0.0f;
+    return (float)probes / lookups;
+}
+
+// The arrays belong to the simulation arena and are released with it
+void cleanup_grid(void) {
+    partition_start = NULL;
+    color_partitions = NULL;
+    partition_cursor = NULL;
+    sorted_particles = NULL;
+    particle_partition = NULL;
+    hashed_neighbors = NULL;
+    hashed_forward_count = NULL;
+    hashed_neighbor_count = NULL;
+    particle_level = NULL;
+    particle_cell_x = NULL;
+    particle_cell_y = NULL;
+    finer_start = NULL;
+    finer_cursor = NULL;
+    finer_particles = NULL;
+    finer_entry_partition = NULL;
+    finer_entry_particle = NULL;
+    for (int level = 0; level < hashed_level_count; level++)
+        spatial_hash_free(&grid_levels[level].hash);
+    hashed_level_count = 0;
     num_partitions = 0;
+    partition_capacity = 0;
+    grid_dimension = 0;
+    level_count = 1;
+    max_level_count = 1;
 }
@@ -0,0 +1,64 @@
+#include "spatial/grid_autotune.h"
+#include "spatial/grid.h"
+#include "spatial/neighbor_list.h"
+#include "physics/forces.h"
+#include "physics/integrator.h"
+#include "core/particle_store.h"
+#include "core/profiler.h"
+#include "core/trace.h"
+#include <string.h>
+
+// Restores the saved state and rebins it into a grid of grid_dim cells per
+// side. Returns the dimension the grid accepted.
+static int restore_with_grid(ParticleStore* store, const ParticleStore* saved, int grid_dim) {
+    particle_store_copy(store, saved);
+    grid_dim = set_grid_dim(grid_dim);
+    if (neighbor_list_enabled())
+        neighbor_list_build();
+    return grid_dim;
+}
+
+void grid_autotune(int steps_per_candidate, float dt, GridAutotuneResult* result) {
+    TRACE_SCOPE("grid autotune");
+    memset(result, 0, sizeof(*result));
+    result->grid_dims[0] = get_grid_dim();
+    result->candidates = 1;
+    if (steps_per_candidate <= 0)
+        return;
+
+    ParticleStore* store = get_particle_store();
+    // Arena-backed like the store itself; only needed during warm-up
+    static ParticleStore saved = {0};
+    if (saved.capacity < store->capacity)
+        particle_store_init(&saved, store->capacity);
+    particle_store_copy(&saved, store);
+
+    // Candidate dimensions, coarsest last, without repeats
+    static const float factors[] = GRID_AUTOTUNE_FACTORS;
+    float min_cell = get_grid_min_cell_size();
+    result->candidates = 0;
+    for (int f = 0; f < GRID_AUTOTUNE_MAX_CANDIDATES; f++) {
+        int grid_dim = min_cell > 0 ? (int)(domain_size / (min_cell * factors[f])) : 1;
+        if (grid_dim > get_max_grid_dim())
+            grid_dim = get_max_grid_dim();
+        if (grid_dim < 1)
+            grid_dim = 1;
+        if (result->candidates > 0 && result->grid_dims[result->candidates - 1] == grid_dim)
+            continue;
+        result->grid_dims[result->candidates++] = grid_dim;
+    }
+
+    for (int c = 0; c < result->candidates; c++) {
+        result->grid_dims[c] = restore_with_grid(store, &saved, result->grid_dims[c]);
+
+        uint64_t start = profiler_now_ns();
+        for (int step = 0; step < steps_per_candidate; step++)
+            physics_step(dt);
+        result->ms_per_step[c] = (profiler_now_ns() - start) / 1.0e6 / steps_per_candidate;
+
+        if (result->ms_per_step[c] < result->ms_per_step[result->best])
+            result->best = c;
+    }
+
+    restore_with_grid(store, &saved, result->grid_dims[result->best]);
+}
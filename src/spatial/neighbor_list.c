@@ -0,0 +1,239 @@
+#include "spatial/neighbor_list.h"
+#include "spatial/grid.h"
+#include "core/arena.h"
+#include "core/particle_store.h"
+#include "core/thread_pool.h"
+#include "core/trace.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PARTITION_GRAIN 4
+#define PARTICLE_GRAIN 1024
+
+static float list_skin = 0.0f;
+static int* neighbor_offsets = NULL;    // Indexed by sorted slot, count + 1 entries
+static int* neighbor_indices = NULL;
+static long neighbor_capacity = 0;
+static float* reference_x = NULL;       // Positions at the last build
+static float* reference_y = NULL;
+static NeighborListStats list_stats;
+
+// Each thread collects the lists of the partitions it builds in its own
+// buffer; the build then copies them into one array in sorted order
+typedef struct ThreadNeighborBuffer {
+    int* indices;
+    long count;
+    long capacity;
+} ThreadNeighborBuffer;
+
+typedef struct PartitionSource {
+    int thread;
+    long begin;                 // Start of the partition's lists in that thread's buffer
+} PartitionSource;
+
+static ThreadNeighborBuffer thread_buffers[THREAD_POOL_MAX_THREADS];
+static PartitionSource* partition_sources = NULL;
+
+typedef struct BuildContext {
+    ParticleStore* store;
+    const int* sorted;
+} BuildContext;
+
+typedef struct DisplacementContext {
+    ParticleStore* store;
+    float thread_max[THREAD_POOL_MAX_THREADS];
+} DisplacementContext;
+
+int neighbor_list_enabled(void) {
+    return list_skin > 0.0f;
+}
+
+float neighbor_list_skin(void) {
+    return list_skin;
+}
+
+void neighbor_list_init(float skin) {
+    list_skin = skin > 0.0f ? skin : 0.0f;
+    memset(&list_stats, 0, sizeof(list_stats));
+    if (!neighbor_list_enabled())
+        return;
+
+    ParticleStore* store = get_particle_store();
+    Arena* arena = get_simulation_arena();
+    neighbor_offsets = arena_alloc(arena, (store->capacity + 1) * sizeof(int));
+    reference_x = arena_alloc(arena, store->capacity * sizeof(float));
+    reference_y = arena_alloc(arena, store->capacity * sizeof(float));
+    partition_sources = arena_alloc(arena, get_partition_capacity() * sizeof(PartitionSource));
+
+    neighbor_list_build();
+}
+
+// Offsets, reference positions and partition sources belong to the
+// simulation arena
+void neighbor_list_cleanup(void) {
+    for (int t = 0; t < THREAD_POOL_MAX_THREADS; t++)
+        free(thread_buffers[t].indices);
+    memset(thread_buffers, 0, sizeof(thread_buffers));
+    free(neighbor_indices);
+    neighbor_indices = NULL;
+    neighbor_capacity = 0;
+    neighbor_offsets = NULL;
+    reference_x = NULL;
+    reference_y = NULL;
+    partition_sources = NULL;
+    list_skin = 0.0f;
+}
+
+static void reserve_indices(int** indices, long* capacity, long needed) {
+    if (needed <= *capacity)
+        return;
+    long grown = *capacity > 0 ? *capacity : 4096;
+    while (grown < needed)
+        grown *= 2;
+    int* resized = realloc(*indices, grown * sizeof(int));
+    if (resized == NULL) {
+        fprintf(stderr, "error: realloc failed for neighbor lists\n");
+        exit(1);
+    }
+    *indices = resized;
+    *capacity = grown;
+}
+
+// Appends every particle of sorted[begin, end) within reach of particle i
+static void scan_candidates(const BuildContext* ctx, ThreadNeighborBuffer* buffer, int i, int begin, int end) {
+    ParticleStore* store = ctx->store;
+    float xi = store->position_x[i];
+    float yi = store->position_y[i];
+    float ri = store->radius[i] + list_skin;
+
+    reserve_indices(&buffer->indices, &buffer->capacity, buffer->count + (end - begin));
+    int* out = buffer->indices + buffer->count;
+    int found = 0;
+
+    for (int m = begin; m < end; m++) {
+        int j = ctx->sorted[m];
+        float dx = store->position_x[j] - xi;
+        float dy = store->position_y[j] - yi;
+        float reach = ri + store->radius[j];
+        // Written unconditionally, kept only when within reach
+        out[found] = j;
+        found += dx * dx + dy * dy < reach * reach;
+    }
+    buffer->count += found;
+}
+
+static void build_partitions_task(void* context, int thread_index, int begin, int end) {
+    BuildContext* ctx = context;
+    ThreadNeighborBuffer* buffer = &thread_buffers[thread_index];
+
+    for (int partition = begin; partition < end; partition++) {
+        int neighbors[GRID_MAX_NEIGHBORS];
+        int neighbor_count = get_adjacent_partitions(partition, neighbors);
+        int partition_end = get_partition_end(partition);
+
+        partition_sources[partition].thread = thread_index;
+        partition_sources[partition].begin = buffer->count;
+
+        for (int k = get_partition_begin(partition); k < partition_end; k++) {
+            int i = ctx->sorted[k];
+            long first = buffer->count;
+            scan_candidates(ctx, buffer, i, k + 1, partition_end);
+            for (int n = 0; n < neighbor_count; n++)
+                scan_candidates(ctx, buffer, i, get_partition_begin(neighbors[n]), get_partition_end(neighbors[n]));
+            // Stored one slot ahead for the prefix sum
+            neighbor_offsets[k + 1] = (int)(buffer->count - first);
+        }
+    }
+}
+
+static void copy_partition_lists_task(void* context, int thread_index, int begin, int end) {
+    (void)context;
+    (void)thread_index;
+
+    for (int partition = begin; partition < end; partition++) {
+        int first = neighbor_offsets[get_partition_begin(partition)];
+        int count = neighbor_offsets[get_partition_end(partition)] - first;
+        const PartitionSource* source = &partition_sources[partition];
+        if (count > 0)
+            memcpy(neighbor_indices + first, thread_buffers[source->thread].indices + source->begin,
+                   count * sizeof(int));
+    }
+}
+
+void neighbor_list_build(void) {
+    TRACE_SCOPE("build neighbor lists");
+    ParticleStore* store = get_particle_store();
+    BuildContext ctx = { store, get_sorted_particles() };
+    int count = store->count;
+
+    for (int t = 0; t < thread_pool_size(); t++)
+        thread_buffers[t].count = 0;
+    neighbor_offsets[0] = 0;
+    thread_pool_parallel_for(get_partition_count(), PARTITION_GRAIN, build_partitions_task, &ctx);
+
+    int max_neighbors = 0;
+    for (int k = 0; k < count; k++) {
+        if (neighbor_offsets[k + 1] > max_neighbors)
+            max_neighbors = neighbor_offsets[k + 1];
+        neighbor_offsets[k + 1] += neighbor_offsets[k];
+    }
+
+    long entries = neighbor_offsets[count];
+    reserve_indices(&neighbor_indices, &neighbor_capacity, entries);
+    thread_pool_parallel_for(get_partition_count(), PARTITION_GRAIN * 16, copy_partition_lists_task, NULL);
+
+    memcpy(reference_x, store->position_x, count * sizeof(float));
+    memcpy(reference_y, store->position_y, count * sizeof(float));
+
+    list_stats.rebuilds++;
+    list_stats.entries = entries;
+    list_stats.max_neighbors = max_neighbors;
+}
+
+static void max_displacement_task(void* context, int thread_index, int begin, int end) {
+    DisplacementContext* ctx = context;
+    ParticleStore* store = ctx->store;
+    float max_reach = ctx->thread_max[thread_index];
+
+    for (int i = begin; i < end; i++) {
+        float dx = store->position_x[i] - reference_x[i];
+        float dy = store->position_y[i] - reference_y[i];
+        float reach = sqrtf(dx * dx + dy * dy);
+        if (reach > max_reach)
+            max_reach = reach;
+    }
+    ctx->thread_max[thread_index] = max_reach;
+}
+
+int neighbor_list_needs_rebuild(void) {
+    DisplacementContext ctx;
+    ctx.store = get_particle_store();
+    int threads = thread_pool_size();
+    for (int t = 0; t < threads; t++)
+        ctx.thread_max[t] = 0.0f;
+
+    thread_pool_parallel_for(ctx.store->count, PARTICLE_GRAIN, max_displacement_task, &ctx);
+
+    float max_displacement = 0.0f;
+    for (int t = 0; t < threads; t++)
+        if (ctx.thread_max[t] > max_displacement)
+            max_displacement = ctx.thread_max[t];
+
+    list_stats.checks++;
+    list_stats.max_displacement = max_displacement;
+    return max_displacement > 0.5f * list_skin;
+}
+
+const int* get_neighbor_offsets(void) {
+    return neighbor_offsets;
+}
+
+const int* get_neighbor_indices(void) {
+    return neighbor_indices;
+}
+
+const NeighborListStats* get_neighbor_list_stats(void) {
+    return &list_stats;
+}
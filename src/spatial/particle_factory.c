@@ -1,20 +1,101 @@
 #include "spatial/particle_factory.h"
+#include "spatial/broad_phase.h"
 #include "spatial/grid.h"
-#include "render/renderer.h"
+#include "spatial/neighbor_list.h"
+#include "physics/collision.h"
+#include "physics/forces.h"
+#include "physics/sleep.h"
 #include "core/particle.h"
-#include "core/linked_list.h"
+#include "core/particle_store.h"
+#include "core/trace.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <math.h>
 #include <time.h>
 
-void create_particles(int count) {
+static int recycle_per_step = 0;
+static Arena recycle_arena = {0};   // Rewound by every pass
+
+static void add_particle(ParticleStore* store, const Particle* particle, int i) {
+    int index = particle_store_add(store, particle);
+    if (index < 0) {
+        fprintf(stderr, "error: could not add particle %d\n", i);
+        exit(1);
+    }
+}
+
+static int compare_radii_descending(const void* a, const void* b) {
+    float ra = *(const float*)a;
+    float rb = *(const float*)b;
+    return (ra < rb) - (ra > rb);
+}
+
+// Radii from the template's up to radius_spread times it, drawn with equal
+// area in every doubling of the radius, so small particles far outnumber
+// large ones as in a graded granular mix; mass follows the area. Largest first, the particles are packed in rows, each
+// as tall as its first particle, across a square block of their total area.
+static void create_mixed_particles(int count, const Particle* template, float radius_spread) {
+    ParticleStore* store = get_particle_store();
+    float* radii = malloc(count * sizeof(float));
+    if (radii == NULL) {
+        fprintf(stderr, "error: malloc failed for particle radii\n");
+        exit(1);
+    }
+
+    double area = 0.0;
+    for (int i = 0; i < count; i++) {
+        float u = (float)rand() / RAND_MAX;
+        radii[i] = template->radius / sqrtf(1.0f - u * (1.0f - 1.0f / (radius_spread * radius_spread)));
+        area += 4.0 * radii[i] * radii[i];
+    }
+    qsort(radii, count, sizeof(float), compare_radii_descending);
+    float block_width = (float)sqrt(area);
+    printf("Packing %d particles of radius %.4f to %.4f m into a %.3f m wide block\n", count, template->radius,
+           template->radius * radius_spread, block_width);
+
+    float x_init = (domain_size - block_width) / 2;
+    float x = x_init;
+    float y = x_init;
+    float row_height = 0.0f;
+
+    for (int i = 0; i < count; i++) {
+        Particle particle = *template;
+        float r = radii[i];
+        float scale = r / template->radius;
+        particle.radius = r;
+        particle.mass = template->mass * scale * scale;
+
+        if (x + 2 * r > x_init + block_width && x > x_init) {
+            x = x_init;
+            y += row_height;
+            row_height = 0.0f;
+        }
+        particle.position[0] = x + r + ((float)rand() / RAND_MAX - 0.5f) * r;
+        particle.position[1] = y + r + ((float)rand() / RAND_MAX - 0.5f) * r;
+        particle.velocity[0] = (float)rand() / RAND_MAX;
+        particle.velocity[1] = (float)rand() / RAND_MAX;
+        x += 2 * r;
+        if (2 * r > row_height)
+            row_height = 2 * r;
+
+        add_particle(store, &particle, i);
+    }
+    free(radii);
+}
+
+void create_particles(int count, float radius_spread) {
+    ParticleStore* store = get_particle_store();
     Particle template = {
         .radius = 0.005f,
         .mass = 10.0f,
         .charge = 0.05f
     };
 
+    if (radius_spread > 1.0f) {
+        create_mixed_particles(count, &template, radius_spread);
+        return;
+    }
+
     int grid_dim = (int)ceil(sqrt(count));
     float spacing = 2 * template.radius;
     float grid_width = grid_dim * spacing;
@@ -27,33 +108,120 @@ void create_particles(int count) {
     float y_init = (domain_size - grid_width) / 2 + template.radius;
 
     for (int i = 0; i < count; i++) {
-        Particle* particle = malloc(sizeof(Particle));
-        if (particle == NULL) {
-            fprintf(stderr, "error: malloc failed for particle\n");
-            exit(1);
-        }
-        *particle = template;
+        Particle particle = template;
 
         int col = i % grid_dim;
         int row = i / grid_dim;
         float x = x_init + spacing * col;
         float y = y_init + spacing * row;
 
-        particle->position[0] = x + ((float)rand() / RAND_MAX - 0.5f) * spacing * 0.5f;
-        particle->position[1] = y + ((float)rand() / RAND_MAX - 0.5f) * spacing * 0.5f;
-        particle->velocity[0] = (float)rand() / RAND_MAX;
-        particle->velocity[1] = (float)rand() / RAND_MAX;
+        particle.position[0] = x + ((float)rand() / RAND_MAX - 0.5f) * spacing * 0.5f;
+        particle.position[1] = y + ((float)rand() / RAND_MAX - 0.5f) * spacing * 0.5f;
+        particle.velocity[0] = (float)rand() / RAND_MAX;
+        particle.velocity[1] = (float)rand() / RAND_MAX;
+
+        add_particle(store, &particle, i);
+    }
+}
+
+static int compare_indices_descending(const void* a, const void* b) {
+    int ia = *(const int*)a;
+    int ib = *(const int*)b;
+    return (ia < ib) - (ia > ib);
+}
+
+// Swap-removes the distinct indices from the highest down, so the last
+// particle moved into a hole is never one that is still to be removed.
+// new_index maps every old index to its new one, -1 for the removed.
+static void remove_and_map(ParticleStore* store, int* indices, int count, int* new_index) {
+    int old_count = store->count;
+    int* slot_origin = arena_alloc(&recycle_arena, (size_t)old_count * sizeof(int));
+    for (int i = 0; i < old_count; i++) {
+        new_index[i] = i;
+        slot_origin[i] = i;
+    }
 
-        Node* particle_node = malloc(sizeof(Node));
-        if (particle_node == NULL) {
-            fprintf(stderr, "error: malloc failed for particle_node\n");
-            exit(1);
+    qsort(indices, count, sizeof(int), compare_indices_descending);
+    for (int k = 0; k < count; k++) {
+        int index = indices[k];
+        int last = store->count - 1;
+        new_index[index] = -1;
+        if (last != index) {
+            slot_origin[index] = slot_origin[last];
+            new_index[slot_origin[index]] = index;
         }
-        particle_node->item = particle;
+        particle_store_remove(store, index);
+    }
+}
+
+// The same fix-ups as after a reorder
+static void fix_up_indices(const int* new_index) {
+    remap_collision_pairs(new_index);
+    broad_phase_remap(new_index);
 
-        Node* partition_node = compute_partition_for_particle(particle_node);
-        Node* particle_head = (Node*)partition_node->item;
-        list_append(&particle_head, particle_node);
-        partition_node->item = particle_head;
+    // Grid slots and neighbor lists refer to the old indices
+    rebuild_grid();
+    if (neighbor_list_enabled())
+        neighbor_list_build();
+}
+
+void recycle_init(int per_step) {
+    recycle_per_step = per_step > 0 ? per_step : 0;
+    arena_init(&recycle_arena, 0);
+}
+
+void recycle_cleanup(void) {
+    arena_free(&recycle_arena);
+    recycle_per_step = 0;
+}
+
+int recycle_enabled(void) {
+    return recycle_per_step > 0;
+}
+
+void recycle_particles(void) {
+    TRACE_SCOPE("recycle particles");
+    ParticleStore* store = get_particle_store();
+    int count = recycle_per_step < store->count ? recycle_per_step : store->count;
+    if (count <= 0)
+        return;
+
+    arena_reset(&recycle_arena);
+    int* picked = arena_alloc(&recycle_arena, (size_t)count * sizeof(int));
+    Particle* spawned = arena_alloc(&recycle_arena, (size_t)count * sizeof(Particle));
+    int* new_index = arena_alloc(&recycle_arena, (size_t)store->count * sizeof(int));
+    for (int k = 0; k < count; k++) {
+        int index;
+        int repeated;
+        do {
+            index = rand() % store->count;
+            repeated = 0;
+            for (int j = 0; j < k && !repeated; j++)
+                repeated = picked[j] == index;
+        } while (repeated);
+        picked[k] = index;
+        particle_store_get(store, index, &spawned[k]);
+        wake_around_particle(store, index);
     }
+
+    remove_and_map(store, picked, count, new_index);
+    for (int k = 0; k < count; k++) {
+        Particle particle = spawned[k];
+        float r = particle.radius;
+        particle.position[0] = r + (float)rand() / RAND_MAX * (domain_size - 2 * r);
+        particle.position[1] = domain_size - r - (float)rand() / RAND_MAX * r;
+        particle.velocity[0] = 0.0f;
+        particle.velocity[1] = 0.0f;
+        particle.acceleration[0] = 0.0f;
+        particle.acceleration[1] = -gravity_acceleration;
+        add_particle(store, &particle, k);
+    }
+
+    // New particles sit past the end of the old index range, where nothing
+    // cached refers to
+    fix_up_indices(new_index);
+}
+
+const Arena* get_recycle_arena(void) {
+    return &recycle_arena;
 }
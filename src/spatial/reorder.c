@@ -0,0 +1,145 @@
+#include "spatial/reorder.h"
+#include "spatial/broad_phase.h"
+#include "spatial/grid.h"
+#include "spatial/neighbor_list.h"
+#include "physics/collision.h"
+#include "core/arena.h"
+#include "core/math_utils.h"
+#include "core/particle_store.h"
+#include "core/trace.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct MortonKey {
+    uint32_t code;
+    int partition;
+} MortonKey;
+
+static int reorder_interval = 0;
+static int steps_since_reorder = 0;
+static MortonKey* morton_keys = NULL;   // Occupied partitions ranked along the curve
+static int* particle_order = NULL;      // New slot -> old particle index
+static int* new_index = NULL;           // Old particle index -> new slot
+static ReorderStats reorder_stats;
+
+static int compare_morton_keys(const void* a, const void* b) {
+    uint32_t ka = ((const MortonKey*)a)->code;
+    uint32_t kb = ((const MortonKey*)b)->code;
+    if (ka != kb)
+        return (ka > kb) - (ka < kb);
+    // Cells of different levels can share a corner
+    return ((const MortonKey*)a)->partition - ((const MortonKey*)b)->partition;
+}
+
+int reorder_enabled(void) {
+    return reorder_interval > 0;
+}
+
+void reorder_init(int interval) {
+    reorder_interval = interval > 0 ? interval : 0;
+    steps_since_reorder = 0;
+    memset(&reorder_stats, 0, sizeof(reorder_stats));
+    if (!reorder_enabled())
+        return;
+
+    ParticleStore* store = get_particle_store();
+    Arena* arena = get_simulation_arena();
+    morton_keys = arena_alloc(arena, get_partition_capacity() * sizeof(MortonKey));
+    particle_order = arena_alloc(arena, store->capacity * sizeof(int));
+    new_index = arena_alloc(arena, store->capacity * sizeof(int));
+
+    reorder_particles();
+}
+
+// Index arrays belong to the simulation arena
+void reorder_cleanup(void) {
+    morton_keys = NULL;
+    particle_order = NULL;
+    new_index = NULL;
+    reorder_interval = 0;
+}
+
+// Ranks the partitions along the curve. Hashed grids renumber their cells on
+// every rebuild and may reach negative coordinates, so this runs per reorder
+// with coordinates biased into the 16 bits the code interleaves. Cells of
+// coarser levels are ranked by their corner in level 0 cells.
+static void rank_partitions(int partition_count) {
+    for (int p = 0; p < partition_count; p++) {
+        int cx, cy;
+        get_partition_coords(p, &cx, &cy);
+        int scale = 1 << get_partition_level(p);
+        cx *= scale;
+        cy *= scale;
+        morton_keys[p].code = morton_encode((uint32_t)(cx + 0x8000), (uint32_t)(cy + 0x8000));
+        morton_keys[p].partition = p;
+    }
+    qsort(morton_keys, partition_count, sizeof(MortonKey), compare_morton_keys);
+}
+
+// Walks the particles in the order the collision pass visits them
+static float measure_scattered_fraction(void) {
+    const int* sorted = get_sorted_particles();
+    int count = get_particle_store()->count;
+    int scattered = 0;
+
+    for (int k = 1; k < count; k++)
+        scattered += abs(sorted[k] - sorted[k - 1]) > REORDER_NEAR_GAP;
+    return count > 1 ? (float)scattered / (count - 1) : 0.0f;
+}
+
+void reorder_particles(void) {
+    TRACE_SCOPE("reorder particles");
+    ParticleStore* store = get_particle_store();
+    const int* sorted = get_sorted_particles();
+    int partition_count = get_partition_count();
+    rank_partitions(partition_count);
+
+    // Walk the cells along the curve; the grid already lists each cell's
+    // particles in index order
+    int slot = 0;
+    for (int k = 0; k < partition_count; k++) {
+        int p = morton_keys[k].partition;
+        int end = get_partition_end(p);
+        for (int m = get_partition_begin(p); m < end; m++)
+            particle_order[slot++] = sorted[m];
+    }
+    for (int k = 0; k < store->count; k++)
+        new_index[particle_order[k]] = k;
+
+    particle_store_permute(store, particle_order);
+    remap_collision_pairs(new_index);
+    broad_phase_remap(new_index);
+
+    // Grid slots and neighbor lists refer to the old indices
+    rebuild_grid();
+    if (neighbor_list_enabled())
+        neighbor_list_build();
+
+    steps_since_reorder = 0;
+    reorder_stats.reorders++;
+    reorder_stats.scattered_after_reorder = measure_scattered_fraction();
+}
+
+int reorder_particles_if_needed(void) {
+    if (!reorder_enabled())
+        return 0;
+
+    steps_since_reorder++;
+    float scattered = measure_scattered_fraction();
+    reorder_stats.scattered = scattered;
+
+    int degraded = scattered > reorder_stats.scattered_after_reorder + REORDER_MAX_DEGRADATION;
+    if (!degraded && steps_since_reorder < reorder_interval)
+        return 0;
+
+    if (degraded)
+        reorder_stats.triggered_by_locality++;
+    reorder_stats.scattered_before_reorder = scattered;
+    reorder_particles();
+    return 1;
+}
+
+const ReorderStats* get_reorder_stats(void) {
+    return &reorder_stats;
+}
@@ -0,0 +1,328 @@
+#include "spatial/sort_and_sweep.h"
+#include "spatial/grid.h"
+#include "core/arena.h"
+#include "core/particle_store.h"
+#include "core/trace.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct SweepKey {
+    float lower;
+    int particle;
+} SweepKey;
+
+// Bounds of one particle of the sweep order, together for the sweep's scan
+typedef struct SweepBounds {
+    float lower;                // Along the sweep axis
+    float upper;
+    float cross_lower;          // Along the other axis
+    float cross_upper;
+} SweepBounds;
+
+// Where one particle of the sweep order sits in the grid
+typedef struct SweepCell {
+    int slot;                   // In get_sorted_particles()
+    int cx;
+    int cy;
+} SweepCell;
+
+typedef struct SweepPair {
+    int slot;                   // Grid slot of the particle the pair is filed under
+    int partner;
+} SweepPair;
+
+// Indexed by position in the sweep order, except grid_slot (by particle) and
+// sweep_offsets (by grid slot)
+static int* sweep_order = NULL;
+static int order_count = -1;            // Particles in sweep_order, -1 before the first sort
+static int insertion_backoff = 0;       // Updates left that skip the insertion sort
+static float* lower = NULL;             // Sort keys, the lower bounds along the sweep axis
+static SweepBounds* bounds = NULL;
+static SweepCell* cells = NULL;
+static SweepKey* sort_keys = NULL;
+static int* grid_slot = NULL;
+static int* sweep_offsets = NULL;
+static int* sweep_indices = NULL;
+static long indices_capacity = 0;
+static SweepPair* sweep_pairs = NULL;
+static long pairs_capacity = 0;
+static SortAndSweepStats sweep_stats;
+
+void sort_and_sweep_init(void) {
+    ParticleStore* store = get_particle_store();
+    Arena* arena = get_simulation_arena();
+    int capacity = store->capacity;
+    sweep_order = arena_alloc(arena, capacity * sizeof(int));
+    lower = arena_alloc(arena, capacity * sizeof(float));
+    bounds = arena_alloc(arena, capacity * sizeof(SweepBounds));
+    cells = arena_alloc(arena, capacity * sizeof(SweepCell));
+    sort_keys = arena_alloc(arena, capacity * sizeof(SweepKey));
+    grid_slot = arena_alloc(arena, capacity * sizeof(int));
+    sweep_offsets = arena_alloc(arena, (capacity + 1) * sizeof(int));
+    sweep_offsets[0] = 0;
+    order_count = -1;
+    insertion_backoff = 0;
+    memset(&sweep_stats, 0, sizeof(sweep_stats));
+}
+
+// The per-particle arrays belong to the simulation arena
+void sort_and_sweep_cleanup(void) {
+    free(sweep_indices);
+    free(sweep_pairs);
+    sweep_indices = NULL;
+    sweep_pairs = NULL;
+    indices_capacity = 0;
+    pairs_capacity = 0;
+    sweep_order = NULL;
+    lower = NULL;
+    bounds = NULL;
+    cells = NULL;
+    sort_keys = NULL;
+    grid_slot = NULL;
+    sweep_offsets = NULL;
+    order_count = -1;
+}
+
+static void reserve_sweep_pairs(long needed) {
+    if (needed <= pairs_capacity)
+        return;
+    long capacity = pairs_capacity > 0 ? pairs_capacity : 4096;
+    while (capacity < needed)
+        capacity *= 2;
+    SweepPair* resized = realloc(sweep_pairs, capacity * sizeof(SweepPair));
+    if (resized == NULL) {
+        fprintf(stderr, "error: realloc failed for sort-and-sweep pairs\n");
+        exit(1);
+    }
+    sweep_pairs = resized;
+    pairs_capacity = capacity;
+}
+
+static void reserve_sweep_indices(long needed) {
+    if (needed <= indices_capacity)
+        return;
+    long capacity = indices_capacity > 0 ? indices_capacity : 4096;
+    while (capacity < needed)
+        capacity *= 2;
+    int* resized = realloc(sweep_indices, capacity * sizeof(int));
+    if (resized == NULL) {
+        fprintf(stderr, "error: realloc failed for sort-and-sweep candidates\n");
+        exit(1);
+    }
+    sweep_indices = resized;
+    indices_capacity = capacity;
+}
+
+// Bounds of particle i along one axis over a step of length dt
+static void swept_bounds(const float* position, const float* velocity, const float* acceleration,
+                         const float* radius, int i, float dt, float* low, float* high) {
+    float start = position[i];
+    float end = start + (velocity[i] + acceleration[i] * dt) * dt;
+    *low = fminf(start, end) - radius[i];
+    *high = fmaxf(start, end) + radius[i];
+}
+
+static int compare_keys(const void* a, const void* b) {
+    const SweepKey* ka = a;
+    const SweepKey* kb = b;
+    if (ka->lower != kb->lower)
+        return ka->lower < kb->lower ? -1 : 1;
+    return ka->particle - kb->particle;
+}
+
+static void full_sort(int count) {
+    for (int k = 0; k < count; k++) {
+        sort_keys[k].lower = lower[k];
+        sort_keys[k].particle = sweep_order[k];
+    }
+    qsort(sort_keys, count, sizeof(SweepKey), compare_keys);
+    for (int k = 0; k < count; k++) {
+        lower[k] = sort_keys[k].lower;
+        sweep_order[k] = sort_keys[k].particle;
+    }
+    sweep_stats.full_sorts++;
+}
+
+// Returns 0, leaving a valid but partly sorted order, once the moves run out
+static int insertion_sort(int count, long max_moves) {
+    long moves = 0;
+    for (int k = 1; k < count; k++) {
+        float key = lower[k];
+        int particle = sweep_order[k];
+        int m = k - 1;
+        while (m >= 0 && lower[m] > key) {
+            lower[m + 1] = lower[m];
+            sweep_order[m + 1] = sweep_order[m];
+            m--;
+        }
+        moves += k - 1 - m;
+        lower[m + 1] = key;
+        sweep_order[m + 1] = particle;
+        if (moves > max_moves) {
+            sweep_stats.moves = moves;
+            return 0;
+        }
+    }
+    sweep_stats.moves = moves;
+    return 1;
+}
+
+// The axis the positions spread furthest along, kept until the other one
+// spreads clearly further
+static int choose_axis(const ParticleStore* store, int current) {
+    int count = store->count;
+    double sum_x = 0.0, sum_y = 0.0, sum_xx = 0.0, sum_yy = 0.0;
+    for (int i = 0; i < count; i++) {
+        double x = store->position_x[i];
+        double y = store->position_y[i];
+        sum_x += x;
+        sum_y += y;
+        sum_xx += x * x;
+        sum_yy += y * y;
+    }
+    if (count == 0)
+        return current;
+    double spread_x = sum_xx / count - (sum_x / count) * (sum_x / count);
+    double spread_y = sum_yy / count - (sum_y / count) * (sum_y / count);
+    double ratio = (double)SWEEP_AXIS_SWITCH_RATIO * SWEEP_AXIS_SWITCH_RATIO;
+    if (current == 0 && spread_y > ratio * spread_x)
+        return 1;
+    if (current == 1 && spread_x > ratio * spread_y)
+        return 0;
+    return current;
+}
+
+// Files every overlapping pair under the grid slot of the particle whose
+// cell's forward stencil holds the other, then lays the lists out by slot in
+// sweep order
+static void sweep(int count) {
+    memset(sweep_offsets, 0, (count + 1) * sizeof(int));
+
+    long pair_count = 0;
+    int beyond_stencil = 0;
+    for (int k = 0; k < count; k++) {
+        SweepBounds box = bounds[k];
+        for (int m = k + 1; m < count && bounds[m].lower <= box.upper; m++) {
+            if (bounds[m].cross_lower > box.cross_upper || bounds[m].cross_upper < box.cross_lower)
+                continue;
+
+            int dx = cells[m].cx - cells[k].cx;
+            int dy = cells[m].cy - cells[k].cy;
+            if (dx < -1 || dx > 1 || dy < -1 || dy > 1) {
+                beyond_stencil++;
+                continue;
+            }
+            int owner = k;
+            int partner = m;
+            if ((dx != 0 || dy != 0) && !grid_offset_is_forward(dx, dy)) {
+                owner = m;
+                partner = k;
+            }
+            reserve_sweep_pairs(pair_count + 1);
+            sweep_pairs[pair_count].slot = cells[owner].slot;
+            sweep_pairs[pair_count].partner = sweep_order[partner];
+            sweep_offsets[cells[owner].slot + 1]++;
+            pair_count++;
+        }
+    }
+
+    for (int k = 0; k < count; k++)
+        sweep_offsets[k + 1] += sweep_offsets[k];
+    reserve_sweep_indices(pair_count);
+    // Filled with the offsets of the next slot as cursors, shifted back after
+    for (long p = 0; p < pair_count; p++)
+        sweep_indices[sweep_offsets[sweep_pairs[p].slot]++] = sweep_pairs[p].partner;
+    for (int k = count; k > 0; k--)
+        sweep_offsets[k] = sweep_offsets[k - 1];
+    sweep_offsets[0] = 0;
+
+    sweep_stats.candidates = pair_count;
+    sweep_stats.beyond_stencil = beyond_stencil;
+}
+
+void sort_and_sweep_update(float dt) {
+    TRACE_SCOPE("sort and sweep");
+    ParticleStore* store = get_particle_store();
+    int count = store->count;
+
+    int axis = choose_axis(store, sweep_stats.axis);
+    int full = order_count != count;
+    if (axis != sweep_stats.axis) {
+        sweep_stats.axis = axis;
+        sweep_stats.axis_switches++;
+        full = 1;
+    }
+    if (order_count != count) {
+        for (int k = 0; k < count; k++)
+            sweep_order[k] = k;
+        order_count = count;
+    }
+
+    const float* along = axis == 0 ? store->position_x : store->position_y;
+    const float* along_velocity = axis == 0 ? store->velocity_x : store->velocity_y;
+    const float* along_acceleration = axis == 0 ? store->acceleration_x : store->acceleration_y;
+    const float* cross = axis == 0 ? store->position_y : store->position_x;
+    const float* cross_velocity = axis == 0 ? store->velocity_y : store->velocity_x;
+    const float* cross_acceleration = axis == 0 ? store->acceleration_y : store->acceleration_x;
+
+    // Sorted by the lower bounds alone; the rest follow the sorted order
+    float upper;
+    for (int k = 0; k < count; k++)
+        swept_bounds(along, along_velocity, along_acceleration, store->radius, sweep_order[k], dt,
+                     &lower[k], &upper);
+
+    sweep_stats.moves = 0;
+    int in_order = 0;
+    if (!full && insertion_backoff == 0) {
+        in_order = insertion_sort(count, (long)SWEEP_MAX_MOVES_PER_PARTICLE * count);
+        if (!in_order) {
+            sweep_stats.failed_insertions++;
+            insertion_backoff = SWEEP_INSERTION_BACKOFF;
+        }
+    } else if (insertion_backoff > 0) {
+        insertion_backoff--;
+    }
+    if (!in_order)
+        full_sort(count);
+    sweep_stats.total_moves += sweep_stats.moves;
+
+    const int* sorted = get_sorted_particles();
+    for (int k = 0; k < count; k++)
+        grid_slot[sorted[k]] = k;
+    for (int k = 0; k < count; k++) {
+        int i = sweep_order[k];
+        cells[k].slot = grid_slot[i];
+        get_partition_coords(get_particle_partition(i), &cells[k].cx, &cells[k].cy);
+        SweepBounds* box = &bounds[k];
+        swept_bounds(along, along_velocity, along_acceleration, store->radius, i, dt, &box->lower, &box->upper);
+        swept_bounds(cross, cross_velocity, cross_acceleration, store->radius, i, dt,
+                     &box->cross_lower, &box->cross_upper);
+    }
+
+    sweep(count);
+    sweep_stats.updates++;
+}
+
+// Removed particles leave the order, the rest keep their place in it
+void sort_and_sweep_remap(const int* new_index) {
+    int kept = 0;
+    for (int k = 0; k < order_count; k++)
+        if (new_index[sweep_order[k]] >= 0)
+            sweep_order[kept++] = new_index[sweep_order[k]];
+    if (order_count >= 0)
+        order_count = kept;
+}
+
+const int* get_sweep_offsets(void) {
+    return sweep_offsets;
+}
+
+const int* get_sweep_indices(void) {
+    return sweep_indices;
+}
+
+const SortAndSweepStats* get_sort_and_sweep_stats(void) {
+    return &sweep_stats;
+}
@@ -0,0 +1,78 @@
+#include "spatial/spatial_hash.h"
+#include "core/arena.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+static unsigned int hash_cell(int cx, int cy) {
+    // Large odd multipliers from the usual 2D spatial hashing scheme
+    return ((uint32_t)cx * 73856093u) ^ ((uint32_t)cy * 19349663u);
+}
+
+void spatial_hash_init(SpatialHash* hash, int max_cells) {
+    unsigned int size = 16;
+    while (size < 2u * (unsigned int)max_cells)
+        size *= 2;
+
+    // Sized for the worst case once, so it lives in the simulation arena
+    Arena* arena = get_simulation_arena();
+    hash->entries = arena_alloc(arena, size * sizeof(SpatialHashEntry));
+    hash->cell_x = arena_alloc(arena, max_cells * sizeof(int));
+    hash->cell_y = arena_alloc(arena, max_cells * sizeof(int));
+    hash->mask = size - 1;
+    hash->max_cells = max_cells;
+    hash->probes = 0;
+    hash->lookups = 0;
+    spatial_hash_clear(hash);
+}
+
+// The table belongs to the simulation arena
+void spatial_hash_free(SpatialHash* hash) {
+    memset(hash, 0, sizeof(*hash));
+}
+
+void spatial_hash_clear(SpatialHash* hash) {
+    // All-ones bytes make every id -1
+    memset(hash->entries, 0xff, (hash->mask + 1) * sizeof(SpatialHashEntry));
+    hash->count = 0;
+}
+
+int spatial_hash_insert(SpatialHash* hash, int cx, int cy) {
+    unsigned int slot = hash_cell(cx, cy) & hash->mask;
+    hash->lookups++;
+
+    for (;;) {
+        SpatialHashEntry* entry = &hash->entries[slot];
+        hash->probes++;
+        if (entry->id < 0) {
+            if (hash->count >= hash->max_cells) {
+                fprintf(stderr, "error: spatial hash full (%d cells)\n", hash->max_cells);
+                return -1;
+            }
+            entry->cx = cx;
+            entry->cy = cy;
+            entry->id = hash->count;
+            hash->cell_x[entry->id] = cx;
+            hash->cell_y[entry->id] = cy;
+            return hash->count++;
+        }
+        if (entry->cx == cx && entry->cy == cy)
+            return entry->id;
+        slot = (slot + 1) & hash->mask;
+    }
+}
+
+int spatial_hash_find(SpatialHash* hash, int cx, int cy) {
+    unsigned int slot = hash_cell(cx, cy) & hash->mask;
+    hash->lookups++;
+
+    for (;;) {
+        const SpatialHashEntry* entry = &hash->entries[slot];
+        hash->probes++;
+        if (entry->id < 0)
+            return -1;
+        if (entry->cx == cx && entry->cy == cy)
+            return entry->id;
+        slot = (slot + 1) & hash->mask;
+    }
+}